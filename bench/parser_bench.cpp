@@ -0,0 +1,324 @@
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+#include "json.h"
+#include "json_binary.h"
+#include "json_snapshot.h"
+#include "parse_cache.h"
+#include "parser.h"
+#include "tools/cpp/runfiles/runfiles.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Throughput of parsing, serializing, traversing and looking up members, over
+// the standard corpora and synthetic documents, next to nlohmann::json doing
+// the same. Every benchmark reports MB/s of JSON text and documents (or
+// lookups) per second. Run with
+//
+//     bazel run -c opt //bench -- --benchmark_filter=twitter
+//
+// The corpora are read from data/bench/, and a run without all of them fails
+// rather than quietly measuring a different set; pass --synthetic_only to run
+// just the synthetic documents. Those come from fixed seeds, so every run
+// measures the same input.
+
+namespace {
+
+struct Document {
+    std::string name;
+    std::string text;
+};
+
+// standard corpora, data/bench/<name>.json
+const char* const CORPORA[] = {"twitter", "canada", "citm_catalog"};
+
+std::optional<std::string> read_corpus(const bazel::tools::cpp::runfiles::Runfiles& runfiles, const std::string& name) {
+    std::ifstream file(runfiles.Rlocation("custom_json_parser/data/bench/" + name + ".json"), std::ios::binary);
+    if (!file.is_open())
+        return std::nullopt;
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+// {"level":0,"next":[{"level":1,"next":[ ... null ... ]}]} nested depth times,
+// each level is two deep so depth has to stay below DEFAULT_MAX_DEPTH / 2
+std::string deep_nesting(size_t depth) {
+    std::string text;
+    for (size_t idx = 0; idx < depth; idx++) text += R"({"level":)" + std::to_string(idx) + R"(,"next":[)";
+    text += "null";
+    for (size_t idx = 0; idx < depth; idx++) text += "]}";
+    return text;
+}
+
+// one array of small homogeneous records
+std::string huge_array(size_t count) {
+    std::mt19937 random(1);
+    std::string text = "[";
+    for (size_t idx = 0; idx < count; idx++) {
+        if (idx) text += ',';
+        text += R"({"id":)" + std::to_string(idx) + R"(,"active":)" + (random() % 2 ? "true" : "false") +
+                R"(,"name":"user)" + std::to_string(random() % 100000) + R"(","tags":["a","b"]})";
+    }
+    return text + "]";
+}
+
+// a few strings of length bytes each, with the odd escape
+std::string long_strings(size_t count, size_t length) {
+    std::mt19937 random(2);
+    std::string text = "[";
+    for (size_t idx = 0; idx < count; idx++) {
+        if (idx) text += ',';
+        text += '"';
+        for (size_t pos = 0; pos < length; pos++) {
+            if (random() % 512 == 0) text += "\\n";
+            else text += static_cast<char>('a' + random() % 26);
+        }
+        text += '"';
+    }
+    return text + "]";
+}
+
+// rows of integers and doubles with exponents
+std::string number_heavy(size_t rows) {
+    std::mt19937_64 random(3);
+    std::uniform_real_distribution<double> real(-1e6, 1e6);
+    std::string text = "[";
+    for (size_t row = 0; row < rows; row++) {
+        text += row ? ",[" : "[";
+        for (size_t col = 0; col < 8; col++) {
+            if (col) text += ',';
+            if (col % 2) text += std::to_string(static_cast<int64_t>(random()));
+            else {
+                std::ostringstream number;
+                number.precision(17);
+                number << real(random) * (col == 4 ? 1e-300 : 1.0);
+                text += number.str();
+            }
+        }
+        text += ']';
+    }
+    return text + "]";
+}
+
+// the corpora unless synthetic_only, then the synthetic documents; nothing if
+// a corpus is missing
+std::optional<std::vector<Document>> load_documents(const char* argv0, bool synthetic_only) {
+    std::vector<Document> documents;
+    std::string error;
+    std::unique_ptr<bazel::tools::cpp::runfiles::Runfiles> runfiles(bazel::tools::cpp::runfiles::Runfiles::Create(argv0, &error));
+    for (const char* name: synthetic_only ? std::span<const char* const>() : std::span(CORPORA)) {
+        std::optional<std::string> text = runfiles ? read_corpus(*runfiles, name) : std::nullopt;
+        if (!text.has_value()) {
+            std::cerr << "data/bench/" << name << ".json not found; add the corpus, or pass --synthetic_only\n";
+            return std::nullopt;
+        }
+        documents.push_back(Document{name, std::move(*text)});
+    }
+    documents.push_back(Document{"deep_nesting", deep_nesting(500)});
+    documents.push_back(Document{"huge_array", huge_array(100000)});
+    documents.push_back(Document{"long_strings", long_strings(64, 64 * 1024)});
+    documents.push_back(Document{"number_heavy", number_heavy(50000)});
+    return documents;
+}
+
+// bytes of JSON text and documents or lookups handled per iteration
+void set_throughput(benchmark::State& state, size_t bytes, size_t items) {
+    if (bytes != 0)
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * items));
+}
+
+// Adds up the numbers and string lengths of the whole tree, so every value is
+// read and nothing can be optimized away.
+double traverse(const JsonValue& value) {
+    switch (value.type()) {
+        case JsonValue::Type::Number: return value.as_double();
+        case JsonValue::Type::String: return static_cast<double>(value.as_string().size());
+        case JsonValue::Type::Boolean: return value.as_boolean();
+        case JsonValue::Type::Object: {
+            double sum = 0;
+            for (const auto& [key, member]: value.as_object()) sum += key.view().size() + traverse(member);
+            return sum;
+        }
+        case JsonValue::Type::Array: {
+            double sum = 0;
+            for (const auto& element: value.as_array()) sum += traverse(element);
+            return sum;
+        }
+        default: return 0;
+    }
+}
+
+double traverse(const nlohmann::json& value) {
+    switch (value.type()) {
+        case nlohmann::json::value_t::number_float: return value.get<double>();
+        case nlohmann::json::value_t::number_integer: return static_cast<double>(value.get<int64_t>());
+        case nlohmann::json::value_t::number_unsigned: return static_cast<double>(value.get<uint64_t>());
+        case nlohmann::json::value_t::string: return static_cast<double>(value.get_ref<const std::string&>().size());
+        case nlohmann::json::value_t::boolean: return value.get<bool>();
+        case nlohmann::json::value_t::object: {
+            double sum = 0;
+            for (const auto& [key, member]: value.items()) sum += key.size() + traverse(member);
+            return sum;
+        }
+        case nlohmann::json::value_t::array: {
+            double sum = 0;
+            for (const auto& element: value) sum += traverse(element);
+            return sum;
+        }
+        default: return 0;
+    }
+}
+
+// every (object, key) pair of the tree, to be looked up again
+void collect_lookups(const JsonValue& value, std::vector<std::pair<const JsonValue*, std::string>>& lookups) {
+    if (value.type() == JsonValue::Type::Object) {
+        for (const auto& [key, member]: value.as_object()) {
+            lookups.emplace_back(&value, std::string(key.view()));
+            collect_lookups(member, lookups);
+        }
+    } else if (value.type() == JsonValue::Type::Array) {
+        for (const auto& element: value.as_array()) collect_lookups(element, lookups);
+    }
+}
+
+void collect_lookups(const nlohmann::json& value, std::vector<std::pair<const nlohmann::json*, std::string>>& lookups) {
+    if (value.is_object()) {
+        for (const auto& [key, member]: value.items()) {
+            lookups.emplace_back(&value, key);
+            collect_lookups(member, lookups);
+        }
+    } else if (value.is_array()) {
+        for (const auto& element: value) collect_lookups(element, lookups);
+    }
+}
+
+void register_benchmarks(const Document& document) {
+    const std::string& text = document.text;
+    const std::string& name = document.name;
+
+    benchmark::RegisterBenchmark(("parse/" + name).c_str(), [&text](benchmark::State& state) {
+        for (auto _: state) benchmark::DoNotOptimize(parse(std::string_view(text)));
+        set_throughput(state, text.size(), 1);
+    });
+    benchmark::RegisterBenchmark(("parse_simd/" + name).c_str(), [&text](benchmark::State& state) {
+        for (auto _: state) benchmark::DoNotOptimize(parse_simd(text));
+        set_throughput(state, text.size(), 1);
+    });
+    benchmark::RegisterBenchmark(("parse_borrowed/" + name).c_str(), [&text](benchmark::State& state) {
+        for (auto _: state) benchmark::DoNotOptimize(parse_borrowed(text));
+        set_throughput(state, text.size(), 1);
+    });
+    // the checks of parse/<input> without building the document
+    benchmark::RegisterBenchmark(("validate/" + name).c_str(), [&text](benchmark::State& state) {
+        for (auto _: state) benchmark::DoNotOptimize(validate(text));
+        set_throughput(state, text.size(), 1);
+    });
+    // a repeat of an input the cache already holds
+    benchmark::RegisterBenchmark(("parse_cached/" + name).c_str(), [&text](benchmark::State& state) {
+        ParseCache cache(size_t(1) << 30, 1);
+        cache.parse(text);
+        for (auto _: state) benchmark::DoNotOptimize(cache.parse(text));
+        set_throughput(state, text.size(), 1);
+        state.counters["hits"] = static_cast<double>(cache.counters().hits);
+    });
+    // bytes are those of the JSON text, so the rate compares with parsing it
+    benchmark::RegisterBenchmark(("read_binary/" + name).c_str(), [&text](benchmark::State& state) {
+        std::string binary;
+        write_binary(*parse(std::string_view(text)), binary);
+        for (auto _: state) benchmark::DoNotOptimize(read_binary(binary));
+        set_throughput(state, text.size(), 1);
+        state.counters["binary_size"] = static_cast<double>(binary.size()) / text.size();
+    });
+    // what startup costs with a snapshot instead of parse/<input>
+    benchmark::RegisterBenchmark(("open_snapshot/" + name).c_str(), [&text, name](benchmark::State& state) {
+        std::string path = std::filesystem::temp_directory_path() / ("bench_" + name + ".snap");
+        write_snapshot(*parse(std::string_view(text)), path);
+        for (auto _: state) benchmark::DoNotOptimize(open_snapshot(path)->root().size());
+        set_throughput(state, text.size(), 1);
+        std::filesystem::remove(path);
+    });
+    benchmark::RegisterBenchmark(("nlohmann_parse/" + name).c_str(), [&text](benchmark::State& state) {
+        for (auto _: state) benchmark::DoNotOptimize(nlohmann::json::parse(text));
+        set_throughput(state, text.size(), 1);
+    });
+
+    benchmark::RegisterBenchmark(("serialize/" + name).c_str(), [&text](benchmark::State& state) {
+        JsonValue value = *parse(std::string_view(text));
+        size_t bytes = value.to_string().size();
+        for (auto _: state) benchmark::DoNotOptimize(value.to_string());
+        set_throughput(state, bytes, 1);
+    });
+    benchmark::RegisterBenchmark(("nlohmann_serialize/" + name).c_str(), [&text](benchmark::State& state) {
+        nlohmann::json value = nlohmann::json::parse(text);
+        size_t bytes = value.dump().size();
+        for (auto _: state) benchmark::DoNotOptimize(value.dump());
+        set_throughput(state, bytes, 1);
+    });
+
+    benchmark::RegisterBenchmark(("traverse/" + name).c_str(), [&text](benchmark::State& state) {
+        JsonValue value = *parse(std::string_view(text));
+        for (auto _: state) benchmark::DoNotOptimize(traverse(value));
+        set_throughput(state, text.size(), 1);
+    });
+    benchmark::RegisterBenchmark(("nlohmann_traverse/" + name).c_str(), [&text](benchmark::State& state) {
+        nlohmann::json value = nlohmann::json::parse(text);
+        for (auto _: state) benchmark::DoNotOptimize(traverse(value));
+        set_throughput(state, text.size(), 1);
+    });
+
+    // items are lookups here, every member of every object once per iteration
+    benchmark::RegisterBenchmark(("lookup/" + name).c_str(), [&text](benchmark::State& state) {
+        JsonValue value = *parse(std::string_view(text));
+        std::vector<std::pair<const JsonValue*, std::string>> lookups;
+        collect_lookups(value, lookups);
+        for (auto _: state) {
+            for (const auto& [object, key]: lookups) benchmark::DoNotOptimize(&object->at(key));
+        }
+        set_throughput(state, 0, lookups.size());
+    });
+    benchmark::RegisterBenchmark(("nlohmann_lookup/" + name).c_str(), [&text](benchmark::State& state) {
+        nlohmann::json value = nlohmann::json::parse(text);
+        std::vector<std::pair<const nlohmann::json*, std::string>> lookups;
+        collect_lookups(value, lookups);
+        for (auto _: state) {
+            for (const auto& [object, key]: lookups) benchmark::DoNotOptimize(&object->at(key));
+        }
+        set_throughput(state, 0, lookups.size());
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    // our one flag, taken out before the benchmark library sees the rest
+    bool synthetic_only = false;
+    for (int idx = 1; idx < argc; idx++) {
+        if (std::string_view(argv[idx]) != "--synthetic_only") continue;
+        synthetic_only = true;
+        std::copy(argv + idx + 1, argv + argc + 1, argv + idx);
+        argc--;
+        break;
+    }
+
+    // the documents have to stay put, the benchmarks refer to them
+    static std::optional<std::vector<Document>> documents = load_documents(argv[0], synthetic_only);
+    if (!documents.has_value())
+        return 1;
+    for (const Document& document: *documents)
+        register_benchmarks(document);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include "parse_result.h"
 #include <iostream>
 #include <fstream>
 #include <optional>
@@ -22,9 +23,20 @@ struct BufferReader {
 
     std::optional<char> peek() const;
 
-    char throw_next_byte();
+    // the next byte, or '\0' once the input is exhausted or the stream failed
+    char current() const;
 
-    char throw_peek() const;
+    // consumes one byte, does nothing once the input is exhausted
+    void advance();
+
+    // whether the next advance() has to refill the buffer from the stream
+    bool refill_pending() const;
+
+    // number of bytes consumed so far
+    size_t offset() const;
+
+    // line and column of the next byte
+    SourceLocation location() const;
 
 private:
     void update_buffer();
@@ -34,4 +46,9 @@ private:
     size_t cur_read_size = 0;
     Status next_byte_status = Status::OKAY;
     std::istream& stream;
-};
\ No newline at end of file
+
+    // bookkeeping for the chunks already discarded, so errors can be located
+    size_t consumed_before_buffer = 0;
+    size_t lines_before_buffer = 0;
+    size_t line_start_before_buffer = 0;
+};
@@ -1,8 +1,12 @@
 #pragma once
 
 #include <variant>
-#include <boost/container/map.hpp>
+#include "json_object.h"
+#include "key_pool.h"
+#include <cstdint>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace JsonConstants {
@@ -32,10 +36,20 @@ namespace JsonConstants {
 struct JsonValue;
 
 // We are deliberately not using shared_ptr. 
+// Allocator-aware in the std::pmr sense: every string and container inside a
+// JsonValue comes from the memory resource it was constructed with, and values
+// moved or copied into a container are rebuilt with the container's resource.
+// Parsing with a std::pmr::monotonic_buffer_resource turns every allocation of
+// the document into a pointer bump and freeing it into a single release().
 struct JsonValue {
 
-    using Object = boost::container::map<std::string, JsonValue>;
-    using Array = std::vector<JsonValue>;
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+
+    using String = std::pmr::string;
+    // Keys are interned in KeyPool::current() when they are inserted, so every
+    // object shares one copy of each key. Members keep their insertion order.
+    using Object = JsonObject;
+    using Array = std::pmr::vector<JsonValue>;
 
     enum class Type {
         Null,
@@ -46,7 +60,15 @@ struct JsonValue {
         Array
     };
 
-    static constexpr char* TypeNames[] = {
+    // how a Number is held; integers that fit are kept exactly instead of
+    // being rounded to a double
+    enum class NumberType {
+        Double,
+        Int64,
+        UInt64
+    };
+
+    static constexpr const char* TypeNames[] = {
         "null type",
         "number type",
         "boolean type",
@@ -55,41 +77,71 @@ struct JsonValue {
         "array type"
     };
 
-    using var_t = std::variant<std::nullptr_t, double, bool, std::string, Object, Array>;
+    // the integer and borrowed string alternatives come last so that index() of
+    // the others matches Type
+    using var_t = std::variant<std::nullptr_t, double, bool, String, Object, Array, int64_t, uint64_t, std::string_view>;
 
     JsonValue();
-
-    JsonValue(nullptr_t _value);
-    JsonValue(bool _value);
-    JsonValue(int _value);
-    JsonValue(double _value);
-    JsonValue(const std::string& _value);
-    JsonValue(const char * _value);
-
-    JsonValue(Type _type);
+    explicit JsonValue(const allocator_type& alloc);
+
+    JsonValue(nullptr_t _value, const allocator_type& alloc = {});
+    JsonValue(bool _value, const allocator_type& alloc = {});
+    JsonValue(int _value, const allocator_type& alloc = {});
+    JsonValue(int64_t _value, const allocator_type& alloc = {});
+    JsonValue(uint64_t _value, const allocator_type& alloc = {});
+    JsonValue(double _value, const allocator_type& alloc = {});
+    JsonValue(std::string_view _value, const allocator_type& alloc = {});
+    JsonValue(const std::string& _value, const allocator_type& alloc = {});
+    JsonValue(const char * _value, const allocator_type& alloc = {});
+    // adopts the string together with its allocator
+    JsonValue(String&& _value);
+
+    JsonValue(Type _type, const allocator_type& alloc = {});
+
+    // as with the std::pmr containers, a plain copy uses the default resource
+    // and a move keeps the source's resource
+    JsonValue(const JsonValue& other);
+    JsonValue(const JsonValue& other, const allocator_type& alloc);
+    JsonValue(JsonValue&& other) noexcept;
+    JsonValue(JsonValue&& other, const allocator_type& alloc);
+
+    // assignment never changes the resource of the assigned-to value
+    JsonValue& operator=(const JsonValue& other);
+    JsonValue& operator=(JsonValue&& other);
+
+    allocator_type get_allocator() const;
 
     Type type() const;
 
+    NumberType number_type() const;
+
     bool as_boolean() const;
+    // any number, integers beyond 2^53 are rounded
     double as_double() const;
-    const std::string& as_string() const;
+    // exact, throws std::out_of_range if the number is not an integer in range
+    int64_t as_int64() const;
+    uint64_t as_uint64() const;
+    // owned or borrowed alike
+    std::string_view as_string() const;
     const Object& as_object() const;
     const Array& as_array() const;
 
-    JsonValue& at(const std::string& index);
-    const JsonValue& at(const std::string& index) const;
+    JsonValue& at(std::string_view index);
+    const JsonValue& at(std::string_view index) const;
+    // the member for an already interned key, added as null if missing
+    JsonValue& at(const JsonKey& key);
     JsonValue& at(int index);
     const JsonValue& at(int index) const;
 
-    bool exists(const std::string& index) const;
+    bool exists(std::string_view index) const;
     bool exists(const int index) const;
 
-    void set_index(const std::string& index, const JsonValue& _value);
-    void set_index(const std::string& index, JsonValue&& _value);
-    void set_index(const std::string& index, const Array& _value);
-    void set_index(const std::string& index, Array&& _value);
-    void set_index(const std::string& index, const Object& _value);
-    void set_index(const std::string& index, Object&& _value);
+    void set_index(std::string_view index, const JsonValue& _value);
+    void set_index(std::string_view index, JsonValue&& _value);
+    void set_index(std::string_view index, const Array& _value);
+    void set_index(std::string_view index, Array&& _value);
+    void set_index(std::string_view index, const Object& _value);
+    void set_index(std::string_view index, Object&& _value);
     void set_index(const int index, const JsonValue& _value);
     void set_index(const int index, JsonValue&& _value);
     void set_index(const int index, const Array& _value);
@@ -103,32 +155,42 @@ struct JsonValue {
     void push_back(Array&& _value);
     void push_back(const Object& _value);
     void push_back(Object&& _value);
+    // appends a null element that shares this value's resource and returns it,
+    // so the caller can build the element in place
+    JsonValue& emplace_back();
 
     void set_value(bool _value);
     void set_value(double _value);
+    void set_value(int64_t _value);
+    void set_value(uint64_t _value);
     void set_value(const std::string& _value);
     void set_value(std::string&& _value);
+    void set_value(String&& _value);
     void set_value(const Object& _value);
     void set_value(Object&& _value);
+    // A string that refers to characters owned by someone else, who has to keep
+    // them alive as long as this value and its copies, which borrow them too.
+    void borrow_string(std::string_view _value);
+    bool is_borrowed() const;
     void set_value(const Array& _value);
     void set_value(Array&& _value);
 
     void set_type(Type type);
 
+    // compact JSON, see write_json() in json_writer.h for pretty printing and
+    // for writing to a stream or file descriptor
     std::string to_string() const;
 
 private:
 
-    JsonValue(const Object& _value);
-    JsonValue(const Array& _array);
-    JsonValue(Object&& _value);
-    JsonValue(Array&& _value);
+    JsonValue(const Object& _value, const allocator_type& alloc = {});
+    JsonValue(const Array& _array, const allocator_type& alloc = {});
+    JsonValue(Object&& _value, const allocator_type& alloc = {});
+    JsonValue(Array&& _value, const allocator_type& alloc = {});
     
     void verify_type(Type expected) const;
     void verify_index(int index) const;
 
-    std::string object_to_string() const;
-    std::string array_to_string() const;
-
+    allocator_type alloc;
     var_t value;
 };
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "json.h"
+#include "parse_result.h"
+
+#include <cstdint>
+#include <memory_resource>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Compact binary form of a JsonValue, for passing documents between services
+// without printing and re-parsing text. Every value is a tag byte and its
+// payload; integers are little endian and as narrow as their value allows,
+// lengths and counts are LEB128 varints:
+//
+//   0x00 - 0x7f    unsigned integer 0 - 127, no payload
+//   0x80 - 0x82    null, false, true
+//   0x83 - 0x86    unsigned integer in 1, 2, 4 or 8 bytes
+//   0x87 - 0x8a    signed integer in 1, 2, 4 or 8 bytes
+//   0x8b, 0x8c     double held as a float when that is exact, or as a double
+//   0x8d           string, length then bytes
+//   0x8e           array, element count then the elements
+//   0x8f           object, member count then key and value per member
+//   0xa0 - 0xbf    string of 0 - 31 bytes, the bytes follow
+//   0xe0 - 0xff    signed integer -32 - -1, no payload
+//
+// Each document starts with BINARY_MAGIC and carries its own key dictionary,
+// built as it goes: a key is a varint, id << 1 for one seen before in the
+// document, or length << 1 | 1 followed by the bytes for a new one, which gets
+// the next id. Integers keep whether they were signed, so a decoded document
+// is the same JsonValue as the encoded one.
+constexpr std::string_view BINARY_MAGIC = "JB\x01";
+
+// appends the encoding of value to out
+void write_binary(const JsonValue& value, std::string& out);
+
+// streams the encoding in chunks, it is never held in memory as a whole
+void write_binary(const JsonValue& value, std::ostream& out);
+
+// Rebuilds the document, allocated from resource and with keys interned in
+// KeyPool::current(). Malformed input fails with ParseError::InvalidEncoding
+// or UnexpectedEnd, at the offset of the offending byte. Nesting is limited to
+// DEFAULT_MAX_DEPTH as for parse().
+ParseResult read_binary(std::string_view input, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
@@ -0,0 +1,423 @@
+#pragma once
+
+#include "json_writer.h"
+#include "parser.h"
+#include "sax_parser.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Binding between JSON and plain C++ structs with no JsonValue in between. A
+// struct becomes bindable by listing its members:
+//
+//   struct Order { int64_t id; double price; std::vector<Fill> fills; };
+//
+//   template <>
+//   struct JsonFields<Order> {
+//       static constexpr auto fields = std::make_tuple(JSON_FIELD(Order, id), JSON_FIELD(Order, price),
+//                                                      JSON_FIELD(Order, fills));
+//   };
+//
+// after which parse_into<Order>(text) fills an Order straight from the input
+// and serialize(order) writes one back out. Members may be bool, integers,
+// floating point, std::string, std::optional, std::vector and other bound
+// structs. Keys are found through a perfect hash built at compile time.
+//
+// Unknown keys are skipped and members whose key is missing keep their value.
+// A value of the wrong JSON type fails with ParseError::TypeMismatch, as does
+// a number that does not fit its member: integers take no fraction, exponent
+// or -0. null is only accepted by std::optional.
+template <typename T>
+struct JsonFields;
+
+template <typename Struct, typename Member>
+struct JsonField {
+    std::string_view name;
+    Member Struct::*member;
+};
+
+template <typename Struct, typename Member>
+constexpr JsonField<Struct, Member> json_field(std::string_view name, Member Struct::*member) {
+    return {name, member};
+}
+
+// the member's own name as its key
+#define JSON_FIELD(Struct, member) json_field(#member, &Struct::member)
+
+namespace JsonBinding {
+
+template <typename T>
+constexpr size_t field_count = std::tuple_size_v<std::decay_t<decltype(JsonFields<T>::fields)>>;
+
+template <typename T>
+constexpr std::array<std::string_view, field_count<T>> field_names = std::apply(
+    [](const auto&... field) { return std::array<std::string_view, field_count<T>>{field.name...}; },
+    JsonFields<T>::fields);
+
+template <typename T, typename = void>
+constexpr bool is_bound = false;
+
+template <typename T>
+constexpr bool is_bound<T, std::void_t<decltype(JsonFields<T>::fields)>> = true;
+
+template <typename T>
+constexpr bool is_optional = false;
+
+template <typename T>
+constexpr bool is_optional<std::optional<T>> = true;
+
+template <typename T>
+constexpr bool is_vector = false;
+
+template <typename T, typename Alloc>
+constexpr bool is_vector<std::vector<T, Alloc>> = true;
+
+constexpr uint64_t hash_key(std::string_view key, uint64_t seed) {
+    // FNV-1a, folded so the low bits see the whole key
+    uint64_t hash = 14695981039346656037ull ^ seed;
+    for (char c: key) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash ^ (hash >> 32);
+}
+
+// seeds tried per table size before the table is doubled
+constexpr uint64_t SEEDS_PER_SIZE = 64;
+
+// whether seed sends every name to its own slot of a table of this size
+template <typename T>
+constexpr bool is_perfect(uint64_t seed, size_t slots) {
+    const auto& names = field_names<T>;
+    for (size_t idx = 0; idx < names.size(); idx++) {
+        for (size_t other = 0; other < idx; other++) {
+            if (((hash_key(names[idx], seed) ^ hash_key(names[other], seed)) & (slots - 1)) == 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+// the smallest table size, from twice the field count up, with a perfect seed
+template <typename T>
+constexpr size_t table_slots() {
+    for (size_t slots = std::bit_ceil(std::max<size_t>(2 * field_count<T>, 4));; slots *= 2) {
+        for (uint64_t seed = 0; seed < SEEDS_PER_SIZE; seed++) {
+            if (is_perfect<T>(seed, slots)) return slots;
+        }
+    }
+}
+
+template <size_t Slots>
+struct KeyTable {
+    uint64_t seed = 0;
+    // field index + 1 per slot, 0 for a free one
+    std::array<uint16_t, Slots> fields{};
+};
+
+template <typename T>
+constexpr auto make_key_table() {
+    constexpr size_t slots = table_slots<T>();
+    KeyTable<slots> table;
+    while (!is_perfect<T>(table.seed, slots)) table.seed++;
+    for (size_t idx = 0; idx < field_count<T>; idx++)
+        table.fields[hash_key(field_names<T>[idx], table.seed) & (slots - 1)] = static_cast<uint16_t>(idx + 1);
+    return table;
+}
+
+template <typename T>
+constexpr auto key_table = make_key_table<T>();
+
+// index of the field with this key, or field_count<T>
+template <typename T>
+size_t find_field(std::string_view key) {
+    const auto& table = key_table<T>;
+    size_t entry = table.fields[hash_key(key, table.seed) & (table.fields.size() - 1)];
+    if (entry == 0 || field_names<T>[entry - 1] != key)
+        return field_count<T>;
+    return entry - 1;
+}
+
+// takes whatever value the reader is at without building anything
+struct SkipHandler {
+    void on_null() {}
+    void on_bool(bool) {}
+    void on_number(double) {}
+    void on_string(std::string_view) {}
+    void on_key(std::string_view) {}
+    void on_start_object() {}
+    void on_end_object() {}
+    void on_start_array() {}
+    void on_end_array() {}
+};
+
+template <typename Reader>
+ParseError mismatch(const Reader& reader) {
+    return reader ? ParseError::TypeMismatch : ParseError::UnexpectedEnd;
+}
+
+template <typename T, typename Number>
+bool store_number(Number number, T& result) {
+    if constexpr (std::is_floating_point_v<T>) {
+        result = static_cast<T>(number);
+        return true;
+    } else if constexpr (std::is_floating_point_v<Number>) {
+        return false;
+    } else {
+        if (!std::in_range<T>(number)) return false;
+        result = static_cast<T>(number);
+        return true;
+    }
+}
+
+template <typename Reader, typename T>
+ParseError read_bound(Reader& reader, T& result, size_t depth);
+
+template <typename Reader, typename T, size_t... Index>
+ParseError read_field(Reader& reader, T& result, size_t field, size_t depth, std::index_sequence<Index...>) {
+    // a switch over the field indices once inlined
+    ParseError error = ParseError::None;
+    ((field == Index ? (error = read_bound(reader, result.*(std::get<Index>(JsonFields<T>::fields).member), depth), true)
+                     : false) ||
+     ...);
+    return error;
+}
+
+template <typename Reader, typename T>
+ParseError read_struct(Reader& reader, T& result, size_t depth) {
+    if (reader.current() != JsonConstants::OBJECT_START)
+        return mismatch(reader);
+    reader.advance();
+    consume_whitespace(reader);
+    if (reader.current() == JsonConstants::OBJECT_END) {
+        reader.advance();
+        return ParseError::None;
+    }
+
+    // only needed until the field is found, so nested structs can reuse it; it
+    // lives as long as the thread, so it takes the heap rather than whatever
+    // the default resource is on first use
+    thread_local JsonValue::String key{std::pmr::new_delete_resource()};
+    while (true) {
+        consume_whitespace(reader);
+        if (reader.current() != JsonConstants::STRING_QUOTE)
+            return reader ? ParseError::ExpectedKey : ParseError::UnexpectedEnd;
+        key.clear();
+        ParseError error = read_string(reader, key);
+        if (error != ParseError::None) return error;
+
+        consume_whitespace(reader);
+        if (reader.current() != JsonConstants::KEY_VALUE_SEPARATOR)
+            return reader ? ParseError::ExpectedColon : ParseError::UnexpectedEnd;
+        reader.advance();
+
+        size_t field = find_field<T>(key);
+        if (field == field_count<T>) {
+            SkipHandler handler;
+            SaxParser<Reader, SkipHandler> skipper(reader, handler);
+            // the containers around the member count towards its depth
+            skipper.depth = DEFAULT_MAX_DEPTH - depth;
+            error = skipper.parse_value();
+        } else {
+            error = read_field(reader, result, field, depth, std::make_index_sequence<field_count<T>>());
+        }
+        if (error != ParseError::None) return error;
+
+        consume_whitespace(reader);
+        if (reader.current() == JsonConstants::COMMA) {
+            reader.advance();
+        } else if (reader.current() == JsonConstants::OBJECT_END) {
+            reader.advance();
+            return ParseError::None;
+        } else return reader ? ParseError::ExpectedCommaOrObjectEnd : ParseError::UnexpectedEnd;
+    }
+}
+
+template <typename Reader, typename T>
+ParseError read_vector(Reader& reader, T& result, size_t depth) {
+    if (reader.current() != JsonConstants::ARRAY_START)
+        return mismatch(reader);
+    reader.advance();
+    result.clear();
+    consume_whitespace(reader);
+    if (reader.current() == JsonConstants::ARRAY_END) {
+        reader.advance();
+        return ParseError::None;
+    }
+
+    while (true) {
+        ParseError error = read_bound(reader, result.emplace_back(), depth);
+        if (error != ParseError::None) return error;
+
+        consume_whitespace(reader);
+        if (reader.current() == JsonConstants::COMMA) {
+            reader.advance();
+        } else if (reader.current() == JsonConstants::ARRAY_END) {
+            reader.advance();
+            return ParseError::None;
+        } else return reader ? ParseError::ExpectedCommaOrArrayEnd : ParseError::UnexpectedEnd;
+    }
+}
+
+// depth counts the objects and arrays still allowed, types that contain
+// themselves through a vector nest as deep as the document does
+template <typename Reader, typename T>
+ParseError read_bound(Reader& reader, T& result, size_t depth) {
+    consume_whitespace(reader);
+    char c = reader.current();
+
+    if constexpr (std::is_same_v<T, bool>) {
+        if (c != 't' && c != 'f')
+            return mismatch(reader);
+        if (!read_literal(reader, c == 't' ? "true" : "false"))
+            return reader ? ParseError::InvalidLiteral : ParseError::UnexpectedEnd;
+        result = c == 't';
+        return ParseError::None;
+    } else if constexpr (std::is_arithmetic_v<T>) {
+        if (c != JsonConstants::MINUS && !is_digit(c))
+            return mismatch(reader);
+        NumberValue number;
+        ParseError error = read_number(reader, number);
+        if (error != ParseError::None) return error;
+        bool stored = std::visit([&](auto held) { return store_number(held, result); }, number);
+        return stored ? ParseError::None : ParseError::TypeMismatch;
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        if (c != JsonConstants::STRING_QUOTE)
+            return mismatch(reader);
+        thread_local JsonValue::String scratch{std::pmr::new_delete_resource()};
+        scratch.clear();
+        ParseError error = read_string(reader, scratch);
+        if (error != ParseError::None) return error;
+        result.assign(scratch);
+        return ParseError::None;
+    } else if constexpr (is_optional<T>) {
+        if (c == 'n') {
+            if (!read_literal(reader, "null"))
+                return reader ? ParseError::InvalidLiteral : ParseError::UnexpectedEnd;
+            result.reset();
+            return ParseError::None;
+        }
+        return read_bound(reader, result.emplace(), depth);
+    } else {
+        if (depth == 0)
+            return ParseError::TooDeep;
+        if constexpr (is_vector<T>) {
+            return read_vector(reader, result, depth - 1);
+        } else {
+            static_assert(is_bound<T>, "bound structs need a JsonFields specialization");
+            return read_struct(reader, result, depth - 1);
+        }
+    }
+}
+
+template <typename Reader, typename T>
+ParseError read_document(Reader& reader, T& result) {
+    consume_whitespace(reader);
+    if (!reader)
+        return ParseError::EmptyDocument;
+    if (reader.current() != JsonConstants::OBJECT_START && reader.current() != JsonConstants::ARRAY_START)
+        return ParseError::InvalidRoot;
+
+    ParseError error = read_bound(reader, result, DEFAULT_MAX_DEPTH);
+    if (error != ParseError::None)
+        return error;
+
+    consume_whitespace(reader);
+    if (reader)
+        return ParseError::TrailingCharacters;
+    return ParseError::None;
+}
+
+template <typename T>
+void write_bound(const T& value, std::string& out) {
+    if constexpr (std::is_same_v<T, bool>) {
+        out += value ? "true" : "false";
+    } else if constexpr (std::is_floating_point_v<T>) {
+        write_json_number(static_cast<double>(value), out);
+    } else if constexpr (std::is_signed_v<T> && std::is_integral_v<T>) {
+        write_json_number(static_cast<int64_t>(value), out);
+    } else if constexpr (std::is_integral_v<T>) {
+        write_json_number(static_cast<uint64_t>(value), out);
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        write_json_string(value, out);
+    } else if constexpr (is_optional<T>) {
+        if (value.has_value()) write_bound(*value, out);
+        else out += "null";
+    } else if constexpr (is_vector<T>) {
+        out += JsonConstants::ARRAY_START;
+        for (size_t idx = 0; idx < value.size(); idx++) {
+            if (idx) out += JsonConstants::ITEM_SEPARATOR;
+            write_bound(static_cast<const typename T::value_type&>(value[idx]), out);
+        }
+        out += JsonConstants::ARRAY_END;
+    } else {
+        static_assert(is_bound<T>, "bound structs need a JsonFields specialization");
+        out += JsonConstants::OBJECT_START;
+        std::apply(
+            [&](const auto&... field) {
+                bool start = true;
+                ((out += start ? "" : ",", start = false, write_json_string(field.name, out),
+                  out += JsonConstants::KEY_VALUE_SEPARATOR, write_bound(value.*(field.member), out)),
+                 ...);
+            },
+            JsonFields<T>::fields);
+        out += JsonConstants::OBJECT_END;
+    }
+}
+
+} // namespace JsonBinding
+
+// Fills result from input, see JsonFields. Accepts the same documents as
+// parse(), whose root has to be a bound struct or a vector. On failure result
+// holds whatever was read before the error.
+template <typename T>
+ParseStatus parse_into(std::string_view input, T& result) {
+    SpanReader reader(input);
+    ParseError error = JsonBinding::read_document(reader, result);
+    if (error == ParseError::None)
+        return ParseStatus();
+    return ParseStatus{error, reader.location()};
+}
+
+template <typename T>
+ParseStatus parse_into(std::istream& input, T& result) {
+    BufferReader reader(input);
+    ParseError error = JsonBinding::read_document(reader, result);
+    if (error == ParseError::None)
+        return ParseStatus();
+    if (reader.status() == BufferReader::Status::FAIL)
+        error = ParseError::IoError;
+    return ParseStatus{error, reader.location()};
+}
+
+// a value-initialized T filled from input, nothing if that failed
+template <typename T>
+std::optional<T> parse_into(std::string_view input) {
+    std::optional<T> result(std::in_place);
+    if (!parse_into(input, *result))
+        return std::nullopt;
+    return result;
+}
+
+// compact JSON with the members in declaration order, appended to out
+template <typename T>
+void serialize(const T& value, std::string& out) {
+    JsonBinding::write_bound(value, out);
+}
+
+template <typename T>
+std::string serialize(const T& value) {
+    std::string out;
+    serialize(value, out);
+    return out;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "key_pool.h"
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct JsonValue;
+
+// The members of a JSON object, stored contiguously in insertion order, which
+// for a parsed object is document order. Setting a key again keeps its place.
+// Lookups compare the low 32 bits of the key hashes, packed in their own array:
+// up to LINEAR_LIMIT members by a linear scan, SIMD where available, beyond
+// that through an open addressing index over the same hashes.
+//
+// Allocator-aware like the std::pmr containers; JsonValue is incomplete here,
+// so everything that touches the members is defined in json_object.cpp.
+struct JsonObject {
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+    using value_type = std::pair<JsonKey, JsonValue>;
+    using iterator = value_type*;
+    using const_iterator = const value_type*;
+
+    static constexpr size_t LINEAR_LIMIT = 16;
+
+    JsonObject();
+    explicit JsonObject(const allocator_type& alloc);
+    JsonObject(const JsonObject& other);
+    JsonObject(const JsonObject& other, const allocator_type& alloc);
+    JsonObject(JsonObject&& other) noexcept;
+    JsonObject(JsonObject&& other, const allocator_type& alloc);
+    ~JsonObject();
+
+    JsonObject& operator=(const JsonObject& other);
+    JsonObject& operator=(JsonObject&& other);
+
+    allocator_type get_allocator() const;
+
+    size_t size() const;
+    bool empty() const;
+
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    // end() if there is no such member
+    iterator find(std::string_view key);
+    const_iterator find(std::string_view key) const;
+    iterator find(const JsonKey& key);
+    const_iterator find(const JsonKey& key) const;
+
+    bool contains(std::string_view key) const;
+
+    // the member for key, appended as null if there is none; the flag tells
+    // whether it was appended
+    std::pair<iterator, bool> try_emplace(const JsonKey& key);
+
+    // appends a member without checking for an existing one with the same key
+    iterator append(const JsonKey& key, JsonValue&& value);
+
+    void reserve(size_t capacity);
+
+private:
+    // position of the member with this key, or size(); handle may be null
+    size_t locate(std::string_view key, uint32_t hash, const JsonKey* handle) const;
+    // makes the index cover the member just appended
+    void index_last();
+    void rebuild_index(size_t slots);
+
+    std::pmr::vector<value_type> members;
+    // low 32 bits of each member's key hash
+    std::pmr::vector<uint32_t> hashes;
+    // member position + 1 per slot, 0 for a free one; empty while there are at
+    // most LINEAR_LIMIT members, after that never more than half full
+    std::pmr::vector<uint32_t> index;
+};
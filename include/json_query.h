@@ -0,0 +1,70 @@
+#pragma once
+
+#include "json.h"
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One step of a compiled query.
+struct QueryStep {
+    enum class Kind {
+        // a single member and/or element
+        Child,
+        // every member value or element
+        Wildcard,
+        // every member value or element for which the filter holds
+        Filter
+    };
+
+    Kind kind = Kind::Child;
+
+    // Child: the member key when objects can match, the element index when
+    // arrays can; a JSON Pointer token that reads as an index sets both
+    std::optional<std::string> key;
+    std::optional<size_t> index;
+
+    // Filter: operand is a path of Child steps relative to the candidate, whose
+    // value is compared with literal
+    std::vector<QueryStep> operand;
+    JsonValue literal;
+    bool negate = false;
+};
+
+// A query compiled once into a list of steps and evaluated any number of times.
+// Matches come back in document order.
+struct JsonQuery {
+    explicit JsonQuery(std::vector<QueryStep> _steps);
+
+    std::vector<const JsonValue*> evaluate(const JsonValue& root) const;
+
+    // the first match, or nullptr
+    const JsonValue* first(const JsonValue& root) const;
+
+    // Runs over raw JSON text through the on-demand cursor, so only the matches
+    // are ever built; everything else is stepped over unparsed. Throws
+    // std::runtime_error if the part of the input it reads is malformed.
+    // Repeated keys follow LazyValue: a key step takes the first member with
+    // the key and a wildcard every member, where a parsed JsonValue only has
+    // the last.
+    std::vector<JsonValue> evaluate(std::string_view input, const JsonValue::allocator_type& alloc = {}) const;
+
+    const std::vector<QueryStep>& steps() const;
+
+private:
+    std::vector<QueryStep> query_steps;
+};
+
+// RFC 6901, e.g. "/store/book/0/title" or "" for the whole document. Throws
+// std::invalid_argument if pointer is malformed.
+JsonQuery compile_json_pointer(std::string_view pointer);
+
+// The JSONPath subset
+//   $                     the root, every path starts with it
+//   .name  ['name']       member
+//   [n]                   element
+//   .*  [*]               every member value or element
+//   [?(@.a.b == literal)] every member value or element whose a.b equals a
+//                         string, number, true, false or null; != negates
+// Throws std::invalid_argument if path is malformed or outside the subset.
+JsonQuery compile_json_path(std::string_view path);
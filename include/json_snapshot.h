@@ -0,0 +1,163 @@
+#pragma once
+
+#include "json.h"
+#include "mapped_file.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// A parsed document saved in a form that is used straight out of a memory
+// mapping: opening one costs a header check no matter how large the document,
+// and the pages are read in as lookups touch them and shared by every process
+// that maps the same file. Everything is addressed by byte offsets from the
+// start of the file, never by pointers, in the byte order of the machine that
+// wrote it. After the header come the tables, then the string bytes:
+//
+//   node       16 bytes: tag, count, payload
+//              null, false, true    no payload
+//              double, int64,       payload holds the bits of the number
+//              uint64
+//              string               count is the length, payload the offset
+//                                   of the bytes within the string area
+//              array                count elements, payload the offset of
+//                                   their nodes, which follow one another
+//              object               count members, payload the offset of
+//                                   them, sorted by key
+//   member     32 bytes: key length, key offset within the string area, node
+//
+// Keys are stored once per snapshot however often they occur. Strings and
+// containers are limited to 2^32 - 1 bytes or elements, and nesting to the
+// DEFAULT_MAX_DEPTH containers parse() allows.
+constexpr std::string_view SNAPSHOT_MAGIC = "JSNAPSHT";
+// bumped whenever the layout changes, older snapshots are then rebuilt
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotNode {
+    enum class Tag : uint32_t {
+        Null,
+        False,
+        True,
+        Double,
+        Int64,
+        UInt64,
+        String,
+        Array,
+        Object
+    };
+
+    Tag tag;
+    uint32_t count;
+    uint64_t payload;
+};
+
+struct SnapshotMember {
+    uint32_t key_length;
+    uint32_t reserved;
+    uint64_t key_offset;
+    SnapshotNode value;
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    // 0x01020304 as written, so snapshots from a machine of the other byte
+    // order are rejected
+    uint32_t byte_order;
+    // of the whole snapshot, a truncated file is rejected
+    uint64_t file_size;
+    uint64_t strings_offset;
+    // size and modification time of the JSON file the snapshot was built
+    // from, zero if it was built from a value
+    uint64_t source_size;
+    int64_t source_mtime;
+    SnapshotNode root;
+};
+
+// Read-only cursor into a Snapshot, with the same accessors as JsonValue. It
+// does not own anything, the snapshot has to outlive every view into it.
+// Members are looked up by binary search. Offsets are checked against the
+// mapping before they are followed, and views are only handed out down to the
+// nesting limit, so a damaged snapshot, even one whose containers point back
+// at themselves, throws std::runtime_error instead of reading outside it or
+// recursing without end.
+struct SnapshotView {
+    // tables runs from the start of the snapshot up to the string area
+    SnapshotView(std::string_view _tables, std::string_view _strings, const SnapshotNode& _node);
+
+    JsonValue::Type type() const;
+    JsonValue::NumberType number_type() const;
+
+    bool as_boolean() const;
+    double as_double() const;
+    int64_t as_int64() const;
+    uint64_t as_uint64() const;
+    std::string_view as_string() const;
+
+    SnapshotView at(std::string_view index) const;
+    SnapshotView at(int index) const;
+
+    bool exists(std::string_view index) const;
+    bool exists(const int index) const;
+
+    // number of members or elements, only valid for objects and arrays
+    size_t size() const;
+
+    // the key of the member at position index of an object, in sorted order
+    std::string_view key_at(size_t index) const;
+    // the member at position index of an object, in sorted order
+    SnapshotView value_at(size_t index) const;
+
+    // converts the subtree under this view into a JsonValue, with its members
+    // in sorted order
+    JsonValue materialize(const JsonValue::allocator_type& alloc = {}) const;
+
+private:
+    std::optional<SnapshotView> find(std::string_view index) const;
+    SnapshotView at_node(const SnapshotNode& other) const;
+    SnapshotMember member(size_t index) const;
+    // the count entries of size bytes at payload, checked against the tables
+    const char* entries(size_t size) const;
+    std::string_view string(uint64_t offset, uint32_t length) const;
+
+    void verify_type(JsonValue::Type expected) const;
+
+    std::string_view tables;
+    std::string_view strings;
+    SnapshotNode node;
+    // containers above node
+    size_t depth = 0;
+};
+
+// An open snapshot file, see open_snapshot(). Views into it stay valid when
+// it is moved.
+struct Snapshot {
+    // file has to hold a snapshot with a valid header
+    explicit Snapshot(MappedFile&& _file);
+
+    SnapshotView root() const;
+    const SnapshotHeader& header() const;
+
+private:
+    MappedFile file;
+    SnapshotHeader head;
+};
+
+// Writes a snapshot of value to path. It is written next to path and renamed
+// over it, so processes that open path concurrently see the old snapshot or
+// the new one and never a partial file. If source_path is given, its size and
+// modification time go into the header for open_snapshot() to compare against.
+// Returns false if the file could not be written, throws std::length_error if
+// value exceeds the limits above.
+bool write_snapshot(const JsonValue& value, const std::string& path, const std::string& source_path = {});
+
+// Maps the snapshot at path. Nothing if it is missing, not a snapshot, of
+// another version or byte order, truncated, or, when source_path is given,
+// built from a different version of that file.
+std::optional<Snapshot> open_snapshot(const std::string& path, const std::string& source_path = {});
+
+// Opens the snapshot of source_path at snapshot_path, first rebuilding it with
+// parse_file() if it is missing or stale. Nothing if the source does not parse
+// or the snapshot cannot be written.
+std::optional<Snapshot> load_snapshot(const std::string& source_path, const std::string& snapshot_path);
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "json.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct JsonView;
+
+// Compact, read-only document. Every value is one or two tagged 64 bit words on
+// a single contiguous tape, string bytes live in a separate buffer:
+//
+//   null, true, false   one word, no payload
+//   number              tag word followed by the raw bits of the double, or of
+//                       the int64 / uint64 for integers kept exact
+//   string              payload is the offset of a 32 bit length + bytes in strings
+//   object / array      start word payload is the tape index just past the
+//                       matching end word (low 32 bits) and the element count
+//                       (high 24 bits, saturating); the end word's payload is
+//                       the index of the start word
+//
+// An object's members are stored as key string word, then value. Any subtree
+// can be skipped in O(1) by jumping to the index stored in its start word.
+struct JsonTape {
+    enum class Tag : uint8_t {
+        Null = 'n',
+        True = 't',
+        False = 'f',
+        Number = 'd',
+        Int64 = 'i',
+        UInt64 = 'u',
+        String = '"',
+        ObjectStart = '{',
+        ObjectEnd = '}',
+        ArrayStart = '[',
+        ArrayEnd = ']'
+    };
+
+    static constexpr int TAG_SHIFT = 56;
+    static constexpr uint64_t PAYLOAD_MASK = (uint64_t(1) << TAG_SHIFT) - 1;
+    static constexpr uint64_t SKIP_MASK = 0xFFFFFFFF;
+    static constexpr uint64_t MAX_COUNT = 0xFFFFFF;
+
+    static Tag tag_of(uint64_t word) {
+        return static_cast<Tag>(word >> TAG_SHIFT);
+    }
+
+    static uint64_t payload_of(uint64_t word) {
+        return word & PAYLOAD_MASK;
+    }
+
+    JsonView root() const;
+
+    // builder interface, used by the parser
+    void append_literal(Tag tag);
+    void append_number(double number);
+    void append_number(int64_t number);
+    void append_number(uint64_t number);
+    void append_string(std::string_view str);
+    // returns the index of the start word, to be handed to end_container
+    size_t start_container(Tag tag);
+    void end_container(size_t start, uint64_t count);
+
+    std::vector<uint64_t> words;
+    std::string strings;
+
+private:
+    void append_word(Tag tag, uint64_t payload);
+};
+
+// Lightweight cursor into a JsonTape, with the same accessors as JsonValue.
+// It does not own anything, the tape has to outlive every view into it. Lookups
+// are linear scans that skip over subtrees; with duplicate keys the first one
+// wins, whereas materialize() keeps the last one like parse() does.
+struct JsonView {
+    JsonView(const JsonTape* _tape, size_t _index);
+
+    JsonValue::Type type() const;
+    JsonValue::NumberType number_type() const;
+
+    bool as_boolean() const;
+    double as_double() const;
+    int64_t as_int64() const;
+    uint64_t as_uint64() const;
+    std::string_view as_string() const;
+
+    JsonView at(std::string_view index) const;
+    JsonView at(int index) const;
+
+    bool exists(std::string_view index) const;
+    bool exists(const int index) const;
+
+    // number of members or elements, only valid for objects and arrays
+    size_t size() const;
+
+    // converts the subtree under this view into a JsonValue
+    JsonValue materialize(const JsonValue::allocator_type& alloc = {}) const;
+
+private:
+    JsonTape::Tag tag() const;
+    uint64_t word() const;
+    // tape index of whatever follows this value
+    size_t next() const;
+    std::optional<JsonView> find(std::string_view index) const;
+    std::optional<JsonView> find(int index) const;
+
+    void verify_type(JsonValue::Type expected) const;
+
+    const JsonTape* tape;
+    size_t index;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "json.h"
+#include <ostream>
+#include <string>
+
+struct WriteOptions {
+    // one member or element per line, indented by indent spaces per level
+    bool pretty = false;
+    int indent = 4;
+};
+
+// Serializes value as JSON. Doubles are written in the shortest form that reads
+// back to the same value, NaN and infinities (which JSON cannot express) as
+// null. Strings are escaped, their bytes are otherwise passed through as is.
+
+// appends to out, which can be reused across calls to avoid reallocating
+void write_json(const JsonValue& value, std::string& out, const WriteOptions& options = {});
+
+// streams the output in chunks, the document is never held in memory as a whole
+void write_json(const JsonValue& value, std::ostream& out, const WriteOptions& options = {});
+
+// writes to a file descriptor in chunks, returns false if a write failed
+bool write_json(const JsonValue& value, int fd, const WriteOptions& options = {});
+
+// The pieces the above are made of, for serializing other representations the
+// same way. Both append to out.
+void write_json_string(std::string_view str, std::string& out);
+void write_json_number(int64_t number, std::string& out);
+void write_json_number(uint64_t number, std::string& out);
+void write_json_number(double number, std::string& out);
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+
+// Handle to an object key interned in a KeyPool: a single pointer, while the
+// characters and their hash are stored once per distinct key in the pool. Keys
+// from the same pool are equal exactly when their handles are; comparing with
+// anything else falls back to comparing the characters.
+//
+// A key the pool had no room for is owned instead: it is allocated on its own,
+// shared by the copies of its handle and freed with the last of them.
+struct JsonKey {
+    JsonKey(const JsonKey& other): bits{other.bits} {
+        if (bits & OWNED) owned()->references.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    JsonKey(JsonKey&& other) noexcept: bits{other.bits} {
+        other.bits = 0;
+    }
+
+    JsonKey& operator=(const JsonKey& other) {
+        JsonKey copy(other);
+        std::swap(bits, copy.bits);
+        return *this;
+    }
+
+    JsonKey& operator=(JsonKey&& other) noexcept {
+        std::swap(bits, other.bits);
+        return *this;
+    }
+
+    ~JsonKey() {
+        if (bits & OWNED) release();
+    }
+
+    std::string_view view() const {
+        return entry()->first;
+    }
+
+    operator std::string_view() const {
+        return entry()->first;
+    }
+
+    // std::hash<std::string_view> of the key, computed once when it was interned
+    size_t hash() const {
+        return entry()->second;
+    }
+
+    bool same_handle(const JsonKey& other) const {
+        return bits == other.bits;
+    }
+
+    // whether the key is owned rather than interned
+    bool owned_key() const {
+        return bits & OWNED;
+    }
+
+private:
+    friend struct KeyPool;
+    using Entry = std::pair<const std::string_view, size_t>;
+    // an owned key, its characters follow it
+    struct Owned {
+        Entry entry;
+        std::atomic<size_t> references;
+    };
+
+    static constexpr uintptr_t OWNED = 1;
+
+    explicit JsonKey(const Entry* _entry): bits{reinterpret_cast<uintptr_t>(_entry)} {};
+    explicit JsonKey(Owned* _owned): bits{reinterpret_cast<uintptr_t>(_owned) | OWNED} {};
+
+    const Entry* entry() const {
+        return reinterpret_cast<const Entry*>(bits & ~OWNED);
+    }
+
+    Owned* owned() const {
+        return reinterpret_cast<Owned*>(bits & ~OWNED);
+    }
+
+    void release();
+
+    // points at the pool's entry, which never moves, or at an owned key with
+    // the low bit set; zero once moved from
+    uintptr_t bits;
+};
+
+// Interning table for object keys. Documents hold handles into the pool, so it
+// has to outlive every value whose keys it interned. Safe to share between
+// threads.
+//
+// Nothing is removed from a pool before it is destroyed, so a pool can be
+// given a budget: once the characters of its keys, plus KEY_OVERHEAD bytes of
+// bookkeeping each, would exceed it, new keys are handed out owned instead of
+// interned. They work the same, only without the shared copy.
+struct KeyPool {
+    // what an interned key costs beyond its characters, roughly
+    static constexpr size_t KEY_OVERHEAD = 64;
+    // the budget of global()
+    static constexpr size_t GLOBAL_BUDGET = size_t(16) << 20;
+
+    KeyPool() = default;
+    explicit KeyPool(size_t _budget): budget{_budget} {};
+    KeyPool(const KeyPool&) = delete;
+    KeyPool& operator=(const KeyPool&) = delete;
+
+    // the handle for key, adding it on first use
+    JsonKey intern(std::string_view key);
+
+    // number of distinct keys
+    size_t size() const;
+
+    // what the interned keys count against the budget
+    size_t bytes() const;
+
+    // Used wherever no other pool is in scope. It lives for the whole process,
+    // and is therefore bounded by GLOBAL_BUDGET: a stream of documents whose
+    // keys never repeat (ids used as keys, say) fills it once and then gets
+    // owned keys, which go with the documents. Such documents are still better
+    // parsed with a scoped pool.
+    static KeyPool& global();
+
+    // the pool installed on this thread by a KeyPoolScope, or global()
+    static KeyPool& current();
+
+private:
+    mutable std::shared_mutex mutex;
+    size_t budget = SIZE_MAX;
+    size_t used = 0;
+    // the characters of every key, appended and released only with the pool;
+    // taken from the heap rather than the default resource, which may be a
+    // caller's arena that dies long before the pool
+    std::pmr::monotonic_buffer_resource storage{std::pmr::new_delete_resource()};
+    // views into storage and their hashes, node based so the handles stay
+    // valid on rehash
+    std::unordered_map<std::string_view, size_t> keys;
+};
+
+// Makes pool the current one for this thread until the scope ends, so that
+// everything parsed or built meanwhile interns its keys there:
+//
+//     KeyPool pool;
+//     KeyPoolScope scope(pool);
+//     auto document = parse(input);
+struct KeyPoolScope {
+    explicit KeyPoolScope(KeyPool& pool);
+    ~KeyPoolScope();
+    KeyPoolScope(const KeyPoolScope&) = delete;
+    KeyPoolScope& operator=(const KeyPoolScope&) = delete;
+
+private:
+    KeyPool* previous;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "json.h"
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// On-demand cursor over raw JSON text. Nothing is parsed up front: each
+// accessor decodes just the value it is asked for, and lookups step over the
+// members and elements before the one they want with a bracket matching scan
+// that never builds them. The input has to outlive every cursor into it.
+//
+// Only what is actually read is checked, so malformed JSON inside a subtree
+// that is stepped over goes unnoticed. Anything malformed that is read throws
+// std::runtime_error with the error and its location.
+//
+// Repeated keys are taken as written, the same as JsonView does: a lookup
+// stops at the first member with the key, and size() and for_each() count and
+// visit every member. parse() and materialize() keep only the last one, so on
+// such documents the two can differ.
+struct LazyValue {
+    LazyValue(std::string_view _input, size_t _position);
+
+    JsonValue::Type type() const;
+    JsonValue::NumberType number_type() const;
+
+    bool as_boolean() const;
+    double as_double() const;
+    int64_t as_int64() const;
+    uint64_t as_uint64() const;
+    std::string as_string() const;
+
+    // the first member with this key, throws std::out_of_range if there is none
+    LazyValue at(std::string_view index) const;
+    LazyValue at(int index) const;
+
+    bool exists(std::string_view index) const;
+    bool exists(const int index) const;
+
+    // number of members or elements, only valid for objects and arrays
+    size_t size() const;
+
+    // like at(), but nothing if this is not an object or array or there is no
+    // such member or element
+    std::optional<LazyValue> find(std::string_view index) const;
+    std::optional<LazyValue> find(int index) const;
+
+    // calls visit on every member value or element in document order, does
+    // nothing for other types
+    void for_each(const std::function<void(const LazyValue&)>& visit) const;
+
+    // fully parses and checks the value under this cursor
+    JsonValue materialize(const JsonValue::allocator_type& alloc = {}) const;
+
+private:
+    void verify_type(JsonValue::Type expected) const;
+
+    std::string_view input;
+    // first byte of the value
+    size_t position;
+};
+
+// Returns a cursor on the top level value right away, without reading any
+// further than its first byte.
+LazyValue parse_lazy(std::string_view input);
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a whole file. The mapping lives as long as the
+// MappedFile, so views handed out by view() must not outlive it.
+struct MappedFile {
+    // what the kernel is told to expect, which decides how far it reads ahead
+    enum class Access {
+        // front to back, as parsing does
+        Sequential,
+        // lookups that jump around the file
+        Random
+    };
+
+    MappedFile(const std::string& path, Access access = Access::Sequential);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    ~MappedFile();
+
+    // false if the file could not be opened or mapped
+    operator bool() const;
+
+    std::string_view view() const;
+
+    size_t size() const;
+
+private:
+    void unmap();
+
+    const char* data = nullptr;
+    size_t length = 0;
+    bool valid = false;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "parse_result.h"
+#include <functional>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct NdjsonOptions {
+    // worker threads, 0 picks one per hardware thread
+    size_t threads = 0;
+    // the input is handed to the workers in pieces of about this many bytes,
+    // always cut at a line end
+    size_t chunk_size = 1 << 20;
+};
+
+// Called once per record in input order, with the record's 1-based line number.
+// Calls come from the thread that called parse_ndjson.
+using NdjsonCallback = std::function<void(size_t line, ParseResult&& record)>;
+
+// Newline delimited JSON (JSON Lines): one document per line, each accepted
+// under the same rules as parse(). Blank lines are skipped. Lines are parsed
+// in parallel on a pool of workers; a bad line is reported as a failed
+// ParseResult, located within the whole input, and does not stop the others.
+// Every record interns its keys in the caller's KeyPool::current().
+void parse_ndjson(std::string_view input, const NdjsonCallback& callback, const NdjsonOptions& options = {});
+
+// returns false if reading the stream failed, records before that are delivered
+bool parse_ndjson(std::istream& input, const NdjsonCallback& callback, const NdjsonOptions& options = {});
+
+// returns false if the file could not be mapped
+bool parse_ndjson_file(const std::string& path, const NdjsonCallback& callback, const NdjsonOptions& options = {});
+
+// every record of input, in order
+std::vector<ParseResult> parse_ndjson(std::string_view input, const NdjsonOptions& options = {});
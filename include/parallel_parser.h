@@ -0,0 +1,28 @@
+#pragma once
+
+#include "parse_result.h"
+#include <memory_resource>
+#include <string_view>
+
+struct ParallelParseOptions {
+    // worker threads, 0 picks one per hardware thread
+    size_t threads = 0;
+    // the input is indexed, and elements are handed to the workers, in spans
+    // and groups of about this many bytes
+    size_t chunk_size = 1 << 20;
+};
+
+// Parses a document whose top level value is an array by splitting it into its
+// elements and parsing groups of elements on a pool of workers, each straight
+// into its slot of the result. The split runs on the same workers: the input
+// is cut into chunk_size spans, each indexed with the SIMD structural index of
+// parse_simd(), so no pass over every byte is left to a single thread. The result and
+// any error are identical to parse(input, resource); anything that is not a
+// top level array, or fails to parse, is handed to parse() as is. An exception
+// thrown on a worker, such as std::bad_alloc, is rethrown to the caller.
+//
+// The workers allocate from resource concurrently, so it has to be thread-safe
+// like the default resource or a std::pmr::synchronized_pool_resource. Keys go
+// to the caller's KeyPool::current().
+ParseResult parse_parallel(std::string_view input, const ParallelParseOptions& options = {},
+                           std::pmr::memory_resource* resource = std::pmr::get_default_resource());
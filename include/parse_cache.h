@@ -0,0 +1,64 @@
+#pragma once
+
+#include "parse_result.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Remembers the outcome of parsing recent inputs, so that a byte-identical
+// repeat, such as a polling client or a retry, is answered without parsing.
+// Inputs are looked up by a 64 bit XXH64 hash and then compared in full, so a
+// collision costs a parse and never hands out the wrong document.
+//
+// Documents are shared and immutable: every caller of the same input gets the
+// same ParseResult, which stays valid for as long as a caller holds it, even
+// after the cache has dropped it. Failed parses are kept too. Each document
+// interns its keys in a pool of its own, not in the caller's KeyPool::current(),
+// and is allocated from the heap, not the default resource, so it does not
+// depend on any pool or arena the caller has in scope.
+//
+// The cache is split into shards by hash, each a least recently used list
+// behind its own mutex, so threads looking up different inputs seldom wait on
+// each other. A miss parses outside the lock; two threads missing on the same
+// input both parse it and the second result is the one kept.
+struct ParseCache {
+    struct Counters {
+        size_t hits = 0;
+        size_t misses = 0;
+        // documents dropped to stay within the budget
+        size_t evictions = 0;
+        // held right now
+        size_t entries = 0;
+        size_t bytes = 0;
+    };
+
+    // budget bounds the memory held for documents, including a copy of each
+    // input, split evenly between the shards; a document larger than its
+    // shard's share is parsed but not kept
+    explicit ParseCache(size_t budget, size_t shards = 16);
+    ~ParseCache();
+
+    ParseCache(const ParseCache&) = delete;
+    ParseCache& operator=(const ParseCache&) = delete;
+
+    std::shared_ptr<const ParseResult> parse(std::string_view input);
+
+    Counters counters() const;
+
+    // drops every document, the counters of hits, misses and evictions stay
+    void clear();
+
+private:
+    struct Entry;
+    struct Shard;
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t shard_budget;
+
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+    std::atomic<size_t> evictions{0};
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "json.h"
+#include "json_tape.h"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+enum class ParseError {
+    None,
+    // nothing but whitespace
+    EmptyDocument,
+    // the top level value is not an object or array
+    InvalidRoot,
+    // the input ended in the middle of a value
+    UnexpectedEnd,
+    // no value can start with this character
+    UnexpectedCharacter,
+    // misspelled true, false or null
+    InvalidLiteral,
+    InvalidNumber,
+    // an unknown escape, or \u escapes that leave a surrogate unpaired
+    InvalidEscape,
+    ExpectedKey,
+    ExpectedColon,
+    ExpectedCommaOrObjectEnd,
+    ExpectedCommaOrArrayEnd,
+    // anything but whitespace after the top level value
+    TrailingCharacters,
+    // the stream failed or the file could not be mapped
+    IoError,
+    // objects and arrays nested deeper than the parse allows
+    TooDeep,
+    // a value that does not fit the C++ type it is bound to, see json_bind.h
+    TypeMismatch,
+    // a byte that cannot start a value or key of the binary form, see json_binary.h
+    InvalidEncoding,
+    // larger than the 4 GiB the structural index can address
+    InputTooLarge,
+    // string contents that are not well-formed UTF-8
+    InvalidUtf8
+};
+
+const char* parse_error_message(ParseError error);
+
+// 1-based line and column of a byte offset, counting bytes not characters
+struct SourceLocation {
+    size_t offset = 0;
+    size_t line = 1;
+    size_t column = 1;
+};
+
+// line and column of offset within input, only meant for the error path
+SourceLocation locate(std::string_view input, size_t offset);
+
+// Outcome of a parse. Behaves like std::optional<JsonValue>, and on failure also
+// says why and where parsing stopped. Errors travel through the parser as plain
+// return codes, nothing is thrown on malformed or truncated input.
+struct ParseResult {
+    ParseResult(JsonValue&& _value);
+    ParseResult(ParseError _error, SourceLocation _location);
+
+    bool has_value() const;
+    explicit operator bool() const;
+
+    JsonValue& operator*();
+    const JsonValue& operator*() const;
+    JsonValue* operator->();
+    const JsonValue* operator->() const;
+
+    // throws std::runtime_error with error_message() if parsing failed
+    JsonValue& value();
+    const JsonValue& value() const;
+
+    // for callers that only care whether parsing worked
+    operator std::optional<JsonValue>() const &;
+    operator std::optional<JsonValue>() &&;
+
+    ParseError error() const;
+    const SourceLocation& location() const;
+    // e.g. "expected ':' after object key at line 3, column 7 (offset 42)"
+    std::string error_message() const;
+
+private:
+    std::optional<JsonValue> result;
+    ParseError error_code = ParseError::None;
+    SourceLocation error_location;
+};
+
+// The same for parse_tape(), whose document is a JsonTape rather than a tree.
+struct TapeParseResult {
+    TapeParseResult(JsonTape&& _tape);
+    TapeParseResult(ParseError _error, SourceLocation _location);
+
+    bool has_value() const;
+    explicit operator bool() const;
+
+    JsonTape& operator*();
+    const JsonTape& operator*() const;
+    JsonTape* operator->();
+    const JsonTape* operator->() const;
+
+    // throws std::runtime_error with error_message() if parsing failed
+    JsonTape& value();
+    const JsonTape& value() const;
+
+    operator std::optional<JsonTape>() const &;
+    operator std::optional<JsonTape>() &&;
+
+    ParseError error() const;
+    const SourceLocation& location() const;
+    std::string error_message() const;
+
+private:
+    std::optional<JsonTape> result;
+    ParseError error_code = ParseError::None;
+    SourceLocation error_location;
+};
+
+// Outcome of a parse that builds no value, such as an event driven one.
+struct ParseStatus {
+    ParseError error = ParseError::None;
+    SourceLocation location;
+
+    explicit operator bool() const {
+        return error == ParseError::None;
+    }
+};
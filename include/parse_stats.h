@@ -0,0 +1,98 @@
+#pragma once
+
+#include "buffer_reader.h"
+#include "json.h"
+#include "span_reader.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <forward_list>
+#include <iosfwd>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+
+// What a parse did, for telling apart feeds that are slow for different reasons
+// (huge strings, deep nesting, lots of numbers) without a profiler. Filled in
+// by the parse() overloads that take one; the counters add up over every parse
+// it is handed.
+struct ParseStats {
+    ParseStats() = default;
+    // copies the counters, the copy counts allocations on its own
+    ParseStats(const ParseStats& other);
+    ParseStats& operator=(const ParseStats& other);
+
+    size_t bytes_consumed = 0;
+
+    // stream parses only, including the first fill
+    size_t buffer_refills = 0;
+    std::chrono::nanoseconds refill_time{0};
+
+    // indexed by JsonValue::Type
+    std::array<size_t, 6> values{};
+    size_t max_depth = 0;
+
+    // string and key contents taken over as they are, and the bytes of the
+    // escape sequences among them
+    size_t string_bytes_copied = 0;
+    size_t string_bytes_escaped = 0;
+
+    // made from the memory resource by the document while parsing
+    size_t allocations = 0;
+    size_t allocated_bytes = 0;
+
+    // turning the text of numbers into values
+    std::chrono::nanoseconds number_time{0};
+
+    size_t value_count(JsonValue::Type type) const {
+        return values[static_cast<size_t>(type)];
+    }
+
+    // Stands between a document and upstream to count its allocations, one per
+    // upstream. The document keeps allocating and freeing through it, so a
+    // ParseStats has to outlive the documents parsed with it.
+    std::pmr::memory_resource* counting_resource(std::pmr::memory_resource* upstream);
+
+private:
+    struct Counter: std::pmr::memory_resource {
+        ParseStats* stats = nullptr;
+        std::pmr::memory_resource* upstream = nullptr;
+
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* block, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+    };
+
+    // node based, the documents hold on to their counter's address
+    std::forward_list<Counter> counters;
+};
+
+// one "name: value" line per counter
+std::ostream& operator<<(std::ostream& out, const ParseStats& stats);
+
+// The reader the parser runs on while collecting statistics. The grammar checks
+// for it at compile time, so parsing with a plain reader has no instrumentation
+// in it at all.
+template <typename Base>
+struct StatsReader: Base {
+    template <typename... Args>
+    explicit StatsReader(ParseStats& _stats, Args&&... args): Base(std::forward<Args>(args)...), stats{_stats} {};
+
+    using Base::advance;
+
+    void advance() {
+        if constexpr (std::is_same_v<Base, BufferReader>) {
+            if (Base::refill_pending()) [[unlikely]] {
+                auto start = std::chrono::steady_clock::now();
+                Base::advance();
+                stats.buffer_refills++;
+                stats.refill_time += std::chrono::steady_clock::now() - start;
+                return;
+            }
+        }
+        Base::advance();
+    }
+
+    ParseStats& stats;
+};
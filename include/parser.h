@@ -1,37 +1,144 @@
+#pragma once
+
 #include "json.h"
+#include "json_tape.h"
+#include "parse_result.h"
+#include "parse_stats.h"
 #include "buffer_reader.h"
+#include "span_reader.h"
+#include "structural_index.h"
 
 #include <iostream>
 #include <optional>
+#include <string_view>
+#include <variant>
+
+// Objects and arrays nested deeper than this fail with ParseError::TooDeep,
+// unless a parse is given another limit. Parsing itself does not recurse, but
+// destroying, copying and writing a JsonValue do, so a limit far beyond the
+// default moves the risk of running out of stack to those.
+constexpr size_t DEFAULT_MAX_DEPTH = 1024;
+
+struct ParseOptions {
+    size_t max_depth = DEFAULT_MAX_DEPTH;
+};
+
+// Every string and container of the result is allocated from resource. Pass a
+// std::pmr::monotonic_buffer_resource to build the document in an arena; it
+// then has to outlive the result.
+ParseResult parse(std::istream& input, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+// parses straight out of a contiguous buffer, no copy is made of the input
+ParseResult parse(std::string_view input, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+ParseResult parse(std::istream& input, const ParseOptions& options, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+ParseResult parse(std::string_view input, const ParseOptions& options, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+// Like the two above, and also adds what the parse did to stats. Allocations go
+// through stats on their way to resource, so stats has to outlive the result.
+ParseResult parse(std::istream& input, ParseStats& stats, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+ParseResult parse(std::string_view input, ParseStats& stats, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+// Like parse(std::string_view), but string values without escape sequences are
+// not copied: they point into input, which then has to outlive the result and
+// every copy made of it. Strings with escapes are decoded into resource as
+// usual, and keys are interned either way.
+ParseResult parse_borrowed(std::string_view input, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+// memory maps the file at path and parses it in place
+ParseResult parse_file(const std::string& path, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+ParseResult parse_file(const std::string& path, const ParseOptions& options, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+// Checks that input is a document parse() accepts, under the default depth
+// limit, and on failure reports the same error at the same place. Nothing is
+// kept and nothing is allocated: strings are scanned, not copied, and numbers
+// are only converted to catch those out of a double's range. Reading a stream
+// allocates only for a number of more than 255 characters.
+ParseStatus validate(std::string_view input);
 
-std::optional<JsonValue> parse(std::istream& input);
+ParseStatus validate(std::istream& input);
 
-std::optional<JsonValue> parse_value(BufferReader& reader);
+// Two-stage parser: a SIMD pass indexes the structural characters of the whole
+// input, then the index is walked to build the value. Accepts exactly the same
+// documents as parse(). The engine is picked from CPUID unless one is forced.
+ParseResult parse_simd(std::string_view input, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
-std::optional<JsonValue> parse_bool(BufferReader& reader);
+ParseResult parse_simd(std::string_view input, SimdEngine engine, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
-std::optional<JsonValue> parse_null(BufferReader& reader);
+// Builds the flat tape representation instead of a JsonValue tree, using the
+// same structural index as parse_simd(). Accepts the same documents as parse()
+// and reports errors, locations included, the same way.
+TapeParseResult parse_tape(std::string_view input);
 
-std::optional<JsonValue> parse_string(BufferReader& reader);
+// The grammar functions below are instantiated for BufferReader, SpanReader,
+// BorrowingReader and the StatsReader of the first two.
+// Each one parses into a value or string owned by the caller, which also
+// decides the memory resource, and returns ParseError::None on success. On
+// failure the reader is left at the offending byte. None of them recurses:
+// nesting costs heap, not stack, and is limited to max_depth containers.
 
-std::optional<JsonValue> parse_number(BufferReader& reader);
+template <typename Reader>
+ParseError parse_document(Reader& reader, JsonValue& result, size_t max_depth = DEFAULT_MAX_DEPTH);
 
-std::optional<JsonValue> parse_object(BufferReader& reader);
+template <typename Reader>
+ParseError parse_value(Reader& reader, JsonValue& result, size_t max_depth = DEFAULT_MAX_DEPTH);
 
-std::optional<JsonValue> parse_array(BufferReader& reader);
+template <typename Reader>
+ParseError parse_bool(Reader& reader, JsonValue& result);
 
-std::optional<std::string> read_num_string(BufferReader& reader);
+template <typename Reader>
+ParseError parse_null(Reader& reader, JsonValue& result);
 
-std::optional<std::string> read_string(BufferReader& reader);
+template <typename Reader>
+ParseError parse_string(Reader& reader, JsonValue& result);
 
-std::optional<std::string> read_escape_sequence(BufferReader& reader);
+template <typename Reader>
+ParseError parse_number(Reader& reader, JsonValue& result);
 
-std::optional<std::pair<std::string, JsonValue>> read_key_value_pair(BufferReader& reader);
+template <typename Reader>
+ParseError parse_object(Reader& reader, JsonValue& result, size_t max_depth = DEFAULT_MAX_DEPTH);
 
-void consume_whitespace(BufferReader& reader);
+template <typename Reader>
+ParseError parse_array(Reader& reader, JsonValue& result, size_t max_depth = DEFAULT_MAX_DEPTH);
+
+// a number as read from the input, integers are only kept when they fit
+using NumberValue = std::variant<int64_t, uint64_t, double>;
+
+template <typename Reader>
+ParseError read_number(Reader& reader, NumberValue& result);
+
+// Consumes the number at the reader, checking it against the JSON grammar.
+// Appends every consumed byte to text unless it is null; integral is set when
+// there is neither a fraction nor an exponent.
+template <typename Reader>
+ParseError read_num_string(Reader& reader, JsonValue::String* text, bool& integral);
+
+// converts the text of a number that read_num_string accepted
+ParseError convert_number(std::string_view text, bool integral, NumberValue& result);
+
+template <typename Reader>
+ParseError read_string(Reader& reader, JsonValue::String& result);
+
+// decodes the escape sequence at the reader, a surrogate pair as a whole, and
+// appends it to result as UTF-8
+template <typename Reader>
+ParseError read_escape_sequence(Reader& reader, JsonValue::String& result);
+
+// parses one member and stores it in object
+template <typename Reader>
+ParseError read_key_value_pair(Reader& reader, JsonValue& object, size_t max_depth = DEFAULT_MAX_DEPTH);
+
+// consumes literal if the reader is at it, returns false at the first mismatch
+template <typename Reader>
+bool read_literal(Reader& reader, std::string_view literal);
+
+template <typename Reader>
+void consume_whitespace(Reader& reader);
 
 bool is_whitespace(char c);
 
 bool is_whitespace(std::optional<char> c);
 
-bool is_hex(char c);
\ No newline at end of file
+bool is_digit(char c);
+
+bool is_hex(char c);
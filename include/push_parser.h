@@ -0,0 +1,129 @@
+#pragma once
+
+#include "json.h"
+#include "parse_result.h"
+#include "parser.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Incremental parser for input that arrives in pieces of any size, such as the
+// segments read off a socket in an event loop. feed() takes each piece as it
+// comes and carries on where the previous one stopped, without looking at
+// earlier bytes again. All parse state lives in the object instead of on the
+// call stack, so nothing blocks and no thread is tied to a connection.
+//
+// A document ends at the bracket that closes its root. Whatever follows it in
+// the same piece is left alone for the next document: consumed() tells how much
+// of the last piece was used, and after take() the parser starts over. Accepts
+// the same documents as parse() apart from that trailing input, nesting
+// included: containers deeper than max_depth fail with ParseError::TooDeep.
+struct PushParser {
+    enum class Status {
+        // the document is not complete yet
+        NeedMoreData,
+        // take() hands out the document
+        ValueComplete,
+        // take() hands out the error, the parser ignores further input
+        Error
+    };
+
+    explicit PushParser(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    explicit PushParser(const ParseOptions& options, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    // the parse state points into the document being built
+    PushParser(const PushParser&) = delete;
+    PushParser& operator=(const PushParser&) = delete;
+
+    Status feed(const char* data, size_t size);
+    Status feed(std::string_view data);
+
+    // The input ended. A document that is still incomplete becomes an error,
+    // UnexpectedEnd or EmptyDocument if there was nothing but whitespace.
+    Status finish();
+
+    Status status() const;
+
+    // bytes of the last feed() that belong to the document, all of them unless
+    // it completed the document
+    size_t consumed() const;
+
+    // The document or the error, as if finish() had been called first. Resets
+    // the parser for the next document.
+    ParseResult take();
+
+    // drops the document in progress
+    void reset();
+
+private:
+    enum class State : uint8_t {
+        // the opening bracket of the root
+        Root,
+        // after '[', a value or ']'
+        FirstElement,
+        // after ',' in an array
+        Element,
+        // after '{', a key or '}'
+        FirstKey,
+        // after ',' in an object
+        Key,
+        Colon,
+        MemberValue,
+        // ',' or the bracket closing the innermost container
+        AfterValue,
+        String,
+        // within an escape sequence of a string
+        Escape,
+        Number,
+        Literal,
+        Done,
+        Failed
+    };
+
+    // Each returns the number of bytes of input it consumed. Where whitespace
+    // is allowed, the first byte of input is never whitespace.
+    size_t step(std::string_view input);
+    size_t start_value(std::string_view input);
+    size_t read_string(std::string_view input);
+    size_t read_escape(std::string_view input);
+    size_t read_number(std::string_view input);
+    size_t read_literal(std::string_view input);
+    size_t close_container(char c);
+
+    // the innermost container got a complete value
+    void end_value();
+    // at is the offending byte within the input handed to the current step
+    size_t fail(ParseError error, size_t at);
+
+    std::pmr::memory_resource* resource;
+    size_t max_depth = DEFAULT_MAX_DEPTH;
+    JsonValue root;
+    // the open containers, innermost last; only the innermost one grows, so
+    // the pointers into the ones around it stay valid
+    std::vector<JsonValue*> stack;
+    // where the value being parsed goes
+    JsonValue* slot = nullptr;
+
+    State state = State::Root;
+    // whether the string being read is a key
+    bool in_key = false;
+    // string contents, and the bytes of an unfinished number, escape sequence
+    // or literal
+    JsonValue::String text;
+    JsonValue::String token;
+    // bytes at the front of text known to be well-formed UTF-8
+    size_t checked = 0;
+    std::string_view literal;
+
+    ParseError error = ParseError::None;
+    SourceLocation error_location;
+    // bytes of the document so far, and where its current line starts; lines
+    // are counted in the whitespace between tokens
+    size_t offset = 0;
+    size_t line = 1;
+    size_t line_start = 0;
+    size_t last_consumed = 0;
+};
@@ -0,0 +1,221 @@
+#pragma once
+
+#include "parser.h"
+
+#include <istream>
+#include <string_view>
+
+// Event driven parsing: the document is reported to a handler as it is read and
+// no JsonValue is ever built. A handler provides
+//
+//   void on_null();
+//   void on_bool(bool value);
+//   void on_number(int64_t value);      integers that fit, see NumberValue
+//   void on_number(uint64_t value);
+//   void on_number(double value);
+//   void on_string(std::string_view value);
+//   void on_key(std::string_view key);
+//   void on_start_object();
+//   void on_end_object();
+//   void on_start_array();
+//   void on_end_array();
+//
+// A single on_number(double) or a template covers all three number overloads.
+// The views handed to on_string and on_key are only valid during the call.
+// Events already delivered stand when a later syntax error is found.
+template <typename Reader, typename Handler>
+struct SaxParser {
+    Reader& reader;
+    Handler& handler;
+    // reused by every string and key, so its capacity is only grown a few times
+    JsonValue::String scratch;
+    // open objects and arrays, limited like parse() limits them
+    size_t depth = 0;
+
+    SaxParser(Reader& _reader, Handler& _handler): reader{_reader}, handler{_handler} {};
+
+    ParseError parse_document();
+    ParseError parse_value();
+    ParseError parse_string(bool is_key);
+    ParseError parse_object();
+    ParseError parse_array();
+
+    ParseError error_at(ParseError error) const {
+        return reader ? error : ParseError::UnexpectedEnd;
+    }
+};
+
+template <typename Reader, typename Handler>
+ParseError SaxParser<Reader, Handler>::parse_document() {
+    consume_whitespace(reader);
+    if (!reader)
+        return ParseError::EmptyDocument;
+
+    // only allowed json file level values are object or array
+    ParseError error;
+    switch (reader.current()) {
+        case JsonConstants::OBJECT_START:
+            error = parse_object();
+            break;
+        case JsonConstants::ARRAY_START:
+            error = parse_array();
+            break;
+        default:
+            return ParseError::InvalidRoot;
+    }
+    if (error != ParseError::None)
+        return error;
+
+    consume_whitespace(reader);
+    if (reader)
+        return ParseError::TrailingCharacters;
+    return ParseError::None;
+}
+
+template <typename Reader, typename Handler>
+ParseError SaxParser<Reader, Handler>::parse_value() {
+    consume_whitespace(reader);
+
+    switch (reader.current()) {
+        case JsonConstants::STRING_QUOTE:
+            return parse_string(false);
+        case JsonConstants::ARRAY_START:
+            return parse_array();
+        case JsonConstants::OBJECT_START:
+            return parse_object();
+        case 't':
+            if (!read_literal(reader, "true")) return error_at(ParseError::InvalidLiteral);
+            handler.on_bool(true);
+            return ParseError::None;
+        case 'f':
+            if (!read_literal(reader, "false")) return error_at(ParseError::InvalidLiteral);
+            handler.on_bool(false);
+            return ParseError::None;
+        case 'n':
+            if (!read_literal(reader, "null")) return error_at(ParseError::InvalidLiteral);
+            handler.on_null();
+            return ParseError::None;
+        default: {
+            if (!is_digit(reader.current()) && reader.current() != JsonConstants::MINUS)
+                return error_at(ParseError::UnexpectedCharacter);
+            NumberValue number;
+            ParseError error = read_number(reader, number);
+            if (error != ParseError::None)
+                return error;
+            std::visit([this](auto held) { handler.on_number(held); }, number);
+            return ParseError::None;
+        }
+    }
+}
+
+template <typename Reader, typename Handler>
+ParseError SaxParser<Reader, Handler>::parse_string(bool is_key) {
+    scratch.clear();
+    ParseError error = read_string(reader, scratch);
+    if (error != ParseError::None)
+        return error;
+
+    if (is_key) handler.on_key(scratch);
+    else handler.on_string(scratch);
+    return ParseError::None;
+}
+
+template <typename Reader, typename Handler>
+ParseError SaxParser<Reader, Handler>::parse_object() {
+    if (depth == DEFAULT_MAX_DEPTH)
+        return ParseError::TooDeep;
+    depth++;
+
+    // consume beginning of object
+    reader.advance();
+    handler.on_start_object();
+
+    consume_whitespace(reader);
+    if (reader.current() == JsonConstants::OBJECT_END) {
+        reader.advance();
+        depth--;
+        handler.on_end_object();
+        return ParseError::None;
+    }
+
+    while (true) {
+        consume_whitespace(reader);
+        if (reader.current() != JsonConstants::STRING_QUOTE)
+            return error_at(ParseError::ExpectedKey);
+        ParseError error = parse_string(true);
+        if (error != ParseError::None) return error;
+
+        consume_whitespace(reader);
+        if (reader.current() != JsonConstants::KEY_VALUE_SEPARATOR)
+            return error_at(ParseError::ExpectedColon);
+        reader.advance();
+
+        error = parse_value();
+        if (error != ParseError::None) return error;
+
+        consume_whitespace(reader);
+        if (reader.current() == JsonConstants::COMMA) {
+            reader.advance();
+        } else if (reader.current() == JsonConstants::OBJECT_END) {
+            reader.advance();
+            depth--;
+            handler.on_end_object();
+            return ParseError::None;
+        } else return error_at(ParseError::ExpectedCommaOrObjectEnd);
+    }
+}
+
+template <typename Reader, typename Handler>
+ParseError SaxParser<Reader, Handler>::parse_array() {
+    if (depth == DEFAULT_MAX_DEPTH)
+        return ParseError::TooDeep;
+    depth++;
+
+    // consume beginning of array
+    reader.advance();
+    handler.on_start_array();
+
+    consume_whitespace(reader);
+    if (reader.current() == JsonConstants::ARRAY_END) {
+        reader.advance();
+        depth--;
+        handler.on_end_array();
+        return ParseError::None;
+    }
+
+    while (true) {
+        ParseError error = parse_value();
+        if (error != ParseError::None) return error;
+
+        consume_whitespace(reader);
+        if (reader.current() == JsonConstants::COMMA) {
+            reader.advance();
+        } else if (reader.current() == JsonConstants::ARRAY_END) {
+            reader.advance();
+            depth--;
+            handler.on_end_array();
+            return ParseError::None;
+        } else return error_at(ParseError::ExpectedCommaOrArrayEnd);
+    }
+}
+
+// accepts exactly the documents parse() does and reports the same errors
+template <typename Handler>
+ParseStatus parse_sax(std::istream& input, Handler& handler) {
+    BufferReader reader(input);
+    ParseError error = SaxParser<BufferReader, Handler>(reader, handler).parse_document();
+    if (error == ParseError::None)
+        return ParseStatus();
+    if (reader.status() == BufferReader::Status::FAIL)
+        error = ParseError::IoError;
+    return ParseStatus{error, reader.location()};
+}
+
+template <typename Handler>
+ParseStatus parse_sax(std::string_view input, Handler& handler) {
+    SpanReader reader(input);
+    ParseError error = SaxParser<SpanReader, Handler>(reader, handler).parse_document();
+    if (error == ParseError::None)
+        return ParseStatus();
+    return ParseStatus{error, reader.location()};
+}
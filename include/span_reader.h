@@ -0,0 +1,62 @@
+#pragma once
+#include "parse_result.h"
+#include <cstddef>
+#include <string_view>
+
+// Reader over a contiguous, caller-owned buffer. Exposes the same interface the
+// parser uses on BufferReader, but advances a raw pointer: there is no refill
+// check and no std::optional wrapping per byte. The accessors are defined
+// inline so the parser instantiation can see through them.
+struct SpanReader {
+    SpanReader(std::string_view _input);
+
+    SpanReader(const char* _begin, const char* _end);
+
+    operator bool() const {
+        return cur != end;
+    }
+
+    // the next byte, or '\0' once the input is exhausted
+    char current() const {
+        return cur != end ? *cur : '\0';
+    }
+
+    // consumes one byte, does nothing once the input is exhausted
+    void advance() {
+        if (cur != end) [[likely]] cur++;
+    }
+
+    // consumes count bytes, at most as many as remaining() holds
+    void advance(size_t count) {
+        cur += count;
+    }
+
+    // the bytes not consumed yet
+    std::string_view remaining() const {
+        return std::string_view(cur, end - cur);
+    }
+
+    // number of bytes consumed so far
+    size_t offset() const {
+        return cur - begin;
+    }
+
+    // line and column of the next byte
+    SourceLocation location() const;
+
+    const char* position() const {
+        return cur;
+    }
+
+private:
+    const char* begin;
+    const char* cur;
+    const char* end;
+};
+
+// A SpanReader over a buffer the caller keeps alive as long as the parsed
+// document, so the parser may leave strings in it instead of copying them.
+// See parse_borrowed().
+struct BorrowingReader: SpanReader {
+    using SpanReader::SpanReader;
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Stage one of the two-stage parser. The input is classified 64 bytes at a time
+// into quote, backslash, structural and whitespace bitmasks, and the bitmasks
+// are reduced to the positions stage two has to visit.
+
+enum class SimdEngine {
+    Scalar,
+    SSE42,
+    AVX2
+};
+
+// best engine supported by the CPU we are running on, checked once via CPUID
+SimdEngine detect_simd_engine();
+
+bool engine_supported(SimdEngine engine);
+
+const char* simd_engine_name(SimdEngine engine);
+
+// Positions of every structural character ({}[]:,) outside of strings, every
+// opening quote, and the first byte of every bare scalar (numbers, true, false,
+// null, or stray bytes), in input order. Returns std::nullopt if a string is
+// still open at the end of the input, or if the input is too large to be
+// indexed with 32 bit positions. Requesting an engine the CPU does not support
+// falls back to the scalar kernel.
+std::optional<std::vector<uint32_t>> build_structural_index(std::string_view input, SimdEngine engine);
+
+std::optional<std::vector<uint32_t>> build_structural_index(std::string_view input);
+
+// Indexing in parts, such as on several threads. The index of the whole input
+// is that of consecutive spans, each shifted by where it starts, provided no
+// span starts right after a backslash and each is told whether the ones before
+// it leave a string open, which is when they hold an odd number of unescaped
+// quotes. The one difference is that a bare scalar running across the start of
+// a span is reported there again. Spans are limited to 32 bit positions.
+
+size_t count_unescaped_quotes(std::string_view span, SimdEngine engine);
+
+// positions relative to the start of span, in_string if it starts inside one
+std::vector<uint32_t> build_span_index(std::string_view span, bool in_string, SimdEngine engine);
@@ -0,0 +1,49 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads running submitted tasks in submission order.
+// The destructor finishes every task already submitted before joining.
+struct ThreadPool {
+    // 0 picks one thread per hardware thread
+    explicit ThreadPool(size_t threads = 0);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool();
+
+    size_t size() const;
+
+    // the future also carries any exception the task throws
+    template <typename Task>
+    std::future<std::invoke_result_t<Task>> submit(Task&& task) {
+        using Result = std::invoke_result_t<Task>;
+        // std::function needs a copyable target, packaged_task is move-only
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace_back([packaged]() { (*packaged)(); });
+        }
+        wakeup.notify_one();
+        return result;
+    }
+
+private:
+    void run();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+};
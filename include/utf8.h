@@ -0,0 +1,15 @@
+#pragma once
+#include "structural_index.h"
+
+#include <cstddef>
+#include <string_view>
+
+// Offset of the first byte of text that does not start a well-formed UTF-8
+// sequence, or that starts one which is cut short, overlong, a surrogate or
+// beyond U+10FFFF; text.size() if there is none. The vector engines check 16
+// or 32 bytes at a time with the lookup tables of Keiser and Lemire, "Validating
+// UTF-8 In Less Than One Instruction Per Byte", and only rescan to locate an
+// error they found.
+size_t find_invalid_utf8(std::string_view text, SimdEngine engine);
+
+size_t find_invalid_utf8(std::string_view text);
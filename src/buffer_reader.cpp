@@ -1,4 +1,5 @@
 #include "buffer_reader.h"
+#include <algorithm>
 
 BufferReader::BufferReader(std::istream& _stream): next_pos{std::nullopt}, cur_read_size{0}, next_byte_status{Status::OKAY}, stream{_stream} {
     update_buffer();
@@ -15,10 +16,7 @@ BufferReader::Status BufferReader::status() const {
 std::optional<char> BufferReader::next_byte() {
     if (next_byte_status == Status::OKAY) {
         char return_val = buffer[*next_pos];
-        next_pos = *next_pos + 1;
-        if (*next_pos >= cur_read_size) [[unlikely]] {
-            update_buffer();
-        }
+        advance();
         return return_val;
     } else return std::nullopt;
 }
@@ -29,35 +27,68 @@ std::optional<char> BufferReader::peek() const {
     } else return std::nullopt;
 }
 
-char BufferReader::throw_next_byte() {
-    std::optional<char> cur_read = next_byte();
-    if (cur_read.has_value()) [[likely]] return *cur_read;
-    throw std::runtime_error("Invalid next_byte");
+char BufferReader::current() const {
+    if (next_byte_status == Status::OKAY) [[likely]] return buffer[*next_pos];
+    return '\0';
 }
 
-char BufferReader::throw_peek() const {
-    std::optional<char> cur_read = peek();
-    if (cur_read.has_value()) [[likely]] return *cur_read;
-    throw std::runtime_error("Invalid peek");
+void BufferReader::advance() {
+    if (next_byte_status != Status::OKAY) [[unlikely]] return;
+    next_pos = *next_pos + 1;
+    if (*next_pos >= cur_read_size) [[unlikely]] {
+        update_buffer();
+    }
+}
+
+bool BufferReader::refill_pending() const {
+    return next_byte_status == Status::OKAY && *next_pos + 1 >= cur_read_size;
+}
+
+size_t BufferReader::offset() const {
+    return consumed_before_buffer + next_pos.value_or(0);
+}
+
+SourceLocation BufferReader::location() const {
+    size_t pos = next_pos.value_or(0);
+    const char* newline = std::find(std::make_reverse_iterator(buffer + pos), std::make_reverse_iterator(buffer), '\n').base();
+
+    SourceLocation location;
+    location.offset = offset();
+    location.line = 1 + lines_before_buffer + std::count(buffer, buffer + pos, '\n');
+    if (newline != buffer)
+        location.column = 1 + (buffer + pos - newline);
+    else
+        location.column = 1 + location.offset - line_start_before_buffer;
+    return location;
 }
 
 void BufferReader::update_buffer() {
     // check current state of stream
     if (next_byte_status != Status::OKAY) return;
 
+    // remember what the chunk being discarded contained
+    if (next_pos.has_value()) {
+        lines_before_buffer += std::count(buffer, buffer + cur_read_size, '\n');
+        const char* newline = std::find(std::make_reverse_iterator(buffer + cur_read_size), std::make_reverse_iterator(buffer), '\n').base();
+        if (newline != buffer)
+            line_start_before_buffer = consumed_before_buffer + (newline - buffer);
+        consumed_before_buffer += cur_read_size;
+    }
+
     if (stream.good()) {
         stream.read(buffer, BUFFER_SIZE);
         cur_read_size = stream.gcount();
         next_pos = 0;
+        // a read can come back empty when the input was an exact multiple of the buffer
+        if (cur_read_size > 0) return;
+    }
+
+    next_pos = std::nullopt;
+    cur_read_size = 0;
+
+    if (stream.eof()) {
+        next_byte_status = Status::END_OF_FILE;
     } else {
-        next_pos = std::nullopt;
-        cur_read_size = 0;
-
-        if (stream.eof()) {
-            next_byte_status = Status::END_OF_FILE;
-        } else {
-            next_byte_status = Status::FAIL;
-        }
+        next_byte_status = Status::FAIL;
     }
 }
-
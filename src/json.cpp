@@ -1,49 +1,132 @@
 #include "json.h"
+#include "json_writer.h"
 #include <stdexcept>
 #include <sstream>
 
 
 
+namespace {
+
+// Rebuilds the held alternative so that everything it owns comes from alloc.
+template <typename Var>
+JsonValue::var_t with_allocator(Var&& source, const JsonValue::allocator_type& alloc) {
+    return std::visit([&](auto&& held) -> JsonValue::var_t {
+        using T = std::decay_t<decltype(held)>;
+        if constexpr (std::uses_allocator_v<T, JsonValue::allocator_type>)
+            return JsonValue::var_t(std::in_place_type<T>, std::forward<decltype(held)>(held), alloc);
+        else
+            return JsonValue::var_t(held);
+    }, std::forward<Var>(source));
+}
+
+} // namespace
+
 JsonValue::JsonValue(): value{nullptr} {};
-JsonValue::JsonValue(nullptr_t _value): value{nullptr} {};
-JsonValue::JsonValue(bool _value): value{_value} {};
-JsonValue::JsonValue(int _value): value{(double) _value} {};
-JsonValue::JsonValue(double _value): value{_value} {};
-JsonValue::JsonValue(const std::string& _value): value{_value} {};
-JsonValue::JsonValue(const char* _value): value{std::string(_value)} {};
-JsonValue::JsonValue(const Object& _value): value{_value} {}; 
-JsonValue::JsonValue(const Array& _value): value{_value} {}; 
-JsonValue::JsonValue(Object&& _value): value{std::move(_value)} {};
-JsonValue::JsonValue(Array&& _value): value{std::move(_value)} {};
-
-JsonValue::JsonValue(Type _type) {
-    switch (_type) {
-        case Type::Null: value = nullptr; break;
-        case Type::Boolean: value = false; break;
-        case Type::Number: value = 0.0; break;
-        case Type::String: value = std::string(); break;
-        case Type::Object: value = Object(); break;
-        case Type::Array: value = Array(); break;
+JsonValue::JsonValue(const allocator_type& _alloc): alloc{_alloc}, value{nullptr} {};
+JsonValue::JsonValue(nullptr_t _value, const allocator_type& _alloc): alloc{_alloc}, value{nullptr} {};
+JsonValue::JsonValue(bool _value, const allocator_type& _alloc): alloc{_alloc}, value{_value} {};
+JsonValue::JsonValue(int _value, const allocator_type& _alloc): alloc{_alloc}, value{int64_t(_value)} {};
+JsonValue::JsonValue(int64_t _value, const allocator_type& _alloc): alloc{_alloc}, value{_value} {};
+JsonValue::JsonValue(uint64_t _value, const allocator_type& _alloc): alloc{_alloc}, value{_value} {};
+JsonValue::JsonValue(double _value, const allocator_type& _alloc): alloc{_alloc}, value{_value} {};
+JsonValue::JsonValue(std::string_view _value, const allocator_type& _alloc): alloc{_alloc}, value{std::in_place_type<String>, _value, _alloc} {};
+JsonValue::JsonValue(const std::string& _value, const allocator_type& _alloc): alloc{_alloc}, value{std::in_place_type<String>, _value, _alloc} {};
+JsonValue::JsonValue(const char* _value, const allocator_type& _alloc): alloc{_alloc}, value{std::in_place_type<String>, _value, _alloc} {};
+JsonValue::JsonValue(String&& _value): alloc{_value.get_allocator()}, value{std::move(_value)} {};
+JsonValue::JsonValue(const Object& _value, const allocator_type& _alloc): alloc{_alloc}, value{std::in_place_type<Object>, _value, _alloc} {};
+JsonValue::JsonValue(const Array& _value, const allocator_type& _alloc): alloc{_alloc}, value{std::in_place_type<Array>, _value, _alloc} {};
+JsonValue::JsonValue(Object&& _value, const allocator_type& _alloc): alloc{_alloc}, value{std::in_place_type<Object>, std::move(_value), _alloc} {};
+JsonValue::JsonValue(Array&& _value, const allocator_type& _alloc): alloc{_alloc}, value{std::in_place_type<Array>, std::move(_value), _alloc} {};
+
+JsonValue::JsonValue(Type _type, const allocator_type& _alloc): alloc{_alloc} {
+    set_type(_type);
+}
+
+JsonValue::JsonValue(const JsonValue& other): value{with_allocator(other.value, alloc)} {};
+JsonValue::JsonValue(const JsonValue& other, const allocator_type& _alloc): alloc{_alloc}, value{with_allocator(other.value, _alloc)} {};
+JsonValue::JsonValue(JsonValue&& other) noexcept: alloc{other.alloc}, value{std::move(other.value)} {};
+JsonValue::JsonValue(JsonValue&& other, const allocator_type& _alloc): alloc{_alloc}, value{with_allocator(std::move(other.value), _alloc)} {};
+
+JsonValue& JsonValue::operator=(const JsonValue& other) {
+    if (this != &other)
+        value = with_allocator(other.value, alloc);
+    return *this;
+}
+
+JsonValue& JsonValue::operator=(JsonValue&& other) {
+    if (this != &other) {
+        // go through a temporary, other may live inside the value being replaced
+        var_t replacement = with_allocator(std::move(other.value), alloc);
+        value = std::move(replacement);
     }
+    return *this;
+}
+
+JsonValue::allocator_type JsonValue::get_allocator() const {
+    return alloc;
 }
 
 JsonValue::Type JsonValue::type() const {
+    if (std::holds_alternative<int64_t>(value) || std::holds_alternative<uint64_t>(value))
+        return Type::Number;
+    if (std::holds_alternative<std::string_view>(value))
+        return Type::String;
     return static_cast<JsonValue::Type>(value.index());
 }
 
+JsonValue::NumberType JsonValue::number_type() const {
+    verify_type(Type::Number);
+    if (std::holds_alternative<int64_t>(value)) return NumberType::Int64;
+    if (std::holds_alternative<uint64_t>(value)) return NumberType::UInt64;
+    return NumberType::Double;
+}
+
 bool JsonValue::as_boolean() const {
     verify_type(Type::Boolean);
     return std::get<bool>(value);
 }
 
 double JsonValue::as_double() const {
-    verify_type(Type::Number);
-    return std::get<double>(value);
+    switch (number_type()) {
+        case NumberType::Int64: return static_cast<double>(std::get<int64_t>(value));
+        case NumberType::UInt64: return static_cast<double>(std::get<uint64_t>(value));
+        default: return std::get<double>(value);
+    }
+}
+
+int64_t JsonValue::as_int64() const {
+    switch (number_type()) {
+        case NumberType::Int64:
+            return std::get<int64_t>(value);
+        case NumberType::UInt64:
+            if (std::get<uint64_t>(value) <= uint64_t(INT64_MAX))
+                return static_cast<int64_t>(std::get<uint64_t>(value));
+            break;
+        default:
+            break;
+    }
+    throw std::out_of_range("Number is not an int64");
+}
+
+uint64_t JsonValue::as_uint64() const {
+    switch (number_type()) {
+        case NumberType::UInt64:
+            return std::get<uint64_t>(value);
+        case NumberType::Int64:
+            if (std::get<int64_t>(value) >= 0)
+                return static_cast<uint64_t>(std::get<int64_t>(value));
+            break;
+        default:
+            break;
+    }
+    throw std::out_of_range("Number is not a uint64");
 }
 
-const std::string& JsonValue::as_string() const {
+std::string_view JsonValue::as_string() const {
     verify_type(Type::String);
-    return std::get<std::string>(value);
+    if (const std::string_view* borrowed = std::get_if<std::string_view>(&value))
+        return *borrowed;
+    return std::get<String>(value);
 }
 
 const JsonValue::Object& JsonValue::as_object() const {
@@ -56,14 +139,27 @@ const JsonValue::Array& JsonValue::as_array() const {
     return std::get<Array>(value);
 }
 
-JsonValue& JsonValue::at(const std::string& index) {
+JsonValue& JsonValue::at(std::string_view index) {
+    verify_type(Type::Object);
+    Object& object = std::get<Object>(value);
+    auto it = object.find(index);
+    if (it == object.end())
+        return at(KeyPool::current().intern(index));
+    return it->second;
+}
+
+JsonValue& JsonValue::at(const JsonKey& key) {
     verify_type(Type::Object);
-    return std::get<Object>(value)[index];
+    return std::get<Object>(value).try_emplace(key).first->second;
 }
 
-const JsonValue& JsonValue::at(const std::string& index) const {
+const JsonValue& JsonValue::at(std::string_view index) const {
     verify_type(Type::Object);
-    return std::get<Object>(value).at(index);
+    const Object& object = std::get<Object>(value);
+    auto it = object.find(index);
+    if (it == object.end())
+        throw std::out_of_range("Key not found");
+    return it->second;
 }
 
 JsonValue& JsonValue::at(int index) {
@@ -78,7 +174,7 @@ const JsonValue& JsonValue::at(int index) const {
     return std::get<Array>(value).at(index);
 }
 
-bool JsonValue::exists(const std::string& index) const {
+bool JsonValue::exists(std::string_view index) const {
     return type() == Type::Object && std::get<Object>(value).contains(index);
 }
 
@@ -86,25 +182,29 @@ bool JsonValue::exists(const int index) const {
     return index >= 0 && type() == Type::Array && index < (int) std::get<Array>(value).size();
 }
 
-void JsonValue::set_index(const std::string& index, const JsonValue& _value) {
-    verify_type(Type::Object);
-    std::get<Object>(value)[index] = _value;
+void JsonValue::set_index(std::string_view index, const JsonValue& _value) {
+    at(index) = _value;
 }
-void JsonValue::set_index(const std::string& index, JsonValue&& _value) {
+void JsonValue::set_index(std::string_view index, JsonValue&& _value) {
     verify_type(Type::Object);
-    std::get<Object>(value)[index] = std::move(_value);
+    Object& object = std::get<Object>(value);
+    auto it = object.find(index);
+    if (it == object.end())
+        object.append(KeyPool::current().intern(index), std::move(_value));
+    else
+        it->second = std::move(_value);
 }
-void JsonValue::set_index(const std::string& index, const JsonValue::Array& _value) {
-    set_index(index, JsonValue(_value));
+void JsonValue::set_index(std::string_view index, const JsonValue::Array& _value) {
+    set_index(index, JsonValue(_value, alloc));
 }
-void JsonValue::set_index(const std::string& index, JsonValue::Array&& _value) {
-    set_index(index, JsonValue(_value));
+void JsonValue::set_index(std::string_view index, JsonValue::Array&& _value) {
+    set_index(index, JsonValue(std::move(_value), alloc));
 }
-void JsonValue::set_index(const std::string& index, const JsonValue::Object& _value){
-    set_index(index, JsonValue(_value));
+void JsonValue::set_index(std::string_view index, const JsonValue::Object& _value){
+    set_index(index, JsonValue(_value, alloc));
 }
-void JsonValue::set_index(const std::string& index, JsonValue::Object&& _value) {
-    set_index(index, JsonValue(_value));
+void JsonValue::set_index(std::string_view index, JsonValue::Object&& _value) {
+    set_index(index, JsonValue(std::move(_value), alloc));
 }
 
 void JsonValue::set_index(const int index, const JsonValue& _value) {
@@ -118,16 +218,16 @@ void JsonValue::set_index(const int index, JsonValue&& _value) {
     std::get<Array>(value)[index] = std::move(_value);
 }
 void JsonValue::set_index(const int index, const JsonValue::Array& _value) {
-    set_index(index, JsonValue(_value));
+    set_index(index, JsonValue(_value, alloc));
 }
 void JsonValue::set_index(const int index, JsonValue::Array&& _value) {
-    set_index(index, JsonValue(_value));
+    set_index(index, JsonValue(std::move(_value), alloc));
 }
 void JsonValue::set_index(const int index, const JsonValue::Object& _value) {
-    set_index(index, JsonValue(_value));
+    set_index(index, JsonValue(_value, alloc));
 }
 void JsonValue::set_index(const int index, JsonValue::Object&& _value) {
-    set_index(index, JsonValue(_value));
+    set_index(index, JsonValue(std::move(_value), alloc));
 }
 
 void JsonValue::push_back(const JsonValue& _value) {
@@ -138,17 +238,22 @@ void JsonValue::push_back(JsonValue&& _value) {
     verify_type(Type::Array);
     std::get<Array>(value).push_back(std::move(_value));
 }
+JsonValue& JsonValue::emplace_back() {
+    verify_type(Type::Array);
+    // the array hands its resource to the new element
+    return std::get<Array>(value).emplace_back();
+}
 void JsonValue::push_back(const Array& _value) {
-    push_back(JsonValue(_value));
+    push_back(JsonValue(_value, alloc));
 }
 void JsonValue::push_back(Array&& _value) {
-    push_back(JsonValue(_value));
+    push_back(JsonValue(std::move(_value), alloc));
 }
 void JsonValue::push_back(const Object& _value) {
-    push_back(JsonValue(_value));
+    push_back(JsonValue(_value, alloc));
 }
 void JsonValue::push_back(Object&& _value) {
-    push_back(JsonValue(_value));
+    push_back(JsonValue(std::move(_value), alloc));
 }
 
 void JsonValue::set_value(bool _value) {
@@ -159,28 +264,48 @@ void JsonValue::set_value(double _value) {
     value = _value;
 }
 
-void JsonValue::set_value(const std::string& _value) {
+void JsonValue::set_value(int64_t _value) {
+    value = _value;
+}
+
+void JsonValue::set_value(uint64_t _value) {
     value = _value;
 }
 
+void JsonValue::set_value(const std::string& _value) {
+    value.emplace<String>(_value, alloc);
+}
+
 void JsonValue::set_value(std::string&& _value) {
-    value = std::move(_value);
+    value.emplace<String>(_value, alloc);
+}
+
+void JsonValue::set_value(String&& _value) {
+    value.emplace<String>(std::move(_value), alloc);
 }
 
 void JsonValue::set_value(const Object& _value) {
-    value = _value;
+    value.emplace<Object>(_value, alloc);
 }
 
 void JsonValue::set_value(Object&& _value) {
-    value = std::move(_value);
+    value.emplace<Object>(std::move(_value), alloc);
+}
+
+void JsonValue::borrow_string(std::string_view _value) {
+    value.emplace<std::string_view>(_value);
+}
+
+bool JsonValue::is_borrowed() const {
+    return std::holds_alternative<std::string_view>(value);
 }
 
 void JsonValue::set_value(const Array& _value) {
-    value = _value;
+    value.emplace<Array>(_value, alloc);
 }
 
 void JsonValue::set_value(Array&& _value) {
-    value = std::move(_value);
+    value.emplace<Array>(std::move(_value), alloc);
 }
 
 void JsonValue::set_type(Type type) {
@@ -188,24 +313,18 @@ void JsonValue::set_type(Type type) {
         case Type::Null: value = nullptr; return;
         case Type::Boolean: value = bool(); return;
         case Type::Number: value = double(); return;
-        case Type::String: value = std::string(); return;
-        case Type::Object: value = Object(); return;
-        case Type::Array: value = Array(); return;
+        case Type::String: value.emplace<String>(alloc); return;
+        case Type::Object: value.emplace<Object>(alloc); return;
+        case Type::Array: value.emplace<Array>(alloc); return;
         default:
             throw std::runtime_error("Invalid JSON type");
     }
 }
 
 std::string JsonValue::to_string() const {
-    switch (type()) {
-        case Type::Null: return "null";
-        case Type::Boolean: return as_boolean() ? "true" : "false";
-        case Type::Number: return std::to_string(as_double());
-        case Type::String: return "\"" + as_string() + "\"";
-        case Type::Object: return object_to_string();
-        case Type::Array: return array_to_string();
-        default: throw std::runtime_error("Invalid JSON type");
-    }
+    std::string result;
+    write_json(*this, result);
+    return result;
 }
 
 void JsonValue::verify_type(Type expected) const {
@@ -220,35 +339,3 @@ void JsonValue::verify_index(int index) const {
     if (index < 0 || index >= (int) std::get<Array>(value).size())
         throw std::runtime_error("Index out of bounds");
 }
-
-std::string JsonValue::object_to_string() const {
-    std::stringstream ss;
-    bool start = true;
-    ss << JsonConstants::OBJECT_START;
-    for (const auto& [key, json_val]: std::get<Object>(value)) {
-        if (!start) ss << ", ";
-        start = false;
-
-        ss << JsonConstants::STRING_QUOTE << key << JsonConstants::STRING_QUOTE;
-        ss << JsonConstants::KEY_VALUE_SEPARATOR << " ";
-
-        ss << json_val.to_string();
-    }
-    ss << JsonConstants::OBJECT_END;
-    return ss.str();
-}
-
-std::string JsonValue::array_to_string() const {
-    std::stringstream ss;
-    bool start = true;
-    ss << JsonConstants::ARRAY_START;
-    for (const auto& json_val: std::get<Array>(value)) {
-        if (!start) ss << ", ";
-        start = false;
-        ss << json_val.to_string();
-    }
-    ss << JsonConstants::ARRAY_END;
-    return ss.str();
-}   
-
-
@@ -0,0 +1,370 @@
+#include "json_binary.h"
+#include "parser.h"
+
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// output is handed to the sink whenever this much has accumulated
+constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+namespace Tag {
+    constexpr uint8_t SMALL_UINT_MAX = 0x7f;
+    constexpr uint8_t NULL_VALUE = 0x80;
+    constexpr uint8_t FALSE_VALUE = 0x81;
+    constexpr uint8_t TRUE_VALUE = 0x82;
+    // followed by 1, 2, 4 or 8 bytes
+    constexpr uint8_t UINT = 0x83;
+    constexpr uint8_t INT = 0x87;
+    constexpr uint8_t FLOAT = 0x8b;
+    constexpr uint8_t DOUBLE = 0x8c;
+    constexpr uint8_t STRING = 0x8d;
+    constexpr uint8_t ARRAY = 0x8e;
+    constexpr uint8_t OBJECT = 0x8f;
+    constexpr uint8_t SHORT_STRING = 0xa0;
+    constexpr size_t SHORT_STRING_MAX = 31;
+    constexpr uint8_t SMALL_NEGATIVE = 0xe0;
+    constexpr int64_t SMALL_NEGATIVE_MIN = -32;
+}
+
+// index into 1, 2, 4, 8 bytes
+int width_index(uint64_t magnitude) {
+    if (magnitude <= UINT8_MAX) return 0;
+    if (magnitude <= UINT16_MAX) return 1;
+    if (magnitude <= UINT32_MAX) return 2;
+    return 3;
+}
+
+int signed_width_index(int64_t number) {
+    if (number >= INT8_MIN && number <= INT8_MAX) return 0;
+    if (number >= INT16_MIN && number <= INT16_MAX) return 1;
+    if (number >= INT32_MIN && number <= INT32_MAX) return 2;
+    return 3;
+}
+
+// Flush is called with the buffer once it grows past CHUNK_SIZE and is expected
+// to empty it; std::nullptr_t means everything stays in the buffer.
+template <typename Flush>
+struct Encoder {
+    std::string& out;
+    Flush flush;
+    // ids of the keys written so far, by the address of their interned bytes
+    std::unordered_map<const char*, size_t> key_ids;
+
+    void maybe_flush() {
+        if constexpr (!std::is_same_v<Flush, std::nullptr_t>) {
+            if (out.size() >= CHUNK_SIZE) flush(out);
+        }
+    }
+
+    void write_varint(uint64_t number) {
+        while (number >= 0x80) {
+            out += static_cast<char>(number | 0x80);
+            number >>= 7;
+        }
+        out += static_cast<char>(number);
+    }
+
+    void write_fixed(uint64_t bits, int width) {
+        for (int idx = 0; idx < (1 << width); idx++)
+            out += static_cast<char>(bits >> (8 * idx));
+    }
+
+    void write_value(const JsonValue& value);
+    void write_number(const JsonValue& value);
+    void write_string(std::string_view str);
+    void write_key(const JsonKey& key);
+};
+
+template <typename Flush>
+void Encoder<Flush>::write_value(const JsonValue& value) {
+    switch (value.type()) {
+        case JsonValue::Type::Null: out += static_cast<char>(Tag::NULL_VALUE); break;
+        case JsonValue::Type::Boolean:
+            out += static_cast<char>(value.as_boolean() ? Tag::TRUE_VALUE : Tag::FALSE_VALUE);
+            break;
+        case JsonValue::Type::Number: write_number(value); break;
+        case JsonValue::Type::String: write_string(value.as_string()); break;
+        case JsonValue::Type::Object:
+            out += static_cast<char>(Tag::OBJECT);
+            write_varint(value.as_object().size());
+            for (const auto& [key, member]: value.as_object()) {
+                write_key(key);
+                write_value(member);
+                maybe_flush();
+            }
+            break;
+        case JsonValue::Type::Array:
+            out += static_cast<char>(Tag::ARRAY);
+            write_varint(value.as_array().size());
+            for (const auto& element: value.as_array()) {
+                write_value(element);
+                maybe_flush();
+            }
+            break;
+    }
+}
+
+template <typename Flush>
+void Encoder<Flush>::write_number(const JsonValue& value) {
+    switch (value.number_type()) {
+        case JsonValue::NumberType::UInt64: {
+            uint64_t number = value.as_uint64();
+            if (number <= Tag::SMALL_UINT_MAX) {
+                out += static_cast<char>(number);
+                return;
+            }
+            int width = width_index(number);
+            out += static_cast<char>(Tag::UINT + width);
+            write_fixed(number, width);
+            return;
+        }
+        case JsonValue::NumberType::Int64: {
+            int64_t number = value.as_int64();
+            if (number >= Tag::SMALL_NEGATIVE_MIN && number < 0) {
+                out += static_cast<char>(Tag::SMALL_NEGATIVE + (number - Tag::SMALL_NEGATIVE_MIN));
+                return;
+            }
+            int width = signed_width_index(number);
+            out += static_cast<char>(Tag::INT + width);
+            write_fixed(static_cast<uint64_t>(number), width);
+            return;
+        }
+        default: {
+            double number = value.as_double();
+            // narrowing a double beyond the range of float is undefined
+            float narrow = std::fabs(number) <= std::numeric_limits<float>::max() ? static_cast<float>(number) : 0;
+            if (static_cast<double>(narrow) == number) {
+                out += static_cast<char>(Tag::FLOAT);
+                write_fixed(std::bit_cast<uint32_t>(narrow), 2);
+            } else {
+                out += static_cast<char>(Tag::DOUBLE);
+                write_fixed(std::bit_cast<uint64_t>(number), 3);
+            }
+        }
+    }
+}
+
+template <typename Flush>
+void Encoder<Flush>::write_string(std::string_view str) {
+    if (str.size() <= Tag::SHORT_STRING_MAX) {
+        out += static_cast<char>(Tag::SHORT_STRING + str.size());
+    } else {
+        out += static_cast<char>(Tag::STRING);
+        write_varint(str.size());
+    }
+    out.append(str);
+}
+
+template <typename Flush>
+void Encoder<Flush>::write_key(const JsonKey& key) {
+    auto [it, added] = key_ids.try_emplace(key.view().data(), key_ids.size());
+    if (!added) {
+        write_varint(uint64_t(it->second) << 1);
+        return;
+    }
+    write_varint(uint64_t(key.view().size()) << 1 | 1);
+    out.append(key.view());
+}
+
+struct Decoder {
+    std::string_view input;
+    size_t pos = 0;
+    // by id, in the order the document defines them
+    std::vector<JsonKey> keys;
+    ParseError error = ParseError::None;
+    size_t error_offset = 0;
+
+    bool fail(ParseError _error, size_t offset) {
+        error = _error;
+        error_offset = offset;
+        return false;
+    }
+
+    bool read_byte(uint8_t& byte) {
+        if (pos == input.size()) return fail(ParseError::UnexpectedEnd, pos);
+        byte = static_cast<uint8_t>(input[pos++]);
+        return true;
+    }
+
+    bool read_varint(uint64_t& number) {
+        size_t start = pos;
+        number = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte;
+            if (!read_byte(byte)) return false;
+            number |= uint64_t(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) return true;
+        }
+        return fail(ParseError::InvalidEncoding, start);
+    }
+
+    bool read_fixed(int width, uint64_t& bits) {
+        size_t bytes = size_t(1) << width;
+        if (input.size() - pos < bytes) return fail(ParseError::UnexpectedEnd, input.size());
+        bits = 0;
+        for (size_t idx = 0; idx < bytes; idx++)
+            bits |= uint64_t(static_cast<uint8_t>(input[pos + idx])) << (8 * idx);
+        pos += bytes;
+        return true;
+    }
+
+    bool read_bytes(uint64_t count, std::string_view& bytes) {
+        if (input.size() - pos < count) return fail(ParseError::UnexpectedEnd, input.size());
+        bytes = input.substr(pos, count);
+        pos += count;
+        return true;
+    }
+
+    // every element takes at least a byte, so no larger count can be genuine
+    bool check_count(uint64_t count) {
+        return count <= input.size() - pos || fail(ParseError::UnexpectedEnd, input.size());
+    }
+
+    bool read_value(JsonValue& result, size_t depth);
+    bool read_key(size_t& id);
+};
+
+bool Decoder::read_value(JsonValue& result, size_t depth) {
+    size_t start = pos;
+    uint8_t tag;
+    if (!read_byte(tag)) return false;
+
+    if (tag <= Tag::SMALL_UINT_MAX) {
+        result.set_value(uint64_t(tag));
+        return true;
+    }
+    if (tag >= Tag::SMALL_NEGATIVE) {
+        result.set_value(int64_t(tag - Tag::SMALL_NEGATIVE) + Tag::SMALL_NEGATIVE_MIN);
+        return true;
+    }
+    if (tag >= Tag::SHORT_STRING && tag <= Tag::SHORT_STRING + Tag::SHORT_STRING_MAX) {
+        std::string_view bytes;
+        if (!read_bytes(tag - Tag::SHORT_STRING, bytes)) return false;
+        result.set_value(JsonValue::String(bytes, result.get_allocator()));
+        return true;
+    }
+
+    uint64_t bits;
+    switch (tag) {
+        case Tag::NULL_VALUE:
+            result.set_type(JsonValue::Type::Null);
+            return true;
+        case Tag::FALSE_VALUE:
+        case Tag::TRUE_VALUE:
+            result.set_value(tag == Tag::TRUE_VALUE);
+            return true;
+        case Tag::UINT:
+        case Tag::UINT + 1:
+        case Tag::UINT + 2:
+        case Tag::UINT + 3:
+            if (!read_fixed(tag - Tag::UINT, bits)) return false;
+            result.set_value(bits);
+            return true;
+        case Tag::INT:
+        case Tag::INT + 1:
+        case Tag::INT + 2:
+        case Tag::INT + 3: {
+            int width = tag - Tag::INT;
+            if (!read_fixed(width, bits)) return false;
+            // sign extend from the width it was written in
+            int unused = 64 - (8 << width);
+            result.set_value(static_cast<int64_t>(bits << unused) >> unused);
+            return true;
+        }
+        case Tag::FLOAT:
+            if (!read_fixed(2, bits)) return false;
+            result.set_value(static_cast<double>(std::bit_cast<float>(static_cast<uint32_t>(bits))));
+            return true;
+        case Tag::DOUBLE:
+            if (!read_fixed(3, bits)) return false;
+            result.set_value(std::bit_cast<double>(bits));
+            return true;
+        case Tag::STRING: {
+            uint64_t length;
+            std::string_view bytes;
+            if (!read_varint(length) || !read_bytes(length, bytes)) return false;
+            result.set_value(JsonValue::String(bytes, result.get_allocator()));
+            return true;
+        }
+        case Tag::ARRAY:
+        case Tag::OBJECT: {
+            if (depth == 0) return fail(ParseError::TooDeep, start);
+            uint64_t count;
+            if (!read_varint(count) || !check_count(count)) return false;
+            if (tag == Tag::ARRAY) {
+                result.set_type(JsonValue::Type::Array);
+                for (uint64_t idx = 0; idx < count; idx++) {
+                    if (!read_value(result.emplace_back(), depth - 1)) return false;
+                }
+            } else {
+                result.set_type(JsonValue::Type::Object);
+                for (uint64_t idx = 0; idx < count; idx++) {
+                    size_t id;
+                    if (!read_key(id) || !read_value(result.at(keys[id]), depth - 1)) return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return fail(ParseError::InvalidEncoding, start);
+    }
+}
+
+bool Decoder::read_key(size_t& id) {
+    size_t start = pos;
+    uint64_t reference;
+    if (!read_varint(reference)) return false;
+    if ((reference & 1) == 0) {
+        if ((reference >> 1) >= keys.size()) return fail(ParseError::InvalidEncoding, start);
+        id = reference >> 1;
+        return true;
+    }
+
+    std::string_view bytes;
+    if (!read_bytes(reference >> 1, bytes)) return false;
+    id = keys.size();
+    keys.push_back(KeyPool::current().intern(bytes));
+    return true;
+}
+
+} // namespace
+
+void write_binary(const JsonValue& value, std::string& out) {
+    out.append(BINARY_MAGIC);
+    Encoder<std::nullptr_t> encoder{out, nullptr, {}};
+    encoder.write_value(value);
+}
+
+void write_binary(const JsonValue& value, std::ostream& out) {
+    std::string buffer;
+    buffer.reserve(CHUNK_SIZE * 2);
+    buffer.append(BINARY_MAGIC);
+    auto flush = [&out](std::string& chunk) {
+        out.write(chunk.data(), chunk.size());
+        chunk.clear();
+    };
+    Encoder<decltype(flush)> encoder{buffer, flush, {}};
+    encoder.write_value(value);
+    flush(buffer);
+}
+
+ParseResult read_binary(std::string_view input, std::pmr::memory_resource* resource) {
+    auto location = [](size_t offset) { return SourceLocation{offset, 1, offset + 1}; };
+    if (!input.starts_with(BINARY_MAGIC)) {
+        bool truncated = input.size() < BINARY_MAGIC.size() && BINARY_MAGIC.starts_with(input);
+        return ParseResult(truncated ? ParseError::UnexpectedEnd : ParseError::InvalidEncoding, location(0));
+    }
+
+    Decoder decoder{input, BINARY_MAGIC.size(), {}, ParseError::None, 0};
+    JsonValue result{JsonValue::allocator_type(resource)};
+    if (decoder.read_value(result, DEFAULT_MAX_DEPTH) && decoder.pos != input.size())
+        decoder.fail(ParseError::TrailingCharacters, decoder.pos);
+    if (decoder.error != ParseError::None)
+        return ParseResult(decoder.error, location(decoder.error_offset));
+    return ParseResult(std::move(result));
+}
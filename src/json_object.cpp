@@ -0,0 +1,166 @@
+#include "json_object.h"
+#include "json.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+uint32_t hash_of(std::string_view key) {
+    return static_cast<uint32_t>(std::hash<std::string_view>()(key));
+}
+
+bool key_matches(const JsonKey& member, std::string_view key, const JsonKey* handle) {
+    return (handle && member.same_handle(*handle)) || member.view() == key;
+}
+
+} // namespace
+
+JsonObject::JsonObject() = default;
+JsonObject::JsonObject(const allocator_type& alloc): members{alloc}, hashes{alloc}, index{alloc} {};
+JsonObject::JsonObject(const JsonObject& other): JsonObject(other, allocator_type()) {};
+JsonObject::JsonObject(JsonObject&& other) noexcept = default;
+JsonObject::~JsonObject() = default;
+
+// the members rebuild their values with alloc, keys are shared handles
+JsonObject::JsonObject(const JsonObject& other, const allocator_type& alloc)
+    : members{other.members, alloc}, hashes{other.hashes, alloc}, index{other.index, alloc} {};
+
+JsonObject::JsonObject(JsonObject&& other, const allocator_type& alloc)
+    : members{std::move(other.members), alloc}, hashes{std::move(other.hashes), alloc}, index{std::move(other.index), alloc} {};
+
+JsonObject& JsonObject::operator=(const JsonObject& other) = default;
+JsonObject& JsonObject::operator=(JsonObject&& other) = default;
+
+JsonObject::allocator_type JsonObject::get_allocator() const {
+    return members.get_allocator();
+}
+
+size_t JsonObject::size() const {
+    return members.size();
+}
+
+bool JsonObject::empty() const {
+    return members.empty();
+}
+
+JsonObject::iterator JsonObject::begin() {
+    return members.data();
+}
+
+JsonObject::iterator JsonObject::end() {
+    return members.data() + members.size();
+}
+
+JsonObject::const_iterator JsonObject::begin() const {
+    return members.data();
+}
+
+JsonObject::const_iterator JsonObject::end() const {
+    return members.data() + members.size();
+}
+
+JsonObject::iterator JsonObject::find(std::string_view key) {
+    return begin() + locate(key, hash_of(key), nullptr);
+}
+
+JsonObject::const_iterator JsonObject::find(std::string_view key) const {
+    return begin() + locate(key, hash_of(key), nullptr);
+}
+
+JsonObject::iterator JsonObject::find(const JsonKey& key) {
+    return begin() + locate(key.view(), static_cast<uint32_t>(key.hash()), &key);
+}
+
+JsonObject::const_iterator JsonObject::find(const JsonKey& key) const {
+    return begin() + locate(key.view(), static_cast<uint32_t>(key.hash()), &key);
+}
+
+bool JsonObject::contains(std::string_view key) const {
+    return find(key) != end();
+}
+
+std::pair<JsonObject::iterator, bool> JsonObject::try_emplace(const JsonKey& key) {
+    iterator it = find(key);
+    if (it != end())
+        return {it, false};
+    // the vector hands its resource to the new value
+    members.emplace_back(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple());
+    hashes.push_back(static_cast<uint32_t>(key.hash()));
+    index_last();
+    return {end() - 1, true};
+}
+
+JsonObject::iterator JsonObject::append(const JsonKey& key, JsonValue&& value) {
+    members.emplace_back(key, std::move(value));
+    hashes.push_back(static_cast<uint32_t>(key.hash()));
+    index_last();
+    return end() - 1;
+}
+
+void JsonObject::reserve(size_t capacity) {
+    members.reserve(capacity);
+    hashes.reserve(capacity);
+}
+
+size_t JsonObject::locate(std::string_view key, uint32_t hash, const JsonKey* handle) const {
+    const size_t count = members.size();
+
+    if (!index.empty()) {
+        const size_t mask = index.size() - 1;
+        for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+            uint32_t entry = index[slot];
+            if (entry == 0) return count;
+            size_t position = entry - 1;
+            if (hashes[position] == hash && key_matches(members[position].first, key, handle))
+                return position;
+        }
+    }
+
+    size_t idx = 0;
+#if defined(__SSE2__)
+    // four hashes per compare, then check the candidates
+    const __m128i needle = _mm_set1_epi32(static_cast<int>(hash));
+    for (; idx + 4 <= count; idx += 4) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hashes.data() + idx));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(chunk, needle)));
+        while (mask != 0) {
+            size_t position = idx + __builtin_ctz(mask);
+            if (key_matches(members[position].first, key, handle))
+                return position;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; idx < count; idx++) {
+        if (hashes[idx] == hash && key_matches(members[idx].first, key, handle))
+            return idx;
+    }
+    return count;
+}
+
+void JsonObject::index_last() {
+    const size_t count = members.size();
+    if (count <= LINEAR_LIMIT)
+        return;
+    if (count * 2 > index.size()) {
+        rebuild_index(index.empty() ? 4 * LINEAR_LIMIT : index.size() * 2);
+        return;
+    }
+
+    const size_t mask = index.size() - 1;
+    size_t slot = hashes.back() & mask;
+    while (index[slot] != 0) slot = (slot + 1) & mask;
+    index[slot] = static_cast<uint32_t>(count);
+}
+
+void JsonObject::rebuild_index(size_t slots) {
+    index.assign(slots, 0);
+    const size_t mask = slots - 1;
+    for (size_t position = 0; position < hashes.size(); position++) {
+        size_t slot = hashes[position] & mask;
+        while (index[slot] != 0) slot = (slot + 1) & mask;
+        index[slot] = static_cast<uint32_t>(position + 1);
+    }
+}
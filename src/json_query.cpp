@@ -0,0 +1,362 @@
+#include "json_query.h"
+#include "lazy_value.h"
+#include "parser.h"
+
+#include <charconv>
+#include <stdexcept>
+
+namespace {
+
+[[noreturn]] void throw_syntax_error(std::string_view query, size_t position, const char* problem) {
+    throw std::invalid_argument(std::string(problem) + " at position " + std::to_string(position) + " of \"" +
+                                std::string(query) + "\"");
+}
+
+// RFC 6901 array index: 0 or digits without a leading zero
+std::optional<size_t> parse_index(std::string_view token) {
+    if (token.empty() || (token.size() > 1 && token[0] == '0'))
+        return std::nullopt;
+    size_t index;
+    auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), index);
+    if (ec != std::errc() || end != token.data() + token.size())
+        return std::nullopt;
+    return index;
+}
+
+QueryStep child_step(std::optional<std::string> key, std::optional<size_t> index) {
+    QueryStep step;
+    step.key = std::move(key);
+    step.index = index;
+    return step;
+}
+
+// Recursive descent over the path text. Every parse_* function starts at pos
+// and leaves it just past what it consumed.
+struct PathCompiler {
+    std::string_view path;
+    size_t pos = 0;
+
+    bool done() const {
+        return pos == path.size();
+    }
+
+    char peek() const {
+        return done() ? '\0' : path[pos];
+    }
+
+    void expect(char c) {
+        if (peek() != c) {
+            std::string problem = std::string("expected '") + c + "'";
+            throw_syntax_error(path, pos, problem.c_str());
+        }
+        pos++;
+    }
+
+    void skip_spaces() {
+        while (peek() == ' ') pos++;
+    }
+
+    // a member name after '.', up to the next '.', '[' or space
+    std::string parse_name() {
+        size_t start = pos;
+        while (!done() && peek() != '.' && peek() != '[' && peek() != ' ' && peek() != ']' && peek() != '=' && peek() != '!' && peek() != ')')
+            pos++;
+        if (pos == start)
+            throw_syntax_error(path, pos, "expected a member name");
+        return std::string(path.substr(start, pos - start));
+    }
+
+    // 'name' or "name", backslash escapes the next character
+    std::string parse_quoted() {
+        char quote = peek();
+        pos++;
+        std::string result;
+        while (!done() && peek() != quote) {
+            if (peek() == '\\') pos++;
+            if (done()) break;
+            result += path[pos++];
+        }
+        expect(quote);
+        return result;
+    }
+
+    JsonValue parse_literal() {
+        if (peek() == '\'') {
+            std::string text = parse_quoted();
+            return JsonValue(text);
+        }
+        SpanReader reader(path.substr(pos));
+        JsonValue literal;
+        ParseError error = parse_value(reader, literal);
+        if (error != ParseError::None || literal.type() == JsonValue::Type::Object || literal.type() == JsonValue::Type::Array)
+            throw_syntax_error(path, pos, "expected a string, number, true, false or null");
+        pos += reader.offset();
+        return literal;
+    }
+
+    QueryStep parse_filter() {
+        // "[?(" has been consumed
+        QueryStep step;
+        step.kind = QueryStep::Kind::Filter;
+        skip_spaces();
+        expect('@');
+        while (peek() == '.' || peek() == '[') {
+            if (peek() == '.') {
+                pos++;
+                step.operand.push_back(child_step(parse_name(), std::nullopt));
+            } else {
+                step.operand.push_back(parse_bracket_child());
+            }
+        }
+        skip_spaces();
+        if (path.substr(pos, 2) == "==") {
+            step.negate = false;
+        } else if (path.substr(pos, 2) == "!=") {
+            step.negate = true;
+        } else throw_syntax_error(path, pos, "expected == or !=");
+        pos += 2;
+        skip_spaces();
+        step.literal = parse_literal();
+        skip_spaces();
+        expect(')');
+        return step;
+    }
+
+    // ['name'] or [n], starting at '['
+    QueryStep parse_bracket_child() {
+        expect('[');
+        skip_spaces();
+        QueryStep step;
+        if (peek() == '\'' || peek() == '"') {
+            step = child_step(parse_quoted(), std::nullopt);
+        } else {
+            size_t start = pos;
+            while (is_digit(peek())) pos++;
+            std::optional<size_t> index = parse_index(path.substr(start, pos - start));
+            if (!index.has_value())
+                throw_syntax_error(path, start, "expected a quoted name or an index");
+            step = child_step(std::nullopt, index);
+        }
+        skip_spaces();
+        expect(']');
+        return step;
+    }
+
+    std::vector<QueryStep> compile() {
+        std::vector<QueryStep> steps;
+        expect('$');
+        while (!done()) {
+            if (peek() == '.') {
+                pos++;
+                if (peek() == '.')
+                    throw_syntax_error(path, pos, "recursive descent is not supported");
+                if (peek() == '*') {
+                    pos++;
+                    QueryStep step;
+                    step.kind = QueryStep::Kind::Wildcard;
+                    steps.push_back(step);
+                } else {
+                    steps.push_back(child_step(parse_name(), std::nullopt));
+                }
+            } else if (peek() == '[') {
+                if (path.substr(pos, 3) == "[*]") {
+                    pos += 3;
+                    QueryStep step;
+                    step.kind = QueryStep::Kind::Wildcard;
+                    steps.push_back(step);
+                } else if (path.substr(pos, 3) == "[?(") {
+                    pos += 3;
+                    steps.push_back(parse_filter());
+                    expect(']');
+                } else {
+                    steps.push_back(parse_bracket_child());
+                }
+            } else throw_syntax_error(path, pos, "expected '.' or '['");
+        }
+        return steps;
+    }
+};
+
+bool numbers_equal(const JsonValue& lhs, const JsonValue& rhs) {
+    using NumberType = JsonValue::NumberType;
+    NumberType lhs_type = lhs.number_type();
+    NumberType rhs_type = rhs.number_type();
+    if (lhs_type == NumberType::Double || rhs_type == NumberType::Double)
+        return lhs.as_double() == rhs.as_double();
+    // integers are compared exactly, a negative one never equals a uint64
+    if (lhs_type == NumberType::Int64 && lhs.as_int64() < 0)
+        return rhs_type == NumberType::Int64 && rhs.as_int64() == lhs.as_int64();
+    if (rhs_type == NumberType::Int64 && rhs.as_int64() < 0)
+        return false;
+    return lhs.as_uint64() == rhs.as_uint64();
+}
+
+bool scalar_equals(const JsonValue& value, const JsonValue& literal) {
+    if (value.type() != literal.type())
+        return false;
+    switch (value.type()) {
+        case JsonValue::Type::Null: return true;
+        case JsonValue::Type::Boolean: return value.as_boolean() == literal.as_boolean();
+        case JsonValue::Type::Number: return numbers_equal(value, literal);
+        case JsonValue::Type::String: return value.as_string() == literal.as_string();
+        default: return false;
+    }
+}
+
+// The two kinds of document the steps run over. Each provides child lookup,
+// iteration over children and the comparison a filter needs.
+
+std::optional<const JsonValue*> child_of(const JsonValue* node, const QueryStep& step) {
+    if (step.key.has_value() && node->type() == JsonValue::Type::Object) {
+        const JsonValue::Object& object = node->as_object();
+        auto it = object.find(std::string_view(*step.key));
+        if (it != object.end()) return &it->second;
+    } else if (step.index.has_value() && node->type() == JsonValue::Type::Array) {
+        const JsonValue::Array& array = node->as_array();
+        if (*step.index < array.size()) return &array[*step.index];
+    }
+    return std::nullopt;
+}
+
+template <typename Visit>
+void for_each_child(const JsonValue* node, Visit&& visit) {
+    if (node->type() == JsonValue::Type::Object) {
+        for (const auto& [key, member]: node->as_object()) visit(&member);
+    } else if (node->type() == JsonValue::Type::Array) {
+        for (const auto& element: node->as_array()) visit(&element);
+    }
+}
+
+bool equals_literal(const JsonValue* node, const JsonValue& literal) {
+    return scalar_equals(*node, literal);
+}
+
+std::optional<LazyValue> child_of(const LazyValue& node, const QueryStep& step) {
+    if (step.key.has_value() && node.type() == JsonValue::Type::Object)
+        return node.find(*step.key);
+    if (step.index.has_value() && node.type() == JsonValue::Type::Array && *step.index <= size_t(INT32_MAX))
+        return node.find(static_cast<int>(*step.index));
+    return std::nullopt;
+}
+
+template <typename Visit>
+void for_each_child(const LazyValue& node, Visit&& visit) {
+    node.for_each(visit);
+}
+
+bool equals_literal(const LazyValue& node, const JsonValue& literal) {
+    // only scalars can be equal, those are cheap to build
+    JsonValue::Type type = node.type();
+    if (type == JsonValue::Type::Object || type == JsonValue::Type::Array)
+        return false;
+    return scalar_equals(node.materialize(), literal);
+}
+
+template <typename Node>
+bool filter_holds(const Node& node, const QueryStep& filter) {
+    std::optional<Node> operand = node;
+    for (const QueryStep& step: filter.operand) {
+        operand = child_of(*operand, step);
+        if (!operand.has_value()) return filter.negate;
+    }
+    return equals_literal(*operand, filter.literal) != filter.negate;
+}
+
+// depth first, so matches come out in document order
+template <typename Node, typename Emit>
+void run_steps(const std::vector<QueryStep>& steps, size_t idx, const Node& node, Emit& emit) {
+    if (idx == steps.size()) {
+        emit(node);
+        return;
+    }
+
+    const QueryStep& step = steps[idx];
+    switch (step.kind) {
+        case QueryStep::Kind::Child: {
+            std::optional<Node> child = child_of(node, step);
+            if (child.has_value()) run_steps(steps, idx + 1, *child, emit);
+            break;
+        }
+        case QueryStep::Kind::Wildcard:
+            for_each_child(node, [&](const Node& child) { run_steps(steps, idx + 1, child, emit); });
+            break;
+        case QueryStep::Kind::Filter:
+            for_each_child(node, [&](const Node& child) {
+                if (filter_holds(child, step)) run_steps(steps, idx + 1, child, emit);
+            });
+            break;
+    }
+}
+
+} // namespace
+
+JsonQuery::JsonQuery(std::vector<QueryStep> _steps): query_steps{std::move(_steps)} {};
+
+std::vector<const JsonValue*> JsonQuery::evaluate(const JsonValue& root) const {
+    std::vector<const JsonValue*> matches;
+    auto emit = [&](const JsonValue* match) { matches.push_back(match); };
+    run_steps(query_steps, 0, &root, emit);
+    return matches;
+}
+
+const JsonValue* JsonQuery::first(const JsonValue& root) const {
+    // plain member and element chains need no search
+    const JsonValue* node = &root;
+    for (const QueryStep& step: query_steps) {
+        if (step.kind != QueryStep::Kind::Child) {
+            std::vector<const JsonValue*> matches = evaluate(root);
+            return matches.empty() ? nullptr : matches.front();
+        }
+        std::optional<const JsonValue*> child = child_of(node, step);
+        if (!child.has_value()) return nullptr;
+        node = *child;
+    }
+    return node;
+}
+
+std::vector<JsonValue> JsonQuery::evaluate(std::string_view input, const JsonValue::allocator_type& alloc) const {
+    std::vector<JsonValue> matches;
+    auto emit = [&](const LazyValue& match) { matches.push_back(match.materialize(alloc)); };
+    run_steps(query_steps, 0, parse_lazy(input), emit);
+    return matches;
+}
+
+const std::vector<QueryStep>& JsonQuery::steps() const {
+    return query_steps;
+}
+
+JsonQuery compile_json_pointer(std::string_view pointer) {
+    std::vector<QueryStep> steps;
+    if (pointer.empty())
+        return JsonQuery(std::move(steps));
+    if (pointer[0] != '/')
+        throw_syntax_error(pointer, 0, "expected '/'");
+
+    size_t pos = 1;
+    while (true) {
+        size_t end = pointer.find('/', pos);
+        if (end == std::string_view::npos) end = pointer.size();
+
+        // ~1 is '/' and ~0 is '~', in that order
+        std::string token;
+        for (size_t idx = pos; idx < end; idx++) {
+            if (pointer[idx] != '~') {
+                token += pointer[idx];
+                continue;
+            }
+            if (idx + 1 == end || (pointer[idx + 1] != '0' && pointer[idx + 1] != '1'))
+                throw_syntax_error(pointer, idx, "expected ~0 or ~1");
+            token += pointer[++idx] == '0' ? '~' : '/';
+        }
+
+        std::optional<size_t> index = parse_index(token);
+        steps.push_back(child_step(std::move(token), index));
+        if (end == pointer.size()) break;
+        pos = end + 1;
+    }
+    return JsonQuery(std::move(steps));
+}
+
+JsonQuery compile_json_path(std::string_view path) {
+    return JsonQuery(PathCompiler{path}.compile());
+}
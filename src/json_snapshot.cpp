@@ -0,0 +1,450 @@
+#include "json_snapshot.h"
+#include "parser.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+// size and modification time of a source file
+struct SourceInfo {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+};
+
+std::optional<SourceInfo> source_info(const std::string& path) {
+    if (path.empty())
+        return SourceInfo();
+    std::error_code error;
+    SourceInfo info;
+    info.size = std::filesystem::file_size(path, error);
+    if (error)
+        return std::nullopt;
+    info.mtime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+    if (error)
+        return std::nullopt;
+    return info;
+}
+
+// Lays the snapshot out in two buffers, the header and tables in one and the
+// string area in the other. Containers get their block of entries when they
+// are reached, and the entries are filled in as the values under them are, so
+// offsets never have to be patched and nothing recurses.
+struct Builder {
+    explicit Builder(const SourceInfo& _source): source{_source} {};
+
+    void build(const JsonValue& root) {
+        tables.assign(sizeof(SnapshotHeader), '\0');
+        pending.push_back(Pending{&root, offsetof(SnapshotHeader, root), 0});
+        while (!pending.empty()) {
+            Pending next = pending.back();
+            pending.pop_back();
+            SnapshotNode node = encode(*next.value, next.depth);
+            std::memcpy(tables.data() + next.at, &node, sizeof(node));
+        }
+
+        SnapshotHeader header{};
+        std::memcpy(header.magic, SNAPSHOT_MAGIC.data(), sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.byte_order = BYTE_ORDER_MARK;
+        header.strings_offset = tables.size();
+        header.file_size = tables.size() + strings.size();
+        header.source_size = source.size;
+        header.source_mtime = source.mtime;
+        std::memcpy(&header.root, tables.data() + offsetof(SnapshotHeader, root), sizeof(header.root));
+        std::memcpy(tables.data(), &header, sizeof(header));
+    }
+
+    SourceInfo source;
+    std::string tables;
+    std::string strings;
+
+private:
+    // a value with depth containers above it
+    SnapshotNode encode(const JsonValue& value, size_t depth) {
+        SnapshotNode node{};
+        if ((value.type() == JsonValue::Type::Array || value.type() == JsonValue::Type::Object) &&
+            depth >= DEFAULT_MAX_DEPTH)
+            throw std::length_error("Value nested too deep for a snapshot");
+        switch (value.type()) {
+            case JsonValue::Type::Null:
+                node.tag = SnapshotNode::Tag::Null;
+                break;
+            case JsonValue::Type::Boolean:
+                node.tag = value.as_boolean() ? SnapshotNode::Tag::True : SnapshotNode::Tag::False;
+                break;
+            case JsonValue::Type::Number:
+                switch (value.number_type()) {
+                    case JsonValue::NumberType::Int64:
+                        node.tag = SnapshotNode::Tag::Int64;
+                        node.payload = std::bit_cast<uint64_t>(value.as_int64());
+                        break;
+                    case JsonValue::NumberType::UInt64:
+                        node.tag = SnapshotNode::Tag::UInt64;
+                        node.payload = value.as_uint64();
+                        break;
+                    default:
+                        node.tag = SnapshotNode::Tag::Double;
+                        node.payload = std::bit_cast<uint64_t>(value.as_double());
+                }
+                break;
+            case JsonValue::Type::String:
+                node.tag = SnapshotNode::Tag::String;
+                node.count = checked_count(value.as_string().size());
+                node.payload = strings.size();
+                strings.append(value.as_string());
+                break;
+            case JsonValue::Type::Array: {
+                const JsonValue::Array& array = value.as_array();
+                node.tag = SnapshotNode::Tag::Array;
+                node.count = checked_count(array.size());
+                node.payload = tables.size();
+                tables.resize(tables.size() + array.size() * sizeof(SnapshotNode));
+                for (size_t idx = 0; idx < array.size(); idx++)
+                    pending.push_back(Pending{&array[idx], node.payload + idx * sizeof(SnapshotNode), depth + 1});
+                break;
+            }
+            case JsonValue::Type::Object: {
+                node.tag = SnapshotNode::Tag::Object;
+                node.count = checked_count(value.as_object().size());
+                node.payload = tables.size();
+                tables.resize(tables.size() + value.as_object().size() * sizeof(SnapshotMember));
+
+                std::vector<const JsonValue::Object::value_type*> members;
+                members.reserve(value.as_object().size());
+                for (const auto& member: value.as_object()) members.push_back(&member);
+                std::sort(members.begin(), members.end(), [](auto* lhs, auto* rhs) {
+                    return lhs->first.view() < rhs->first.view();
+                });
+
+                size_t at = node.payload;
+                for (const auto* member: members) {
+                    SnapshotMember entry{};
+                    entry.key_length = static_cast<uint32_t>(member->first.view().size());
+                    entry.key_offset = key_offset(member->first);
+                    std::memcpy(tables.data() + at, &entry, sizeof(entry));
+                    pending.push_back(Pending{&member->second, at + offsetof(SnapshotMember, value), depth + 1});
+                    at += sizeof(SnapshotMember);
+                }
+                break;
+            }
+        }
+        return node;
+    }
+
+    // interned keys share their characters, so one copy per distinct pointer
+    uint64_t key_offset(const JsonKey& key) {
+        auto [it, added] = keys.try_emplace(key.view().data(), strings.size());
+        if (added) {
+            checked_count(key.view().size());
+            strings.append(key.view());
+        }
+        return it->second;
+    }
+
+    static uint32_t checked_count(size_t count) {
+        if (count > UINT32_MAX)
+            throw std::length_error("String or container too large for a snapshot");
+        return static_cast<uint32_t>(count);
+    }
+
+    // a value still to encode, with the offset of the node it goes into
+    struct Pending {
+        const JsonValue* value;
+        size_t at;
+        size_t depth;
+    };
+    std::vector<Pending> pending;
+    std::unordered_map<const char*, uint64_t> keys;
+};
+
+bool write_snapshot_file(const JsonValue& value, const std::string& path, const SourceInfo& source) {
+    Builder builder(source);
+    builder.build(value);
+
+    // unique per process, so concurrent rebuilds do not write into each other
+    std::string temporary = path + ".tmp." + std::to_string(::getpid());
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(builder.tables.data(), builder.tables.size());
+        file.write(builder.strings.data(), builder.strings.size());
+        file.close();
+        if (!file) {
+            std::filesystem::remove(temporary);
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+void damaged() {
+    throw std::runtime_error("Damaged snapshot");
+}
+
+} // namespace
+
+SnapshotView::SnapshotView(std::string_view _tables, std::string_view _strings, const SnapshotNode& _node)
+    : tables{_tables}, strings{_strings}, node{_node} {};
+
+JsonValue::Type SnapshotView::type() const {
+    switch (node.tag) {
+        case SnapshotNode::Tag::Null: return JsonValue::Type::Null;
+        case SnapshotNode::Tag::False:
+        case SnapshotNode::Tag::True: return JsonValue::Type::Boolean;
+        case SnapshotNode::Tag::Double:
+        case SnapshotNode::Tag::Int64:
+        case SnapshotNode::Tag::UInt64: return JsonValue::Type::Number;
+        case SnapshotNode::Tag::String: return JsonValue::Type::String;
+        case SnapshotNode::Tag::Array: return JsonValue::Type::Array;
+        case SnapshotNode::Tag::Object: return JsonValue::Type::Object;
+    }
+    damaged();
+    return JsonValue::Type::Null;
+}
+
+JsonValue::NumberType SnapshotView::number_type() const {
+    verify_type(JsonValue::Type::Number);
+    switch (node.tag) {
+        case SnapshotNode::Tag::Int64: return JsonValue::NumberType::Int64;
+        case SnapshotNode::Tag::UInt64: return JsonValue::NumberType::UInt64;
+        default: return JsonValue::NumberType::Double;
+    }
+}
+
+bool SnapshotView::as_boolean() const {
+    verify_type(JsonValue::Type::Boolean);
+    return node.tag == SnapshotNode::Tag::True;
+}
+
+double SnapshotView::as_double() const {
+    switch (number_type()) {
+        case JsonValue::NumberType::Int64: return static_cast<double>(std::bit_cast<int64_t>(node.payload));
+        case JsonValue::NumberType::UInt64: return static_cast<double>(node.payload);
+        default: return std::bit_cast<double>(node.payload);
+    }
+}
+
+int64_t SnapshotView::as_int64() const {
+    switch (number_type()) {
+        case JsonValue::NumberType::Int64: return std::bit_cast<int64_t>(node.payload);
+        case JsonValue::NumberType::UInt64:
+            if (node.payload <= uint64_t(INT64_MAX)) return static_cast<int64_t>(node.payload);
+            break;
+        default:
+            break;
+    }
+    throw std::out_of_range("Number is not an int64");
+}
+
+uint64_t SnapshotView::as_uint64() const {
+    switch (number_type()) {
+        case JsonValue::NumberType::UInt64: return node.payload;
+        case JsonValue::NumberType::Int64:
+            if (std::bit_cast<int64_t>(node.payload) >= 0) return node.payload;
+            break;
+        default:
+            break;
+    }
+    throw std::out_of_range("Number is not a uint64");
+}
+
+std::string_view SnapshotView::as_string() const {
+    verify_type(JsonValue::Type::String);
+    return string(node.payload, node.count);
+}
+
+SnapshotView SnapshotView::at(std::string_view index) const {
+    verify_type(JsonValue::Type::Object);
+    std::optional<SnapshotView> member = find(index);
+    if (!member.has_value())
+        throw std::out_of_range("Key not found");
+    return *member;
+}
+
+SnapshotView SnapshotView::at(int index) const {
+    verify_type(JsonValue::Type::Array);
+    if (index < 0 || static_cast<size_t>(index) >= node.count)
+        throw std::runtime_error("Index out of bounds");
+    SnapshotNode element;
+    std::memcpy(&element, entries(sizeof(SnapshotNode)) + index * sizeof(SnapshotNode), sizeof(element));
+    return at_node(element);
+}
+
+bool SnapshotView::exists(std::string_view index) const {
+    return type() == JsonValue::Type::Object && find(index).has_value();
+}
+
+bool SnapshotView::exists(const int index) const {
+    return type() == JsonValue::Type::Array && index >= 0 && static_cast<size_t>(index) < node.count;
+}
+
+size_t SnapshotView::size() const {
+    if (type() != JsonValue::Type::Object && type() != JsonValue::Type::Array)
+        throw std::runtime_error("Invalid method type, size() requires an object or array");
+    return node.count;
+}
+
+std::string_view SnapshotView::key_at(size_t index) const {
+    verify_type(JsonValue::Type::Object);
+    if (index >= node.count)
+        throw std::runtime_error("Index out of bounds");
+    SnapshotMember entry = member(index);
+    return string(entry.key_offset, entry.key_length);
+}
+
+SnapshotView SnapshotView::value_at(size_t index) const {
+    verify_type(JsonValue::Type::Object);
+    if (index >= node.count)
+        throw std::runtime_error("Index out of bounds");
+    return at_node(member(index).value);
+}
+
+JsonValue SnapshotView::materialize(const JsonValue::allocator_type& alloc) const {
+    switch (type()) {
+        case JsonValue::Type::Null: return JsonValue(nullptr, alloc);
+        case JsonValue::Type::Boolean: return JsonValue(as_boolean(), alloc);
+        case JsonValue::Type::String: return JsonValue(as_string(), alloc);
+        case JsonValue::Type::Number:
+            switch (number_type()) {
+                case JsonValue::NumberType::Int64: return JsonValue(as_int64(), alloc);
+                case JsonValue::NumberType::UInt64: return JsonValue(as_uint64(), alloc);
+                default: return JsonValue(as_double(), alloc);
+            }
+        case JsonValue::Type::Object: {
+            JsonValue result(JsonValue::Type::Object, alloc);
+            for (size_t idx = 0; idx < node.count; idx++)
+                result.set_index(key_at(idx), value_at(idx).materialize(alloc));
+            return result;
+        }
+        case JsonValue::Type::Array: {
+            JsonValue result(JsonValue::Type::Array, alloc);
+            for (size_t idx = 0; idx < node.count; idx++)
+                result.push_back(at(static_cast<int>(idx)).materialize(alloc));
+            return result;
+        }
+    }
+    return JsonValue(nullptr, alloc);
+}
+
+std::optional<SnapshotView> SnapshotView::find(std::string_view index) const {
+    // lower bound over the sorted keys
+    size_t low = 0, high = node.count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        SnapshotMember entry = member(middle);
+        if (string(entry.key_offset, entry.key_length) < index) low = middle + 1;
+        else high = middle;
+    }
+    if (low == node.count)
+        return std::nullopt;
+    SnapshotMember entry = member(low);
+    if (string(entry.key_offset, entry.key_length) != index)
+        return std::nullopt;
+    return at_node(entry.value);
+}
+
+SnapshotView SnapshotView::at_node(const SnapshotNode& other) const {
+    // only a snapshot whose containers lead back to themselves gets here, a
+    // written one never nests deeper
+    if (depth >= DEFAULT_MAX_DEPTH)
+        damaged();
+    SnapshotView child(tables, strings, other);
+    child.depth = depth + 1;
+    return child;
+}
+
+SnapshotMember SnapshotView::member(size_t index) const {
+    SnapshotMember entry;
+    std::memcpy(&entry, entries(sizeof(SnapshotMember)) + index * sizeof(SnapshotMember), sizeof(entry));
+    return entry;
+}
+
+const char* SnapshotView::entries(size_t size) const {
+    if (node.payload > tables.size() || node.count > (tables.size() - node.payload) / size)
+        damaged();
+    return tables.data() + node.payload;
+}
+
+std::string_view SnapshotView::string(uint64_t offset, uint32_t length) const {
+    if (offset > strings.size() || length > strings.size() - offset)
+        damaged();
+    return strings.substr(offset, length);
+}
+
+void SnapshotView::verify_type(JsonValue::Type expected) const {
+    if (type() != expected) {
+        std::stringstream ss;
+        ss << "Invalid method type, requested " << JsonValue::TypeNames[static_cast<int>(expected)] << ", but SnapshotView is of type " << JsonValue::TypeNames[static_cast<int>(type())];
+        throw std::runtime_error(ss.str());
+    }
+}
+
+Snapshot::Snapshot(MappedFile&& _file): file{std::move(_file)} {
+    std::memcpy(&head, file.view().data(), sizeof(head));
+}
+
+SnapshotView Snapshot::root() const {
+    std::string_view data = file.view();
+    return SnapshotView(data.substr(0, head.strings_offset), data.substr(head.strings_offset), head.root);
+}
+
+const SnapshotHeader& Snapshot::header() const {
+    return head;
+}
+
+bool write_snapshot(const JsonValue& value, const std::string& path, const std::string& source_path) {
+    std::optional<SourceInfo> source = source_info(source_path);
+    return source.has_value() && write_snapshot_file(value, path, *source);
+}
+
+std::optional<Snapshot> open_snapshot(const std::string& path, const std::string& source_path) {
+    MappedFile file(path, MappedFile::Access::Random);
+    if (!file || file.size() < sizeof(SnapshotHeader))
+        return std::nullopt;
+
+    SnapshotHeader header;
+    std::memcpy(&header, file.view().data(), sizeof(header));
+    if (std::string_view(header.magic, sizeof(header.magic)) != SNAPSHOT_MAGIC ||
+        header.version != SNAPSHOT_VERSION || header.byte_order != BYTE_ORDER_MARK ||
+        header.file_size != file.size() || header.strings_offset < sizeof(SnapshotHeader) ||
+        header.strings_offset > file.size())
+        return std::nullopt;
+
+    if (!source_path.empty()) {
+        std::optional<SourceInfo> source = source_info(source_path);
+        if (!source.has_value() || source->size != header.source_size || source->mtime != header.source_mtime)
+            return std::nullopt;
+    }
+    return Snapshot(std::move(file));
+}
+
+std::optional<Snapshot> load_snapshot(const std::string& source_path, const std::string& snapshot_path) {
+    if (auto snapshot = open_snapshot(snapshot_path, source_path))
+        return snapshot;
+
+    // taken before parsing, a source changed meanwhile then leaves the new
+    // snapshot stale instead of passing for current
+    std::optional<SourceInfo> source = source_info(source_path);
+    if (!source.has_value())
+        return std::nullopt;
+    ParseResult document = parse_file(source_path);
+    if (!document.has_value() || !write_snapshot_file(*document, snapshot_path, *source))
+        return std::nullopt;
+    return open_snapshot(snapshot_path);
+}
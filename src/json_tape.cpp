@@ -0,0 +1,258 @@
+#include "json_tape.h"
+#include <bit>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+void JsonTape::append_word(Tag tag, uint64_t payload) {
+    words.push_back((static_cast<uint64_t>(tag) << TAG_SHIFT) | (payload & PAYLOAD_MASK));
+}
+
+JsonView JsonTape::root() const {
+    if (words.empty())
+        throw std::runtime_error("Empty tape");
+    return JsonView(this, 0);
+}
+
+void JsonTape::append_literal(Tag tag) {
+    append_word(tag, 0);
+}
+
+void JsonTape::append_number(double number) {
+    append_word(Tag::Number, 0);
+    words.push_back(std::bit_cast<uint64_t>(number));
+}
+
+void JsonTape::append_number(int64_t number) {
+    append_word(Tag::Int64, 0);
+    words.push_back(std::bit_cast<uint64_t>(number));
+}
+
+void JsonTape::append_number(uint64_t number) {
+    append_word(Tag::UInt64, 0);
+    words.push_back(number);
+}
+
+void JsonTape::append_string(std::string_view str) {
+    append_word(Tag::String, strings.size());
+    uint32_t length = static_cast<uint32_t>(str.size());
+    strings.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    strings.append(str);
+}
+
+size_t JsonTape::start_container(Tag tag) {
+    size_t start = words.size();
+    append_word(tag, 0);
+    return start;
+}
+
+void JsonTape::end_container(size_t start, uint64_t count) {
+    Tag end_tag = tag_of(words[start]) == Tag::ObjectStart ? Tag::ObjectEnd : Tag::ArrayEnd;
+    append_word(end_tag, start);
+    uint64_t skip = words.size();
+    if (count > MAX_COUNT) count = MAX_COUNT;
+    words[start] |= (count << 32) | (skip & SKIP_MASK);
+}
+
+JsonView::JsonView(const JsonTape* _tape, size_t _index): tape{_tape}, index{_index} {};
+
+JsonTape::Tag JsonView::tag() const {
+    return JsonTape::tag_of(word());
+}
+
+uint64_t JsonView::word() const {
+    return tape->words[index];
+}
+
+size_t JsonView::next() const {
+    switch (tag()) {
+        case JsonTape::Tag::Number:
+        case JsonTape::Tag::Int64:
+        case JsonTape::Tag::UInt64: return index + 2;
+        case JsonTape::Tag::ObjectStart:
+        case JsonTape::Tag::ArrayStart: return JsonTape::payload_of(word()) & JsonTape::SKIP_MASK;
+        default: return index + 1;
+    }
+}
+
+JsonValue::Type JsonView::type() const {
+    switch (tag()) {
+        case JsonTape::Tag::Null: return JsonValue::Type::Null;
+        case JsonTape::Tag::True:
+        case JsonTape::Tag::False: return JsonValue::Type::Boolean;
+        case JsonTape::Tag::Number:
+        case JsonTape::Tag::Int64:
+        case JsonTape::Tag::UInt64: return JsonValue::Type::Number;
+        case JsonTape::Tag::String: return JsonValue::Type::String;
+        case JsonTape::Tag::ObjectStart: return JsonValue::Type::Object;
+        case JsonTape::Tag::ArrayStart: return JsonValue::Type::Array;
+        default: throw std::runtime_error("Invalid tape position");
+    }
+}
+
+bool JsonView::as_boolean() const {
+    verify_type(JsonValue::Type::Boolean);
+    return tag() == JsonTape::Tag::True;
+}
+
+JsonValue::NumberType JsonView::number_type() const {
+    verify_type(JsonValue::Type::Number);
+    switch (tag()) {
+        case JsonTape::Tag::Int64: return JsonValue::NumberType::Int64;
+        case JsonTape::Tag::UInt64: return JsonValue::NumberType::UInt64;
+        default: return JsonValue::NumberType::Double;
+    }
+}
+
+double JsonView::as_double() const {
+    uint64_t bits = tape->words[index + 1];
+    switch (number_type()) {
+        case JsonValue::NumberType::Int64: return static_cast<double>(std::bit_cast<int64_t>(bits));
+        case JsonValue::NumberType::UInt64: return static_cast<double>(bits);
+        default: return std::bit_cast<double>(bits);
+    }
+}
+
+int64_t JsonView::as_int64() const {
+    uint64_t bits = tape->words[index + 1];
+    switch (number_type()) {
+        case JsonValue::NumberType::Int64: return std::bit_cast<int64_t>(bits);
+        case JsonValue::NumberType::UInt64:
+            if (bits <= uint64_t(INT64_MAX)) return static_cast<int64_t>(bits);
+            break;
+        default:
+            break;
+    }
+    throw std::out_of_range("Number is not an int64");
+}
+
+uint64_t JsonView::as_uint64() const {
+    uint64_t bits = tape->words[index + 1];
+    switch (number_type()) {
+        case JsonValue::NumberType::UInt64: return bits;
+        case JsonValue::NumberType::Int64:
+            if (std::bit_cast<int64_t>(bits) >= 0) return bits;
+            break;
+        default:
+            break;
+    }
+    throw std::out_of_range("Number is not a uint64");
+}
+
+std::string_view JsonView::as_string() const {
+    verify_type(JsonValue::Type::String);
+    size_t offset = JsonTape::payload_of(word());
+    uint32_t length;
+    std::memcpy(&length, tape->strings.data() + offset, sizeof(length));
+    return std::string_view(tape->strings.data() + offset + sizeof(length), length);
+}
+
+std::optional<JsonView> JsonView::find(std::string_view index) const {
+    size_t end = next() - 1;
+    size_t cur = this->index + 1;
+    while (cur < end) {
+        JsonView key(tape, cur);
+        JsonView member(tape, cur + 1);
+        if (key.as_string() == index) return member;
+        cur = member.next();
+    }
+    return std::nullopt;
+}
+
+std::optional<JsonView> JsonView::find(int index) const {
+    if (index < 0) return std::nullopt;
+    size_t end = next() - 1;
+    size_t cur = this->index + 1;
+    for (int idx = 0; cur < end; idx++) {
+        JsonView element(tape, cur);
+        if (idx == index) return element;
+        cur = element.next();
+    }
+    return std::nullopt;
+}
+
+JsonView JsonView::at(std::string_view index) const {
+    verify_type(JsonValue::Type::Object);
+    std::optional<JsonView> member = find(index);
+    if (!member.has_value())
+        throw std::out_of_range("Key not found");
+    return *member;
+}
+
+JsonView JsonView::at(int index) const {
+    verify_type(JsonValue::Type::Array);
+    std::optional<JsonView> element = find(index);
+    if (!element.has_value())
+        throw std::runtime_error("Index out of bounds");
+    return *element;
+}
+
+bool JsonView::exists(std::string_view index) const {
+    return type() == JsonValue::Type::Object && find(index).has_value();
+}
+
+bool JsonView::exists(const int index) const {
+    return type() == JsonValue::Type::Array && find(index).has_value();
+}
+
+size_t JsonView::size() const {
+    if (type() != JsonValue::Type::Object && type() != JsonValue::Type::Array)
+        throw std::runtime_error("Invalid method type, size() requires an object or array");
+
+    uint64_t count = JsonTape::payload_of(word()) >> 32;
+    if (count < JsonTape::MAX_COUNT) return count;
+
+    // the stored count saturated, walk the elements instead
+    size_t end = next() - 1;
+    size_t cur = index + 1;
+    size_t result = 0;
+    while (cur < end) {
+        if (type() == JsonValue::Type::Object) cur++;
+        cur = JsonView(tape, cur).next();
+        result++;
+    }
+    return result;
+}
+
+JsonValue JsonView::materialize(const JsonValue::allocator_type& alloc) const {
+    switch (tag()) {
+        case JsonTape::Tag::Null: return JsonValue(nullptr, alloc);
+        case JsonTape::Tag::True: return JsonValue(true, alloc);
+        case JsonTape::Tag::False: return JsonValue(false, alloc);
+        case JsonTape::Tag::Number: return JsonValue(as_double(), alloc);
+        case JsonTape::Tag::Int64: return JsonValue(as_int64(), alloc);
+        case JsonTape::Tag::UInt64: return JsonValue(as_uint64(), alloc);
+        case JsonTape::Tag::String: return JsonValue(as_string(), alloc);
+        case JsonTape::Tag::ObjectStart: {
+            JsonValue result(JsonValue::Type::Object, alloc);
+            size_t end = next() - 1;
+            size_t cur = index + 1;
+            while (cur < end) {
+                JsonView member(tape, cur + 1);
+                result.set_index(JsonView(tape, cur).as_string(), member.materialize(alloc));
+                cur = member.next();
+            }
+            return result;
+        }
+        case JsonTape::Tag::ArrayStart: {
+            JsonValue result(JsonValue::Type::Array, alloc);
+            size_t end = next() - 1;
+            size_t cur = index + 1;
+            while (cur < end) {
+                JsonView element(tape, cur);
+                result.push_back(element.materialize(alloc));
+                cur = element.next();
+            }
+            return result;
+        }
+        default: throw std::runtime_error("Invalid tape position");
+    }
+}
+
+void JsonView::verify_type(JsonValue::Type expected) const {
+    if (type() != expected) {
+        std::stringstream ss;
+        ss << "Invalid method type, requested " << JsonValue::TypeNames[static_cast<int>(expected)] << ", but JsonView is of type " << JsonValue::TypeNames[static_cast<int>(type())];
+        throw std::runtime_error(ss.str());
+    }
+}
@@ -0,0 +1,234 @@
+#include "json_writer.h"
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// output is handed to the sink whenever this much has accumulated
+constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+bool needs_escape(unsigned char c) {
+    return c < 0x20 || c == JsonConstants::STRING_QUOTE || c == JsonConstants::ESCAPE;
+}
+
+// length of the prefix of str that can be copied without escaping
+size_t clean_prefix(std::string_view str) {
+    size_t idx = 0;
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8(JsonConstants::STRING_QUOTE);
+    const __m128i escape = _mm_set1_epi8(JsonConstants::ESCAPE);
+    const __m128i control_max = _mm_set1_epi8(0x1F);
+    for (; idx + 16 <= str.size(); idx += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + idx));
+        // unsigned c <= 0x1F is max(c, 0x1F) == 0x1F
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, escape)),
+                                       _mm_cmpeq_epi8(_mm_max_epu8(chunk, control_max), control_max));
+        int mask = _mm_movemask_epi8(special);
+        if (mask != 0)
+            return idx + __builtin_ctz(mask);
+    }
+#endif
+    while (idx < str.size() && !needs_escape(str[idx])) idx++;
+    return idx;
+}
+
+// Flush is called with the buffer once it grows past CHUNK_SIZE and is expected
+// to empty it; std::nullptr_t means everything stays in the buffer.
+template <typename Flush>
+struct Writer {
+    std::string& out;
+    const WriteOptions& options;
+    Flush flush;
+    int depth = 0;
+
+    void maybe_flush() {
+        if constexpr (!std::is_same_v<Flush, std::nullptr_t>) {
+            if (out.size() >= CHUNK_SIZE) flush(out);
+        }
+    }
+
+    void newline() {
+        if (!options.pretty) return;
+        out += '\n';
+        out.append(size_t(depth) * options.indent, ' ');
+    }
+
+    void write_value(const JsonValue& value);
+    void write_number(const JsonValue& value);
+    void write_string(std::string_view str);
+    void write_object(const JsonValue::Object& object);
+    void write_array(const JsonValue::Array& array);
+};
+
+template <typename Flush>
+void Writer<Flush>::write_value(const JsonValue& value) {
+    switch (value.type()) {
+        case JsonValue::Type::Null: out += "null"; break;
+        case JsonValue::Type::Boolean: out += value.as_boolean() ? "true" : "false"; break;
+        case JsonValue::Type::Number: write_number(value); break;
+        case JsonValue::Type::String: write_string(value.as_string()); break;
+        case JsonValue::Type::Object: write_object(value.as_object()); break;
+        case JsonValue::Type::Array: write_array(value.as_array()); break;
+    }
+}
+
+template <typename Flush>
+void Writer<Flush>::write_number(const JsonValue& value) {
+    switch (value.number_type()) {
+        case JsonValue::NumberType::Int64: write_json_number(value.as_int64(), out); break;
+        case JsonValue::NumberType::UInt64: write_json_number(value.as_uint64(), out); break;
+        default: write_json_number(value.as_double(), out); break;
+    }
+}
+
+template <typename Flush>
+void Writer<Flush>::write_string(std::string_view str) {
+    write_json_string(str, out);
+}
+
+template <typename Flush>
+void Writer<Flush>::write_object(const JsonValue::Object& object) {
+    out += JsonConstants::OBJECT_START;
+    if (object.empty()) {
+        out += JsonConstants::OBJECT_END;
+        return;
+    }
+
+    depth++;
+    bool start = true;
+    for (const auto& [key, member]: object) {
+        if (!start) out += JsonConstants::ITEM_SEPARATOR;
+        start = false;
+        newline();
+        write_string(key);
+        out += JsonConstants::KEY_VALUE_SEPARATOR;
+        if (options.pretty) out += ' ';
+        write_value(member);
+        maybe_flush();
+    }
+    depth--;
+    newline();
+    out += JsonConstants::OBJECT_END;
+}
+
+template <typename Flush>
+void Writer<Flush>::write_array(const JsonValue::Array& array) {
+    out += JsonConstants::ARRAY_START;
+    if (array.empty()) {
+        out += JsonConstants::ARRAY_END;
+        return;
+    }
+
+    depth++;
+    bool start = true;
+    for (const auto& element: array) {
+        if (!start) out += JsonConstants::ITEM_SEPARATOR;
+        start = false;
+        newline();
+        write_value(element);
+        maybe_flush();
+    }
+    depth--;
+    newline();
+    out += JsonConstants::ARRAY_END;
+}
+
+} // namespace
+
+void write_json_string(std::string_view str, std::string& out) {
+    out += JsonConstants::STRING_QUOTE;
+    while (!str.empty()) {
+        size_t clean = clean_prefix(str);
+        out.append(str.data(), clean);
+        if (clean == str.size()) break;
+
+        unsigned char c = str[clean];
+        out += JsonConstants::ESCAPE;
+        switch (c) {
+            case JsonConstants::STRING_QUOTE: out += JsonConstants::STRING_QUOTE; break;
+            case JsonConstants::ESCAPE: out += JsonConstants::REVERSE_SLASH; break;
+            case '\b': out += JsonConstants::BACKSPACE; break;
+            case '\f': out += JsonConstants::FORMFEED; break;
+            case '\n': out += JsonConstants::LINEFEED; break;
+            case '\r': out += JsonConstants::RETURN; break;
+            case '\t': out += JsonConstants::TAB; break;
+            default:
+                out += JsonConstants::HEX;
+                out += "00";
+                out += HEX_DIGITS[c >> 4];
+                out += HEX_DIGITS[c & 0xF];
+                break;
+        }
+        str.remove_prefix(clean + 1);
+    }
+    out += JsonConstants::STRING_QUOTE;
+}
+
+// 24 is enough for any int64, uint64 or shortest double
+void write_json_number(int64_t number, std::string& out) {
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    out.append(buffer, result.ptr - buffer);
+}
+
+void write_json_number(uint64_t number, std::string& out) {
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    out.append(buffer, result.ptr - buffer);
+}
+
+void write_json_number(double number, std::string& out) {
+    if (!std::isfinite(number)) {
+        out += "null";
+        return;
+    }
+    // without a precision to_chars gives the shortest round-trip form
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    out.append(buffer, result.ptr - buffer);
+}
+
+void write_json(const JsonValue& value, std::string& out, const WriteOptions& options) {
+    Writer<std::nullptr_t> writer{out, options, nullptr};
+    writer.write_value(value);
+}
+
+void write_json(const JsonValue& value, std::ostream& out, const WriteOptions& options) {
+    std::string buffer;
+    buffer.reserve(CHUNK_SIZE * 2);
+    auto flush = [&out](std::string& chunk) {
+        out.write(chunk.data(), chunk.size());
+        chunk.clear();
+    };
+    Writer<decltype(flush)> writer{buffer, options, flush};
+    writer.write_value(value);
+    flush(buffer);
+}
+
+bool write_json(const JsonValue& value, int fd, const WriteOptions& options) {
+    std::string buffer;
+    buffer.reserve(CHUNK_SIZE * 2);
+    bool failed = false;
+    auto flush = [fd, &failed](std::string& chunk) {
+        size_t written = 0;
+        while (!failed && written < chunk.size()) {
+            ssize_t result = ::write(fd, chunk.data() + written, chunk.size() - written);
+            if (result < 0 && errno == EINTR) continue;
+            if (result <= 0) failed = true;
+            else written += result;
+        }
+        chunk.clear();
+    };
+    Writer<decltype(flush)> writer{buffer, options, flush};
+    writer.write_value(value);
+    flush(buffer);
+    return !failed;
+}
@@ -0,0 +1,76 @@
+#include "key_pool.h"
+
+#include <cstring>
+#include <new>
+#include <mutex>
+
+namespace {
+
+thread_local KeyPool* active_pool = nullptr;
+
+} // namespace
+
+JsonKey KeyPool::intern(std::string_view key) {
+    {
+        std::shared_lock lock(mutex);
+        auto it = keys.find(key);
+        if (it != keys.end()) return JsonKey(&*it);
+    }
+
+    std::unique_lock lock(mutex);
+    // another thread may have added it in between
+    auto it = keys.find(key);
+    if (it != keys.end()) return JsonKey(&*it);
+
+    size_t cost = key.size() + KEY_OVERHEAD;
+    if (cost > budget - used) {
+        lock.unlock();
+        void* block = ::operator new(sizeof(JsonKey::Owned) + key.size());
+        char* text = static_cast<char*>(block) + sizeof(JsonKey::Owned);
+        std::memcpy(text, key.data(), key.size());
+        std::string_view stored(text, key.size());
+        return JsonKey(new (block) JsonKey::Owned{{stored, std::hash<std::string_view>()(stored)}, 1});
+    }
+    used += cost;
+
+    char* text = static_cast<char*>(storage.allocate(key.size() ? key.size() : 1, 1));
+    std::memcpy(text, key.data(), key.size());
+    std::string_view stored(text, key.size());
+    return JsonKey(&*keys.emplace(stored, std::hash<std::string_view>()(stored)).first);
+}
+
+size_t KeyPool::bytes() const {
+    std::shared_lock lock(mutex);
+    return used;
+}
+
+void JsonKey::release() {
+    Owned* key = owned();
+    if (key->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        key->~Owned();
+        ::operator delete(key);
+    }
+}
+
+size_t KeyPool::size() const {
+    std::shared_lock lock(mutex);
+    return keys.size();
+}
+
+KeyPool& KeyPool::global() {
+    // never destroyed, values in static storage may still hold its keys at exit
+    static KeyPool* pool = new KeyPool(GLOBAL_BUDGET);
+    return *pool;
+}
+
+KeyPool& KeyPool::current() {
+    return active_pool ? *active_pool : global();
+}
+
+KeyPoolScope::KeyPoolScope(KeyPool& pool): previous{active_pool} {
+    active_pool = &pool;
+}
+
+KeyPoolScope::~KeyPoolScope() {
+    active_pool = previous;
+}
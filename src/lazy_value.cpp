@@ -0,0 +1,284 @@
+#include "lazy_value.h"
+#include "parser.h"
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+[[noreturn]] void throw_error(std::string_view input, ParseError error, size_t offset) {
+    throw std::runtime_error(ParseResult(error, locate(input, offset)).error_message());
+}
+
+size_t skip_whitespace(std::string_view input, size_t position) {
+    while (position < input.size() && is_whitespace(input[position])) position++;
+    return position;
+}
+
+// position just past the string that opens at position
+size_t skip_string(std::string_view input, size_t position) {
+    for (size_t idx = position + 1; idx < input.size(); idx++) {
+        if (input[idx] == JsonConstants::ESCAPE) idx++;
+        else if (input[idx] == JsonConstants::STRING_QUOTE) return idx + 1;
+    }
+    throw_error(input, ParseError::UnexpectedEnd, input.size());
+}
+
+// Position just past the object or array that opens at position. Only strings
+// and nesting are followed, the contents are not checked.
+size_t skip_container(std::string_view input, size_t position) {
+    size_t depth = 0;
+    for (size_t idx = position; idx < input.size(); idx++) {
+        switch (input[idx]) {
+            case JsonConstants::STRING_QUOTE:
+                idx = skip_string(input, idx) - 1;
+                break;
+            case JsonConstants::ARRAY_START:
+            case JsonConstants::OBJECT_START:
+                depth++;
+                break;
+            case JsonConstants::ARRAY_END:
+            case JsonConstants::OBJECT_END:
+                if (--depth == 0) return idx + 1;
+                break;
+            default:
+                break;
+        }
+    }
+    throw_error(input, ParseError::UnexpectedEnd, input.size());
+}
+
+// position just past the value that starts at position
+size_t skip_value(std::string_view input, size_t position) {
+    if (position >= input.size())
+        throw_error(input, ParseError::UnexpectedEnd, position);
+
+    switch (input[position]) {
+        case JsonConstants::OBJECT_START:
+        case JsonConstants::ARRAY_START:
+            return skip_container(input, position);
+        case JsonConstants::STRING_QUOTE:
+            return skip_string(input, position);
+        default: {
+            SpanReader reader(input.substr(position));
+            JsonValue scalar;
+            ParseError error = parse_value(reader, scalar);
+            if (error != ParseError::None)
+                throw_error(input, error, position + reader.offset());
+            return position + reader.offset();
+        }
+    }
+}
+
+// Calls visit(key, value) for each member of the object opening at position,
+// until visit returns true. key is the raw text between the key's quotes.
+template <typename Visit>
+void for_each_member(std::string_view input, size_t position, Visit&& visit) {
+    size_t cur = skip_whitespace(input, position + 1);
+    if (cur < input.size() && input[cur] == JsonConstants::OBJECT_END)
+        return;
+
+    while (true) {
+        if (cur >= input.size() || input[cur] != JsonConstants::STRING_QUOTE)
+            throw_error(input, ParseError::ExpectedKey, cur);
+        size_t key_end = skip_string(input, cur);
+        std::string_view key = input.substr(cur + 1, key_end - cur - 2);
+
+        cur = skip_whitespace(input, key_end);
+        if (cur >= input.size() || input[cur] != JsonConstants::KEY_VALUE_SEPARATOR)
+            throw_error(input, ParseError::ExpectedColon, cur);
+        size_t value = skip_whitespace(input, cur + 1);
+        if (visit(key, LazyValue(input, value)))
+            return;
+
+        cur = skip_whitespace(input, skip_value(input, value));
+        if (cur < input.size() && input[cur] == JsonConstants::COMMA) {
+            cur = skip_whitespace(input, cur + 1);
+        } else if (cur < input.size() && input[cur] == JsonConstants::OBJECT_END) {
+            return;
+        } else throw_error(input, ParseError::ExpectedCommaOrObjectEnd, cur);
+    }
+}
+
+// calls visit(element) for each element of the array opening at position,
+// until visit returns true
+template <typename Visit>
+void for_each_element(std::string_view input, size_t position, Visit&& visit) {
+    size_t cur = skip_whitespace(input, position + 1);
+    if (cur < input.size() && input[cur] == JsonConstants::ARRAY_END)
+        return;
+
+    while (true) {
+        if (visit(LazyValue(input, cur)))
+            return;
+
+        cur = skip_whitespace(input, skip_value(input, cur));
+        if (cur < input.size() && input[cur] == JsonConstants::COMMA) {
+            cur = skip_whitespace(input, cur + 1);
+        } else if (cur < input.size() && input[cur] == JsonConstants::ARRAY_END) {
+            return;
+        } else throw_error(input, ParseError::ExpectedCommaOrArrayEnd, cur);
+    }
+}
+
+// keys without escapes are compared in place, the rest are decoded first
+bool key_equals(std::string_view raw_key, std::string_view index) {
+    if (std::memchr(raw_key.data(), JsonConstants::ESCAPE, raw_key.size()) == nullptr)
+        return raw_key == index;
+
+    std::string quoted = "\"" + std::string(raw_key) + "\"";
+    SpanReader reader(quoted);
+    JsonValue::String key;
+    return read_string(reader, key) == ParseError::None && key == index;
+}
+
+} // namespace
+
+LazyValue::LazyValue(std::string_view _input, size_t _position): input{_input}, position{_position} {};
+
+JsonValue::Type LazyValue::type() const {
+    char c = position < input.size() ? input[position] : '\0';
+    switch (c) {
+        case JsonConstants::OBJECT_START: return JsonValue::Type::Object;
+        case JsonConstants::ARRAY_START: return JsonValue::Type::Array;
+        case JsonConstants::STRING_QUOTE: return JsonValue::Type::String;
+        case 't':
+        case 'f': return JsonValue::Type::Boolean;
+        case 'n': return JsonValue::Type::Null;
+        default:
+            if (is_digit(c) || c == JsonConstants::MINUS)
+                return JsonValue::Type::Number;
+            throw_error(input, position < input.size() ? ParseError::UnexpectedCharacter : ParseError::UnexpectedEnd, position);
+    }
+}
+
+JsonValue::NumberType LazyValue::number_type() const {
+    return materialize().number_type();
+}
+
+bool LazyValue::as_boolean() const {
+    verify_type(JsonValue::Type::Boolean);
+    return materialize().as_boolean();
+}
+
+double LazyValue::as_double() const {
+    verify_type(JsonValue::Type::Number);
+    return materialize().as_double();
+}
+
+int64_t LazyValue::as_int64() const {
+    verify_type(JsonValue::Type::Number);
+    return materialize().as_int64();
+}
+
+uint64_t LazyValue::as_uint64() const {
+    verify_type(JsonValue::Type::Number);
+    return materialize().as_uint64();
+}
+
+std::string LazyValue::as_string() const {
+    verify_type(JsonValue::Type::String);
+    return std::string(materialize().as_string());
+}
+
+std::optional<LazyValue> LazyValue::find(std::string_view index) const {
+    if (type() != JsonValue::Type::Object) return std::nullopt;
+    // stops at the first match, so what follows it is never scanned
+    std::optional<LazyValue> result;
+    for_each_member(input, position, [&](std::string_view key, LazyValue value) {
+        if (key_equals(key, index)) result = value;
+        return result.has_value();
+    });
+    return result;
+}
+
+std::optional<LazyValue> LazyValue::find(int index) const {
+    if (index < 0 || type() != JsonValue::Type::Array) return std::nullopt;
+    std::optional<LazyValue> result;
+    int idx = 0;
+    for_each_element(input, position, [&](LazyValue element) {
+        if (idx++ == index) result = element;
+        return result.has_value();
+    });
+    return result;
+}
+
+LazyValue LazyValue::at(std::string_view index) const {
+    verify_type(JsonValue::Type::Object);
+    std::optional<LazyValue> member = find(index);
+    if (!member.has_value())
+        throw std::out_of_range("Key not found");
+    return *member;
+}
+
+LazyValue LazyValue::at(int index) const {
+    verify_type(JsonValue::Type::Array);
+    std::optional<LazyValue> element = find(index);
+    if (!element.has_value())
+        throw std::runtime_error("Index out of bounds");
+    return *element;
+}
+
+bool LazyValue::exists(std::string_view index) const {
+    return find(index).has_value();
+}
+
+bool LazyValue::exists(const int index) const {
+    return find(index).has_value();
+}
+
+void LazyValue::for_each(const std::function<void(const LazyValue&)>& visit) const {
+    switch (type()) {
+        case JsonValue::Type::Object:
+            for_each_member(input, position, [&](std::string_view, LazyValue value) { visit(value); return false; });
+            return;
+        case JsonValue::Type::Array:
+            for_each_element(input, position, [&](LazyValue element) { visit(element); return false; });
+            return;
+        default:
+            return;
+    }
+}
+
+size_t LazyValue::size() const {
+    size_t count = 0;
+    switch (type()) {
+        case JsonValue::Type::Object:
+            for_each_member(input, position, [&](std::string_view, LazyValue) { count++; return false; });
+            return count;
+        case JsonValue::Type::Array:
+            for_each_element(input, position, [&](LazyValue) { count++; return false; });
+            return count;
+        default:
+            throw std::runtime_error("Invalid method type, size() requires an object or array");
+    }
+}
+
+JsonValue LazyValue::materialize(const JsonValue::allocator_type& alloc) const {
+    SpanReader reader(input.substr(position));
+    JsonValue result(alloc);
+    ParseError error = parse_value(reader, result);
+    if (error != ParseError::None)
+        throw_error(input, error, position + reader.offset());
+    return result;
+}
+
+void LazyValue::verify_type(JsonValue::Type expected) const {
+    if (type() != expected) {
+        std::stringstream ss;
+        ss << "Invalid method type, requested " << JsonValue::TypeNames[static_cast<int>(expected)] << ", but LazyValue is of type " << JsonValue::TypeNames[static_cast<int>(type())];
+        throw std::runtime_error(ss.str());
+    }
+}
+
+LazyValue parse_lazy(std::string_view input) {
+    size_t position = skip_whitespace(input, 0);
+    if (position == input.size())
+        throw_error(input, ParseError::EmptyDocument, position);
+
+    // only allowed json file level values are object or array
+    if (input[position] != JsonConstants::OBJECT_START && input[position] != JsonConstants::ARRAY_START)
+        throw_error(input, ParseError::InvalidRoot, position);
+    return LazyValue(input, position);
+}
@@ -1,6 +1,109 @@
 #include "parser.h"
+#include "json_writer.h"
+#include "ndjson.h"
+#include <charconv>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
 
-int main() {
-    std::cout << "Hello world!\n";
-}
\ No newline at end of file
+namespace {
+
+int usage() {
+    std::cerr << "usage: parser [--ndjson] [--threads N] [--pretty] [--stats] [FILE]\n"
+              << "  Parses FILE, or standard input when FILE is missing or -, and writes it\n"
+              << "  back out. With --ndjson every line is a separate document, parsed on N\n"
+              << "  worker threads and written back as one compact line each. With --stats\n"
+              << "  what the parse did is written to standard error.\n";
+    return 2;
+}
+
+// a positive whole number, nothing else
+std::optional<size_t> parse_count(std::string_view text) {
+    size_t count = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), count);
+    if (error != std::errc() || end != text.data() + text.size() || count == 0)
+        return std::nullopt;
+    return count;
+}
+
+void report(const std::string& source, const ParseResult& result) {
+    std::cerr << source << ": " << result.error_message() << "\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool ndjson = false;
+    bool stats = false;
+    WriteOptions write_options;
+    NdjsonOptions ndjson_options;
+    std::string path = "-";
+
+    for (int idx = 1; idx < argc; idx++) {
+        if (std::strcmp(argv[idx], "--ndjson") == 0) {
+            ndjson = true;
+        } else if (std::strcmp(argv[idx], "--stats") == 0) {
+            stats = true;
+        } else if (std::strcmp(argv[idx], "--pretty") == 0) {
+            write_options.pretty = true;
+        } else if (std::strcmp(argv[idx], "--threads") == 0 && idx + 1 < argc) {
+            std::optional<size_t> threads = parse_count(argv[++idx]);
+            if (!threads.has_value())
+                return usage();
+            ndjson_options.threads = *threads;
+        } else if (argv[idx][0] == '-' && argv[idx][1] != '\0') {
+            return usage();
+        } else {
+            path = argv[idx];
+        }
+    }
+
+    if (ndjson) {
+        size_t failures = 0;
+        std::string line;
+        auto on_record = [&](size_t, ParseResult&& record) {
+            if (!record) {
+                report(path, record);
+                failures++;
+                return;
+            }
+            line.clear();
+            write_json(*record, line);
+            line += '\n';
+            std::cout.write(line.data(), line.size());
+        };
+
+        bool read = path == "-" ? parse_ndjson(std::cin, on_record, ndjson_options)
+                                : parse_ndjson_file(path, on_record, ndjson_options);
+        if (!read) {
+            std::cerr << path << ": could not read input\n";
+            return 1;
+        }
+        return failures == 0 ? 0 : 1;
+    }
+
+    // declared first, the result allocates through it
+    ParseStats parse_stats;
+    std::ifstream file;
+    if (stats && path != "-") {
+        file.open(path, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << path << ": could not read input\n";
+            return 1;
+        }
+    }
+    std::istream& input = path == "-" ? std::cin : file;
+    ParseResult result = !stats ? (path == "-" ? parse(std::cin) : parse_file(path)) : parse(input, parse_stats);
+    if (stats)
+        std::cerr << parse_stats;
+    if (!result) {
+        report(path, result);
+        return 1;
+    }
+    write_json(*result, std::cout, write_options);
+    std::cout << "\n";
+    return 0;
+}
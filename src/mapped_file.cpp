@@ -0,0 +1,79 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+MappedFile::MappedFile(const std::string& path, Access access) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        return;
+    }
+
+    length = static_cast<size_t>(info.st_size);
+
+    // mmap rejects zero-length mappings, an empty file is simply an empty view
+    if (length == 0) {
+        ::close(fd);
+        valid = true;
+        return;
+    }
+
+    void* mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        length = 0;
+        return;
+    }
+
+    ::madvise(mapping, length, access == Access::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+
+    data = static_cast<const char*>(mapping);
+    valid = true;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept:
+    data{std::exchange(other.data, nullptr)},
+    length{std::exchange(other.length, 0)},
+    valid{std::exchange(other.valid, false)} {};
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        data = std::exchange(other.data, nullptr);
+        length = std::exchange(other.length, 0);
+        valid = std::exchange(other.valid, false);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+MappedFile::operator bool() const {
+    return valid;
+}
+
+std::string_view MappedFile::view() const {
+    return std::string_view(data, length);
+}
+
+size_t MappedFile::size() const {
+    return length;
+}
+
+void MappedFile::unmap() {
+    if (data != nullptr)
+        ::munmap(const_cast<char*>(data), length);
+    data = nullptr;
+    length = 0;
+    valid = false;
+}
@@ -0,0 +1,160 @@
+#include "ndjson.h"
+#include "mapped_file.h"
+#include "parser.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <optional>
+
+namespace {
+
+struct ParsedRecord {
+    // lines before this one within the chunk, and where it starts in the chunk
+    size_t line;
+    size_t offset;
+    ParseResult result;
+};
+
+struct ParsedChunk {
+    // where the chunk starts in the whole input
+    size_t offset;
+    size_t newlines = 0;
+    std::vector<ParsedRecord> records;
+};
+
+bool is_blank(std::string_view line) {
+    for (char c: line) {
+        if (!is_whitespace(c)) return false;
+    }
+    return true;
+}
+
+// runs on a worker, keys go to the pool that was current for the caller
+ParsedChunk parse_chunk(std::string_view chunk, size_t offset, KeyPool& keys) {
+    KeyPoolScope scope(keys);
+    ParsedChunk parsed{offset, 0, {}};
+    size_t start = 0;
+    while (start < chunk.size()) {
+        const char* newline = static_cast<const char*>(std::memchr(chunk.data() + start, '\n', chunk.size() - start));
+        size_t end = newline ? newline - chunk.data() : chunk.size();
+        std::string_view line = chunk.substr(start, end - start);
+        if (!is_blank(line))
+            parsed.records.push_back(ParsedRecord{parsed.newlines, start, parse(line)});
+        if (newline) parsed.newlines++;
+        start = end + 1;
+    }
+    return parsed;
+}
+
+// Keeps up to two chunks per worker in flight and hands the records to callback
+// in input order. submit_next returns the future of the next chunk, or nothing
+// once the input is exhausted.
+template <typename SubmitNext>
+void run_pipeline(ThreadPool& pool, SubmitNext&& submit_next, const NdjsonCallback& callback) {
+    const size_t window = pool.size() * 2;
+    std::deque<std::future<ParsedChunk>> pending;
+    size_t lines_before = 0;
+
+    auto deliver = [&]() {
+        ParsedChunk chunk = pending.front().get();
+        pending.pop_front();
+        for (auto& record: chunk.records) {
+            size_t line = lines_before + record.line + 1;
+            if (record.result.has_value()) {
+                callback(line, std::move(record.result));
+            } else {
+                // the record was parsed on its own, move the location into the whole input
+                SourceLocation location = record.result.location();
+                location.offset += chunk.offset + record.offset;
+                location.line = line;
+                callback(line, ParseResult(record.result.error(), location));
+            }
+        }
+        lines_before += chunk.newlines;
+    };
+
+    while (true) {
+        std::optional<std::future<ParsedChunk>> next = submit_next();
+        if (!next.has_value()) break;
+        pending.push_back(std::move(*next));
+        if (pending.size() >= window) deliver();
+    }
+    while (!pending.empty()) deliver();
+}
+
+} // namespace
+
+void parse_ndjson(std::string_view input, const NdjsonCallback& callback, const NdjsonOptions& options) {
+    ThreadPool pool(options.threads);
+    KeyPool& keys = KeyPool::current();
+    size_t offset = 0;
+    auto submit_next = [&]() -> std::optional<std::future<ParsedChunk>> {
+        if (offset >= input.size()) return std::nullopt;
+
+        // extend the chunk to the end of the line it stops in
+        size_t end = std::min(input.size(), offset + std::max<size_t>(options.chunk_size, 1));
+        if (end < input.size()) {
+            size_t newline = input.find('\n', end - 1);
+            end = newline == std::string_view::npos ? input.size() : newline + 1;
+        }
+        std::string_view chunk = input.substr(offset, end - offset);
+        size_t chunk_offset = offset;
+        offset = end;
+        return pool.submit([chunk, chunk_offset, &keys]() { return parse_chunk(chunk, chunk_offset, keys); });
+    };
+    run_pipeline(pool, submit_next, callback);
+}
+
+bool parse_ndjson(std::istream& input, const NdjsonCallback& callback, const NdjsonOptions& options) {
+    ThreadPool pool(options.threads);
+    KeyPool& keys = KeyPool::current();
+    const size_t chunk_size = std::max<size_t>(options.chunk_size, 1);
+    // bytes read past the last line end, they start the next chunk
+    std::string carry;
+    size_t offset = 0;
+    bool failed = false;
+
+    auto submit_next = [&]() -> std::optional<std::future<ParsedChunk>> {
+        std::string chunk = std::move(carry);
+        carry.clear();
+        size_t line_end = std::string::npos;
+        while (input && line_end == std::string::npos) {
+            size_t size = chunk.size();
+            chunk.resize(size + chunk_size);
+            input.read(chunk.data() + size, chunk_size);
+            chunk.resize(size + input.gcount());
+            // only the bytes just read, the ones before hold no line end
+            size_t found = std::string_view(chunk).substr(size).rfind('\n');
+            if (found != std::string_view::npos) line_end = size + found;
+        }
+        if (input.bad()) failed = true;
+        if (failed || chunk.empty()) return std::nullopt;
+
+        // everything after the last line end waits for the rest of its line
+        if (input && line_end != std::string::npos) {
+            carry.assign(chunk, line_end + 1);
+            chunk.resize(line_end + 1);
+        }
+        size_t chunk_offset = offset;
+        offset += chunk.size();
+        return pool.submit([chunk = std::move(chunk), chunk_offset, &keys]() { return parse_chunk(chunk, chunk_offset, keys); });
+    };
+    run_pipeline(pool, submit_next, callback);
+    return !failed;
+}
+
+bool parse_ndjson_file(const std::string& path, const NdjsonCallback& callback, const NdjsonOptions& options) {
+    MappedFile file(path);
+    if (!file)
+        return false;
+    parse_ndjson(file.view(), callback, options);
+    return true;
+}
+
+std::vector<ParseResult> parse_ndjson(std::string_view input, const NdjsonOptions& options) {
+    std::vector<ParseResult> records;
+    parse_ndjson(input, [&records](size_t, ParseResult&& record) { records.push_back(std::move(record)); }, options);
+    return records;
+}
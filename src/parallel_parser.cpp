@@ -0,0 +1,204 @@
+#include "parallel_parser.h"
+#include "parser.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <optional>
+#include <vector>
+
+namespace {
+
+// One span of the input as it goes through find_element_boundaries.
+struct Span {
+    std::string_view text;
+    size_t offset;
+    // whether the span starts inside a string, and the unescaped quotes in it
+    bool in_string = false;
+    size_t quotes = 0;
+    // its brackets and commas outside strings, and how much deeper the nesting
+    // is at its end than at its start
+    std::vector<uint32_t> structurals;
+    int64_t depth_change = 0;
+    // nesting at its start, and what it adds to the boundaries
+    int64_t depth = 0;
+    std::vector<size_t> boundaries;
+    // the bracket that takes the nesting back to zero, if it is in this span
+    char root_end = 0;
+};
+
+// Cuts input into spans of about chunk_size bytes that can each be indexed on
+// their own, so none starts right after a backslash. Nothing if one would run
+// past what the index can address.
+std::optional<std::vector<Span>> split_spans(std::string_view input, size_t chunk_size) {
+    chunk_size = std::clamp<size_t>(chunk_size, 64, UINT32_MAX / 2);
+    std::vector<Span> spans;
+    size_t start = 0;
+    while (start < input.size()) {
+        size_t end = std::min(input.size(), start + chunk_size);
+        while (end < input.size() && input[end - 1] == JsonConstants::ESCAPE) end++;
+        if (end - start > UINT32_MAX) return std::nullopt;
+        Span& span = spans.emplace_back();
+        span.text = input.substr(start, end - start);
+        span.offset = start;
+        start = end;
+    }
+    return spans;
+}
+
+// runs task for every index below count on pool and waits for all of them,
+// then rethrows the first exception one threw
+template <typename Task>
+void run_each(ThreadPool& pool, size_t count, const Task& task) {
+    std::vector<std::future<void>> done;
+    for (size_t idx = 0; idx < count; idx++)
+        done.push_back(pool.submit([&task, idx]() { task(idx); }));
+    // none may still be running once this returns, they refer to the caller's state
+    for (std::future<void>& future: done) future.wait();
+    for (std::future<void>& future: done) future.get();
+}
+
+// Positions of the commas directly inside the array opened at the start of
+// input, past any whitespace, followed by the position of its closing bracket.
+// The input is cut into spans that are indexed with the SIMD structural index
+// on the pool's threads: once to count quotes, so that each span knows whether
+// it starts inside a string, and once for its brackets and commas, so that each
+// knows its nesting depth. Only the per span totals are added up in order.
+// Strings and nesting are all that is tracked, the elements are checked when
+// they are parsed. Returns nothing if the array is not closed by a ']'.
+std::optional<std::vector<size_t>> find_element_boundaries(std::string_view input, ThreadPool& pool, size_t chunk_size) {
+    std::optional<std::vector<Span>> split = split_spans(input, chunk_size);
+    if (!split.has_value())
+        return std::nullopt;
+    std::vector<Span>& spans = *split;
+    SimdEngine engine = detect_simd_engine();
+
+    run_each(pool, spans.size(), [&](size_t idx) {
+        spans[idx].quotes = count_unescaped_quotes(spans[idx].text, engine);
+    });
+    for (size_t idx = 1; idx < spans.size(); idx++)
+        spans[idx].in_string = spans[idx - 1].in_string != (spans[idx - 1].quotes % 2 == 1);
+
+    run_each(pool, spans.size(), [&](size_t idx) {
+        Span& span = spans[idx];
+        std::vector<uint32_t> index = build_span_index(span.text, span.in_string, engine);
+        // quotes and scalars are of no interest here
+        for (uint32_t pos: index) {
+            switch (span.text[pos]) {
+                case JsonConstants::ARRAY_START:
+                case JsonConstants::OBJECT_START:
+                    span.depth_change++;
+                    break;
+                case JsonConstants::ARRAY_END:
+                case JsonConstants::OBJECT_END:
+                    span.depth_change--;
+                    break;
+                case JsonConstants::ITEM_SEPARATOR:
+                    break;
+                default:
+                    continue;
+            }
+            span.structurals.push_back(pos);
+        }
+    });
+    for (size_t idx = 1; idx < spans.size(); idx++)
+        spans[idx].depth = spans[idx - 1].depth + spans[idx - 1].depth_change;
+
+    run_each(pool, spans.size(), [&](size_t idx) {
+        Span& span = spans[idx];
+        int64_t depth = span.depth;
+        for (uint32_t pos: span.structurals) {
+            char c = span.text[pos];
+            if (c == JsonConstants::ARRAY_START || c == JsonConstants::OBJECT_START) {
+                depth++;
+            } else if (c == JsonConstants::ITEM_SEPARATOR) {
+                if (depth == 1) span.boundaries.push_back(span.offset + pos);
+            } else if (--depth == 0) {
+                // the root is closed here, anything after it is not an element
+                span.boundaries.push_back(span.offset + pos);
+                span.root_end = c;
+                return;
+            }
+        }
+    });
+
+    std::vector<size_t> boundaries;
+    for (const Span& span: spans) {
+        boundaries.insert(boundaries.end(), span.boundaries.begin(), span.boundaries.end());
+        if (span.root_end == JsonConstants::ARRAY_END) return boundaries;
+        if (span.root_end != 0) return std::nullopt;
+    }
+    return std::nullopt;
+}
+
+// parses one element, which is all of text apart from surrounding whitespace;
+// the root array counts towards its depth
+bool parse_element(std::string_view text, JsonValue& result) {
+    SpanReader reader(text);
+    if (parse_value(reader, result, DEFAULT_MAX_DEPTH - 1) != ParseError::None)
+        return false;
+    consume_whitespace(reader);
+    return !reader;
+}
+
+bool is_blank(std::string_view text) {
+    for (char c: text) {
+        if (!is_whitespace(c)) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+ParseResult parse_parallel(std::string_view input, const ParallelParseOptions& options, std::pmr::memory_resource* resource) {
+    size_t open = 0;
+    while (open < input.size() && is_whitespace(input[open])) open++;
+    if (open == input.size() || input[open] != JsonConstants::ARRAY_START)
+        return parse(input, resource);
+
+    ThreadPool pool(options.threads);
+    std::optional<std::vector<size_t>> boundaries = find_element_boundaries(input, pool, options.chunk_size);
+    if (!boundaries.has_value() || !is_blank(input.substr(boundaries->back() + 1)))
+        return parse(input, resource);
+
+    // element idx lies between boundary idx - 1 (or the open bracket) and boundary idx
+    auto element_text = [&](size_t idx) {
+        size_t start = (idx == 0 ? open : (*boundaries)[idx - 1]) + 1;
+        return input.substr(start, (*boundaries)[idx] - start);
+    };
+    size_t count = boundaries->size();
+    if (count == 1 && is_blank(element_text(0)))
+        count = 0;
+
+    // group elements until each group covers chunk_size bytes, a group starts
+    // where the one before it ends
+    std::vector<size_t> group_ends;
+    for (size_t last = 0; last < count;) {
+        size_t bytes = 0;
+        while (last < count && bytes < options.chunk_size)
+            bytes += element_text(last++).size() + 1;
+        group_ends.push_back(last);
+    }
+
+    // every slot exists up front, so the workers can fill them independently
+    JsonValue::Array elements(count, JsonValue::allocator_type(resource));
+    std::atomic<bool> failed = false;
+    KeyPool& keys = KeyPool::current();
+    // rethrows what a worker threw, such as std::bad_alloc
+    run_each(pool, group_ends.size(), [&](size_t group) {
+        KeyPoolScope scope(keys);
+        for (size_t idx = group ? group_ends[group - 1] : 0; idx < group_ends[group] && !failed; idx++) {
+            if (!parse_element(element_text(idx), elements[idx]))
+                failed = true;
+        }
+    });
+
+    // parse() knows where exactly the input went wrong
+    if (failed)
+        return parse(input, resource);
+    JsonValue result(JsonValue::Type::Array, resource);
+    result.set_value(std::move(elements));
+    return ParseResult(std::move(result));
+}
@@ -0,0 +1,212 @@
+#include "parse_cache.h"
+#include "parser.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <list>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+// XXH64 with seed 0: four independent multiply-rotate lanes over 32 byte
+// stripes, faster than std::hash on anything but short inputs
+constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87;
+constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4F;
+constexpr uint64_t PRIME3 = 0x165667B19E3779F9;
+constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63;
+constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5;
+
+uint64_t load64(const char* at) {
+    uint64_t word;
+    std::memcpy(&word, at, sizeof(word));
+    return word;
+}
+
+uint32_t load32(const char* at) {
+    uint32_t word;
+    std::memcpy(&word, at, sizeof(word));
+    return word;
+}
+
+uint64_t round(uint64_t lane, uint64_t input) {
+    return std::rotl(lane + input * PRIME2, 31) * PRIME1;
+}
+
+uint64_t merge(uint64_t hash, uint64_t lane) {
+    return (hash ^ round(0, lane)) * PRIME1 + PRIME4;
+}
+
+uint64_t hash_input(std::string_view input) {
+    const char* at = input.data();
+    const char* end = at + input.size();
+    uint64_t hash;
+    if (input.size() >= 32) {
+        // separate variables, so that the lanes stay in registers
+        uint64_t lane0 = PRIME1 + PRIME2, lane1 = PRIME2, lane2 = 0, lane3 = 0 - PRIME1;
+        for (; end - at >= 32; at += 32) {
+            lane0 = round(lane0, load64(at));
+            lane1 = round(lane1, load64(at + 8));
+            lane2 = round(lane2, load64(at + 16));
+            lane3 = round(lane3, load64(at + 24));
+        }
+        hash = std::rotl(lane0, 1) + std::rotl(lane1, 7) + std::rotl(lane2, 12) + std::rotl(lane3, 18);
+        for (uint64_t lane: {lane0, lane1, lane2, lane3}) hash = merge(hash, lane);
+    } else {
+        hash = PRIME5;
+    }
+    hash += input.size();
+
+    for (; end - at >= 8; at += 8)
+        hash = std::rotl(hash ^ round(0, load64(at)), 27) * PRIME1 + PRIME4;
+    if (end - at >= 4) {
+        hash = std::rotl(hash ^ (load32(at) * PRIME1), 23) * PRIME2 + PRIME3;
+        at += 4;
+    }
+    for (; at < end; at++)
+        hash = std::rotl(hash ^ (static_cast<uint8_t>(*at) * PRIME5), 11) * PRIME1;
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// counts what an entry's arena takes from the heap, which is what the entry
+// costs. Not from the default resource: the cache outlives any arena a caller
+// has set as the default while parsing.
+struct ByteCounter: std::pmr::memory_resource {
+    size_t bytes = 0;
+    std::pmr::memory_resource* upstream = std::pmr::new_delete_resource();
+
+    void* do_allocate(size_t size, size_t alignment) override {
+        bytes += size;
+        return upstream->allocate(size, alignment);
+    }
+
+    void do_deallocate(void* block, size_t size, size_t alignment) override {
+        upstream->deallocate(block, size, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// parses with keys interned in pool, whichever pool the caller has in scope
+ParseResult parse_into_pool(std::string_view input, std::pmr::memory_resource* arena, KeyPool& pool) {
+    KeyPoolScope scope(pool);
+    return parse(input, arena);
+}
+
+} // namespace
+
+// One parsed input. The document lives in its own arena and its keys in its
+// own pool, both taking the heap, so building it is a run of pointer bumps,
+// dropping it a single release, and it depends on nothing the caller might
+// destroy first.
+struct ParseCache::Entry {
+    Entry(std::string_view _input, uint64_t _hash)
+        : hash{_hash}, input{_input}, arena{std::max<size_t>(input.size(), 1024), &counter},
+          result{parse_into_pool(input, &arena, keys)} {};
+
+    size_t bytes() const {
+        return sizeof(Entry) + input.capacity() + counter.bytes + keys.bytes();
+    }
+
+    uint64_t hash;
+    std::string input;
+    // declared in this order so that they are destroyed the other way round
+    ByteCounter counter;
+    std::pmr::monotonic_buffer_resource arena;
+    KeyPool keys;
+    ParseResult result;
+};
+
+struct ParseCache::Shard {
+    std::mutex mutex;
+    // most recently used first
+    std::list<std::shared_ptr<const Entry>> order;
+    std::unordered_map<uint64_t, std::list<std::shared_ptr<const Entry>>::iterator> index;
+    size_t bytes = 0;
+
+    void erase(std::list<std::shared_ptr<const Entry>>::iterator it) {
+        bytes -= (*it)->bytes();
+        index.erase((*it)->hash);
+        order.erase(it);
+    }
+};
+
+ParseCache::ParseCache(size_t budget, size_t _shards) {
+    _shards = std::max<size_t>(_shards, 1);
+    for (size_t idx = 0; idx < _shards; idx++) shards.push_back(std::make_unique<Shard>());
+    shard_budget = budget / _shards;
+}
+
+ParseCache::~ParseCache() = default;
+
+std::shared_ptr<const ParseResult> ParseCache::parse(std::string_view input) {
+    uint64_t hash = hash_input(input);
+    Shard& shard = *shards[hash % shards.size()];
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.index.find(hash);
+        if (found != shard.index.end() && (*found->second)->input == input) {
+            shard.order.splice(shard.order.begin(), shard.order, found->second);
+            hits++;
+            const std::shared_ptr<const Entry>& entry = *found->second;
+            // shares ownership of the entry, which holds the document's arena
+            return std::shared_ptr<const ParseResult>(entry, &entry->result);
+        }
+    }
+
+    misses++;
+    auto entry = std::make_shared<const Entry>(input, hash);
+    std::shared_ptr<const ParseResult> result(entry, &entry->result);
+    if (entry->bytes() > shard_budget)
+        return result;
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // another thread's copy of the same input, or a different input with
+    // the same hash, gives way to the newer one
+    auto found = shard.index.find(hash);
+    if (found != shard.index.end())
+        shard.erase(found->second);
+
+    shard.order.push_front(std::move(entry));
+    shard.index.emplace(hash, shard.order.begin());
+    shard.bytes += shard.order.front()->bytes();
+    while (shard.bytes > shard_budget) {
+        shard.erase(std::prev(shard.order.end()));
+        evictions++;
+    }
+    return result;
+}
+
+ParseCache::Counters ParseCache::counters() const {
+    Counters result;
+    result.hits = hits;
+    result.misses = misses;
+    result.evictions = evictions;
+    for (const auto& shard: shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        result.entries += shard->order.size();
+        result.bytes += shard->bytes;
+    }
+    return result;
+}
+
+void ParseCache::clear() {
+    for (const auto& shard: shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->order.clear();
+        shard->index.clear();
+        shard->bytes = 0;
+    }
+}
@@ -0,0 +1,172 @@
+#include "parse_result.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+const char* parse_error_message(ParseError error) {
+    switch (error) {
+        case ParseError::None: return "no error";
+        case ParseError::EmptyDocument: return "empty document";
+        case ParseError::InvalidRoot: return "top level value must be an object or array";
+        case ParseError::UnexpectedEnd: return "unexpected end of input";
+        case ParseError::UnexpectedCharacter: return "unexpected character";
+        case ParseError::InvalidLiteral: return "invalid literal";
+        case ParseError::InvalidNumber: return "invalid number";
+        case ParseError::InvalidEscape: return "invalid escape sequence";
+        case ParseError::ExpectedKey: return "expected a string key";
+        case ParseError::ExpectedColon: return "expected ':' after object key";
+        case ParseError::ExpectedCommaOrObjectEnd: return "expected ',' or '}'";
+        case ParseError::ExpectedCommaOrArrayEnd: return "expected ',' or ']'";
+        case ParseError::TrailingCharacters: return "unexpected characters after the top level value";
+        case ParseError::IoError: return "could not read input";
+        case ParseError::TooDeep: return "nested too deeply";
+        case ParseError::TypeMismatch: return "value does not fit the bound type";
+        case ParseError::InvalidEncoding: return "invalid binary encoding";
+        case ParseError::InputTooLarge: return "input too large";
+        case ParseError::InvalidUtf8: return "invalid UTF-8 in string";
+    }
+    return "unknown error";
+}
+
+namespace {
+
+std::string format_error(ParseError error, const SourceLocation& location) {
+    std::stringstream ss;
+    ss << parse_error_message(error) << " at line " << location.line << ", column "
+       << location.column << " (offset " << location.offset << ")";
+    return ss.str();
+}
+
+} // namespace
+
+SourceLocation locate(std::string_view input, size_t offset) {
+    offset = std::min(offset, input.size());
+    std::string_view before = input.substr(0, offset);
+
+    SourceLocation location;
+    location.offset = offset;
+    location.line = 1 + std::count(before.begin(), before.end(), '\n');
+    size_t line_start = before.rfind('\n');
+    location.column = 1 + (line_start == std::string_view::npos ? offset : offset - line_start - 1);
+    return location;
+}
+
+ParseResult::ParseResult(JsonValue&& _value): result{std::move(_value)} {};
+
+ParseResult::ParseResult(ParseError _error, SourceLocation _location): error_code{_error}, error_location{_location} {};
+
+bool ParseResult::has_value() const {
+    return result.has_value();
+}
+
+ParseResult::operator bool() const {
+    return result.has_value();
+}
+
+JsonValue& ParseResult::operator*() {
+    return *result;
+}
+
+const JsonValue& ParseResult::operator*() const {
+    return *result;
+}
+
+JsonValue* ParseResult::operator->() {
+    return &*result;
+}
+
+const JsonValue* ParseResult::operator->() const {
+    return &*result;
+}
+
+JsonValue& ParseResult::value() {
+    if (!result.has_value())
+        throw std::runtime_error(error_message());
+    return *result;
+}
+
+const JsonValue& ParseResult::value() const {
+    if (!result.has_value())
+        throw std::runtime_error(error_message());
+    return *result;
+}
+
+ParseResult::operator std::optional<JsonValue>() const & {
+    return result;
+}
+
+ParseResult::operator std::optional<JsonValue>() && {
+    return std::move(result);
+}
+
+ParseError ParseResult::error() const {
+    return error_code;
+}
+
+const SourceLocation& ParseResult::location() const {
+    return error_location;
+}
+
+std::string ParseResult::error_message() const {
+    return format_error(error_code, error_location);
+}
+
+TapeParseResult::TapeParseResult(JsonTape&& _tape): result{std::move(_tape)} {};
+
+TapeParseResult::TapeParseResult(ParseError _error, SourceLocation _location): error_code{_error}, error_location{_location} {};
+
+bool TapeParseResult::has_value() const {
+    return result.has_value();
+}
+
+TapeParseResult::operator bool() const {
+    return result.has_value();
+}
+
+JsonTape& TapeParseResult::operator*() {
+    return *result;
+}
+
+const JsonTape& TapeParseResult::operator*() const {
+    return *result;
+}
+
+JsonTape* TapeParseResult::operator->() {
+    return &*result;
+}
+
+const JsonTape* TapeParseResult::operator->() const {
+    return &*result;
+}
+
+JsonTape& TapeParseResult::value() {
+    if (!result.has_value())
+        throw std::runtime_error(error_message());
+    return *result;
+}
+
+const JsonTape& TapeParseResult::value() const {
+    if (!result.has_value())
+        throw std::runtime_error(error_message());
+    return *result;
+}
+
+TapeParseResult::operator std::optional<JsonTape>() const & {
+    return result;
+}
+
+TapeParseResult::operator std::optional<JsonTape>() && {
+    return std::move(result);
+}
+
+ParseError TapeParseResult::error() const {
+    return error_code;
+}
+
+const SourceLocation& TapeParseResult::location() const {
+    return error_location;
+}
+
+std::string TapeParseResult::error_message() const {
+    return format_error(error_code, error_location);
+}
@@ -0,0 +1,58 @@
+#include "parse_stats.h"
+
+#include <ostream>
+
+ParseStats::ParseStats(const ParseStats& other) {
+    *this = other;
+}
+
+// everything but the counters, which stay with their own stats
+ParseStats& ParseStats::operator=(const ParseStats& other) {
+    bytes_consumed = other.bytes_consumed;
+    buffer_refills = other.buffer_refills;
+    refill_time = other.refill_time;
+    values = other.values;
+    max_depth = other.max_depth;
+    string_bytes_copied = other.string_bytes_copied;
+    string_bytes_escaped = other.string_bytes_escaped;
+    allocations = other.allocations;
+    allocated_bytes = other.allocated_bytes;
+    number_time = other.number_time;
+    return *this;
+}
+
+std::pmr::memory_resource* ParseStats::counting_resource(std::pmr::memory_resource* upstream) {
+    for (Counter& counter: counters) {
+        if (counter.upstream == upstream) return &counter;
+    }
+    Counter& counter = counters.emplace_front();
+    counter.stats = this;
+    counter.upstream = upstream;
+    return &counter;
+}
+
+void* ParseStats::Counter::do_allocate(size_t bytes, size_t alignment) {
+    stats->allocations++;
+    stats->allocated_bytes += bytes;
+    return upstream->allocate(bytes, alignment);
+}
+
+void ParseStats::Counter::do_deallocate(void* block, size_t bytes, size_t alignment) {
+    upstream->deallocate(block, bytes, alignment);
+}
+
+bool ParseStats::Counter::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+std::ostream& operator<<(std::ostream& out, const ParseStats& stats) {
+    out << "bytes consumed: " << stats.bytes_consumed << "\n"
+        << "buffer refills: " << stats.buffer_refills << " in " << stats.refill_time.count() << " ns\n";
+    for (size_t type = 0; type < stats.values.size(); type++)
+        out << JsonValue::TypeNames[type] << " values: " << stats.values[type] << "\n";
+    out << "max depth: " << stats.max_depth << "\n"
+        << "string bytes copied: " << stats.string_bytes_copied << ", escaped: " << stats.string_bytes_escaped << "\n"
+        << "allocations: " << stats.allocations << " of " << stats.allocated_bytes << " bytes\n"
+        << "number conversion: " << stats.number_time.count() << " ns\n";
+    return out;
+}
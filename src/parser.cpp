@@ -1,368 +1,904 @@
 #include "parser.h"
-#include <boost/lexical_cast.hpp>
+#include "mapped_file.h"
+#include "utf8.h"
+#include <algorithm>
+#include <bitset>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Expectations that fail because the input ran out are reported as such.
+template <typename Reader>
+ParseError error_at(const Reader& reader, ParseError error) {
+    return reader ? error : ParseError::UnexpectedEnd;
+}
 
-std::optional<JsonValue> parse(std::istream& input) {
-    std::optional<JsonValue> result;
-    
-    // setup reader
-    BufferReader reader(input);
+// For a number from_chars rejected as out of range, tells a magnitude too large
+// for a double apart from one too small, by where the first significant digit is.
+bool is_overflow(std::string_view text) {
+    long magnitude = 0;
+    bool significant = false;
+    size_t idx = text.front() == JsonConstants::MINUS ? 1 : 0;
+    for (; idx < text.size() && is_digit(text[idx]); idx++) {
+        significant = significant || text[idx] != '0';
+        if (significant) magnitude++;
+    }
+    if (idx < text.size() && text[idx] == JsonConstants::DECIMAL_POINT) {
+        for (idx++; idx < text.size() && is_digit(text[idx]) && !significant; idx++) {
+            significant = text[idx] != '0';
+            if (!significant) magnitude--;
+        }
+        while (idx < text.size() && is_digit(text[idx])) idx++;
+    }
+    if (idx < text.size()) {
+        // exponent, saturated; far more digits than a long holds means far out of range either way
+        idx++;
+        bool negative_exponent = text[idx] == JsonConstants::MINUS;
+        if (text[idx] == JsonConstants::MINUS || text[idx] == JsonConstants::PLUS) idx++;
+        long exponent;
+        if (std::from_chars(text.data() + idx, text.data() + text.size(), exponent).ec != std::errc())
+            exponent = LONG_MAX / 2;
+        magnitude += negative_exponent ? -std::min(exponent, LONG_MAX / 2) : std::min(exponent, LONG_MAX / 2);
+    }
+    return magnitude > 0;
+}
 
-    // consume whitespace
-    consume_whitespace(reader);
+// readers over a contiguous buffer, where runs of bytes can be taken at once
+template <typename Reader>
+constexpr bool is_span_reader = std::is_base_of_v<SpanReader, Reader>;
 
-    // begin parsing
-    if (!reader) 
-        return std::nullopt;
-    
-    // only allowed json file level values are object or array
-    switch(*reader.peek()) {
-        case JsonConstants::OBJECT_START:
-            result = parse_object(reader);
-            break;
-        case JsonConstants::ARRAY_START:
-            result = parse_array(reader);
-            break;
-        default:
-            return std::nullopt;
+// Statistics hooks. They only do something for the StatsReader instantiations
+// and compile to nothing for every other reader.
+template <typename Reader>
+struct collects_stats: std::false_type {};
+
+template <typename Base>
+struct collects_stats<StatsReader<Base>>: std::true_type {};
+
+// a value was parsed into result, returns success
+template <typename Reader>
+ParseError count_value(Reader& reader, const JsonValue& result) {
+    if constexpr (collects_stats<Reader>::value)
+        reader.stats.values[static_cast<size_t>(result.type())]++;
+    return ParseError::None;
+}
+
+template <typename Reader>
+void count_string_bytes(Reader& reader, size_t copied, size_t escaped) {
+    if constexpr (collects_stats<Reader>::value) {
+        reader.stats.string_bytes_copied += copied;
+        reader.stats.string_bytes_escaped += escaped;
     }
-    
-    consume_whitespace(reader);
-    if (reader.next_byte().has_value()) 
-        return std::nullopt;
-    return result;
 }
 
-std::optional<JsonValue> parse_value(BufferReader& reader) {
-    // consume whitespace
-    consume_whitespace(reader);
+// a container was opened, depth containers are open now
+template <typename Reader>
+void note_depth(Reader& reader, size_t depth) {
+    if constexpr (collects_stats<Reader>::value)
+        reader.stats.max_depth = std::max(reader.stats.max_depth, depth);
+}
 
-    try {
-        std::optional<JsonValue> value;
-        switch(reader.throw_peek()) {
-            case JsonConstants::STRING_QUOTE:
-                return parse_string(reader);
-            case JsonConstants::ARRAY_START:
-                return parse_array(reader);
-            case JsonConstants::OBJECT_START:
-                return parse_object(reader);
-            case 't':
-            case 'f':
-                return parse_bool(reader);
-            case 'n':
-                value = parse_null(reader);
-                return value;
-            default:
-                if (isdigit(reader.throw_peek()) || reader.throw_peek() == JsonConstants::MINUS) 
-                    return parse_number(reader);
-                else return std::nullopt;
-        }
-    } catch (std::exception &) {
-        return std::nullopt;
+template <typename Reader>
+ParseError timed_convert_number(Reader& reader, std::string_view text, bool integral, NumberValue& result) {
+    if constexpr (collects_stats<Reader>::value) {
+        auto start = std::chrono::steady_clock::now();
+        ParseError error = convert_number(text, integral, result);
+        reader.stats.number_time += std::chrono::steady_clock::now() - start;
+        return error;
+    } else {
+        return convert_number(text, integral, result);
     }
-}   
-
-std::optional<JsonValue> parse_string(BufferReader& reader) {
-    // consume whitespace
-    std::optional<std::string> str = read_string(reader);
+}
 
-    if (!str.has_value()) return std::nullopt;
-    return JsonValue(*str);
+bool is_control(char c) {
+    return static_cast<unsigned char>(c) < 0x20;
 }
 
-std::optional<JsonValue> parse_number(BufferReader& reader) {
-    // consume whitespace
-    consume_whitespace(reader);
+// Consumes the bytes of a string up to its closing quote, next escape or the
+// first control character, which has to be escaped, or the end of the input,
+// and points run at them. Runs with bytes beyond ASCII are checked to be UTF-8;
+// the reader then stops at the first byte that is not.
+ParseError read_plain_run(SpanReader& reader, std::string_view& run) {
+    std::string_view rest = reader.remaining();
+    size_t length = 0;
+    bool ascii = true;
+    bool stopped = false;
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8(JsonConstants::STRING_QUOTE);
+    const __m128i escape = _mm_set1_epi8(JsonConstants::ESCAPE);
+    const __m128i last_control = _mm_set1_epi8(0x1F);
+    for (; length + 16 <= rest.size(); length += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rest.data() + length));
+        __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(chunk, last_control), chunk);
+        int mask = _mm_movemask_epi8(
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, escape)), control));
+        int high = _mm_movemask_epi8(chunk);
+        if (mask != 0) {
+            // only the bytes before the stop count
+            ascii = ascii && (high & ((mask & -mask) - 1)) == 0;
+            length += __builtin_ctz(mask);
+            stopped = true;
+            break;
+        }
+        ascii = ascii && high == 0;
+    }
+#endif
+    if (!stopped) {
+        while (length < rest.size() && rest[length] != JsonConstants::STRING_QUOTE &&
+               rest[length] != JsonConstants::ESCAPE && !is_control(rest[length])) {
+            ascii = ascii && static_cast<unsigned char>(rest[length]) < 0x80;
+            length++;
+        }
+    }
 
-    // grab the string first
-    std::optional<std::string> num_string = read_num_string(reader);
-    if (!num_string.has_value()) 
-        return std::nullopt;
+    run = rest.substr(0, length);
+    if (!ascii) {
+        size_t valid = find_invalid_utf8(run);
+        if (valid != run.size()) {
+            reader.advance(valid);
+            return ParseError::InvalidUtf8;
+        }
+    }
+    reader.advance(length);
+    return ParseError::None;
+}
 
-    JsonValue result;
+// Consumes the multi-byte sequence whose lead byte is at the reader into
+// sequence, for readers that go byte by byte.
+template <typename Reader>
+ParseError read_utf8_sequence(Reader& reader, char (&sequence)[4], size_t& length) {
+    unsigned char lead = static_cast<unsigned char>(reader.current());
+    length = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : 2;
+    for (size_t idx = 0; idx < length; idx++) {
+        if (idx > 0 && (static_cast<unsigned char>(reader.current()) & 0xC0) != 0x80)
+            return error_at(reader, ParseError::InvalidUtf8);
+        sequence[idx] = reader.current();
+        reader.advance();
+    }
+    // overlong forms, surrogates and values beyond U+10FFFF
+    if (find_invalid_utf8(std::string_view(sequence, length), SimdEngine::Scalar) != length)
+        return ParseError::InvalidUtf8;
+    return ParseError::None;
+}
 
-    try {
-        result.set_value(boost::lexical_cast<double>(*num_string));
-    } catch (boost::bad_lexical_cast &) {
-        return std::nullopt;
+template <typename Reader>
+ParseError read_hex_quad(Reader& reader, uint32_t& value) {
+    value = 0;
+    for (int idx = 0; idx < 4; idx++) {
+        char c = reader.current();
+        if (!is_hex(c))
+            return error_at(reader, ParseError::InvalidEscape);
+        value = value << 4 | (is_digit(c) ? c - '0' : (c | 0x20) - 'a' + 10);
+        reader.advance();
     }
+    return ParseError::None;
+}
 
-    return result;
+void append_utf8(uint32_t code_point, JsonValue::String& result) {
+    if (code_point < 0x80) {
+        result += static_cast<char>(code_point);
+    } else if (code_point < 0x800) {
+        result += static_cast<char>(0xC0 | code_point >> 6);
+        result += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        result += static_cast<char>(0xE0 | code_point >> 12);
+        result += static_cast<char>(0x80 | (code_point >> 6 & 0x3F));
+        result += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else {
+        result += static_cast<char>(0xF0 | code_point >> 18);
+        result += static_cast<char>(0x80 | (code_point >> 12 & 0x3F));
+        result += static_cast<char>(0x80 | (code_point >> 6 & 0x3F));
+        result += static_cast<char>(0x80 | (code_point & 0x3F));
+    }
 }
 
-// see https://www.json.org/fatfree.html
-std::optional<std::string> read_num_string(BufferReader& reader) {
-    std::string result;
-    consume_whitespace(reader);
-    try {
-        // if there is a sign, grab it
-        if (reader.throw_peek() == JsonConstants::MINUS)
-            result += reader.throw_next_byte();
-
-        // grab the decimal part
-        if (!isdigit(reader.throw_peek()))
-            return std::nullopt;
-        else {
-            while(isdigit(reader.throw_peek())) {
-                result += reader.throw_next_byte();
+// Consumes the escape sequence at the reader, a surrogate pair as a whole, and
+// sets code_point to the character it stands for.
+template <typename Reader>
+ParseError decode_escape_sequence(Reader& reader, uint32_t& code_point) {
+    if (reader.current() != JsonConstants::ESCAPE)
+        return error_at(reader, ParseError::InvalidEscape);
+    reader.advance();
+
+    char c = reader.current();
+    switch (c) {
+        case JsonConstants::HEX: {
+            reader.advance();
+            ParseError error = read_hex_quad(reader, code_point);
+            if (error != ParseError::None) return error;
+            if (code_point >= 0xDC00 && code_point <= 0xDFFF)
+                return error_at(reader, ParseError::InvalidEscape);
+            if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+                // a high surrogate, the low one has to follow as an escape too
+                if (reader.current() != JsonConstants::ESCAPE)
+                    return error_at(reader, ParseError::InvalidEscape);
+                reader.advance();
+                if (reader.current() != JsonConstants::HEX)
+                    return error_at(reader, ParseError::InvalidEscape);
+                reader.advance();
+                uint32_t low;
+                error = read_hex_quad(reader, low);
+                if (error != ParseError::None) return error;
+                if (low < 0xDC00 || low > 0xDFFF)
+                    return error_at(reader, ParseError::InvalidEscape);
+                code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
             }
+            return ParseError::None;
         }
+        case JsonConstants::STRING_QUOTE:
+        case JsonConstants::REVERSE_SLASH:
+        case JsonConstants::SLASH:
+            code_point = c;
+            break;
+        case JsonConstants::BACKSPACE: code_point = '\b'; break;
+        case JsonConstants::FORMFEED: code_point = '\f'; break;
+        case JsonConstants::LINEFEED: code_point = '\n'; break;
+        case JsonConstants::RETURN: code_point = '\r'; break;
+        case JsonConstants::TAB: code_point = '\t'; break;
+        default:
+            return error_at(reader, ParseError::InvalidEscape);
+    }
+    reader.advance();
+    return ParseError::None;
+}
 
-        // if there is fractional part, grab it
-        if (reader.throw_peek() == JsonConstants::DECIMAL_POINT) {
-            result += reader.throw_next_byte();
-            if (!isdigit(reader.throw_peek()))
-                return std::nullopt;
-            while(isdigit(reader.throw_peek())) {
-                result += reader.throw_next_byte();
-            }
+// the contents of a string whose opening quote has been consumed, up to and
+// including the closing quote
+template <typename Reader>
+ParseError read_string_contents(Reader& reader, JsonValue::String& result) {
+    while (true) {
+        if constexpr (is_span_reader<Reader>) {
+            std::string_view run;
+            ParseError error = read_plain_run(reader, run);
+            if (error != ParseError::None) return error;
+            result += run;
+            count_string_bytes(reader, run.size(), 0);
         }
 
-        // if there is exponent, grab it
-        if (tolower(reader.throw_peek()) == JsonConstants::EXPONENT_UNCASED) {
-            result += reader.throw_next_byte();
-
-            // if there is sign, grab it
-            if (reader.throw_peek() == JsonConstants::MINUS || reader.throw_peek() == JsonConstants::PLUS)
-                result += reader.throw_next_byte();
+        char c = reader.current();
+        if (c == JsonConstants::ESCAPE) {
+            size_t before = reader.offset();
+            ParseError error = read_escape_sequence(reader, result);
+            if (error != ParseError::None) return error;
+            count_string_bytes(reader, 0, reader.offset() - before);
+        } else if (c == JsonConstants::STRING_QUOTE) {
+            reader.advance();
+            return ParseError::None;
+        } else if (!reader) {
+            return ParseError::UnexpectedEnd;
+        } else if (is_control(c)) {
+            return ParseError::UnexpectedCharacter;
+        } else if (static_cast<unsigned char>(c) >= 0x80) {
+            char sequence[4];
+            size_t length;
+            ParseError error = read_utf8_sequence(reader, sequence, length);
+            if (error != ParseError::None) return error;
+            result.append(sequence, length);
+            count_string_bytes(reader, length, 0);
+        } else {
+            result += c;
+            reader.advance();
+            count_string_bytes(reader, 1, 0);
+        }
+    }
+}
 
-            // grab digits
-            if (!isdigit(reader.throw_peek()))
-                return std::nullopt;
-            
-            while(isdigit(reader.throw_peek())) {
-                result += reader.throw_next_byte();
-            }
+// Reads a string and points text at its contents: into the input when it has no
+// escapes and the reader is over a contiguous buffer, else into scratch, which
+// the string is decoded into. borrowed tells which of the two it is.
+template <typename Reader>
+ParseError read_string_view(Reader& reader, JsonValue::String& scratch, std::string_view& text, bool& borrowed) {
+    borrowed = false;
+    if constexpr (is_span_reader<Reader>) {
+        consume_whitespace(reader);
+        if (reader.current() != JsonConstants::STRING_QUOTE)
+            return error_at(reader, ParseError::UnexpectedCharacter);
+        reader.advance();
+
+        std::string_view run;
+        ParseError error = read_plain_run(reader, run);
+        if (error != ParseError::None) return error;
+        count_string_bytes(reader, run.size(), 0);
+        if (reader.current() == JsonConstants::STRING_QUOTE) {
+            reader.advance();
+            text = run;
+            borrowed = true;
+            return ParseError::None;
         }
-        return result;
-    } catch (std::exception &) {
-        return std::nullopt;
+        scratch.assign(run);
+        error = read_string_contents(reader, scratch);
+        text = scratch;
+        return error;
+    } else {
+        scratch.clear();
+        ParseError error = read_string(reader, scratch);
+        text = scratch;
+        return error;
     }
 }
 
-std::optional<std::string> read_string(BufferReader& reader) {
-    std::string result;
+template <typename Reader>
+ParseResult finish(const Reader& reader, ParseError error, JsonValue&& result) {
+    if (error != ParseError::None)
+        return ParseResult(error, reader.location());
+    return ParseResult(std::move(result));
+}
+
+// Reads a member's key and the separator after it, and points member at the
+// member of object with that key. A repeated key reuses the earlier member.
+template <typename Reader>
+ParseError read_member_key(Reader& reader, JsonValue& object, JsonValue*& member) {
+    consume_whitespace(reader);
+    if (reader.current() != JsonConstants::STRING_QUOTE)
+        return error_at(reader, ParseError::ExpectedKey);
+
+    // grab key, straight from the input where possible; it only lives until
+    // it is interned so the buffer is reused. It outlives any arena a caller
+    // sets as the default resource, so it takes the heap explicitly.
+    thread_local JsonValue::String scratch{std::pmr::new_delete_resource()};
+    std::string_view key;
+    bool borrowed;
+    ParseError error = read_string_view(reader, scratch, key, borrowed);
+    if (error != ParseError::None) return error;
+
+    // read delimiter
     consume_whitespace(reader);
+    if (reader.current() != JsonConstants::KEY_VALUE_SEPARATOR)
+        return error_at(reader, ParseError::ExpectedColon);
+    reader.advance();
 
-    try {
-        if (reader.throw_peek() != JsonConstants::STRING_QUOTE)
-            return std::nullopt;
-        reader.throw_next_byte();
-
-        while(true) {
-            if (reader.throw_peek() == JsonConstants::ESCAPE) {
-                std::optional<std::string> escape_sequence = read_escape_sequence(reader);
-                if (!escape_sequence.has_value()) return std::nullopt;
-                else result += *escape_sequence;
-            } else if (reader.throw_peek() == JsonConstants::STRING_QUOTE) {
-                reader.throw_next_byte();
-                break;
-            } else {
-                result += reader.throw_next_byte();
-            }
-        }
-        return result;
-    } catch (std::exception &) {
-        return std::nullopt;
+    member = &object.at(KeyPool::current().intern(key));
+    return ParseError::None;
+}
+
+// any value but an object or array
+template <typename Reader>
+ParseError parse_scalar(Reader& reader, JsonValue& result) {
+    switch(reader.current()) {
+        case JsonConstants::STRING_QUOTE:
+            return parse_string(reader, result);
+        case 't':
+        case 'f':
+            return parse_bool(reader, result);
+        case 'n':
+            return parse_null(reader, result);
+        default:
+            if (is_digit(reader.current()) || reader.current() == JsonConstants::MINUS)
+                return parse_number(reader, result);
+            return error_at(reader, ParseError::UnexpectedCharacter);
     }
 }
 
-std::optional<std::string> read_escape_sequence(BufferReader& reader) {
-    std::string result;
-    consume_whitespace(reader);
+// The validating counterparts of the grammar functions: they check the same
+// rules in the same order, so they fail with the same error at the same byte,
+// but keep nothing of what they read.
+
+// like read_string_contents
+template <typename Reader>
+ParseError skip_string_contents(Reader& reader) {
+    while (true) {
+        if constexpr (is_span_reader<Reader>) {
+            std::string_view run;
+            ParseError error = read_plain_run(reader, run);
+            if (error != ParseError::None) return error;
+        }
 
-    try {
-        if (reader.throw_peek() != JsonConstants::ESCAPE) return std::nullopt;
-        result += reader.throw_next_byte();
-        switch (reader.throw_peek()) {
-            case JsonConstants::HEX:
-                // read 4 hex
-                result += reader.throw_next_byte();
-                for (int idx = 0; idx < 4; idx++) {
-                    if (is_hex(reader.throw_peek()))
-                        result += reader.throw_next_byte();
-                    else   
-                        return std::nullopt;
-                }
-                break;
-            case JsonConstants::STRING_QUOTE:
-            case JsonConstants::REVERSE_SLASH:
-            case JsonConstants::SLASH:
-            case JsonConstants::BACKSPACE:
-            case JsonConstants::FORMFEED:
-            case JsonConstants::LINEFEED:
-            case JsonConstants::RETURN:
-            case JsonConstants::TAB:
-                result += reader.throw_next_byte();
-                break;
-            default:
-                return std::nullopt;
+        char c = reader.current();
+        if (c == JsonConstants::ESCAPE) {
+            uint32_t code_point;
+            ParseError error = decode_escape_sequence(reader, code_point);
+            if (error != ParseError::None) return error;
+        } else if (c == JsonConstants::STRING_QUOTE) {
+            reader.advance();
+            return ParseError::None;
+        } else if (!reader) {
+            return ParseError::UnexpectedEnd;
+        } else if (is_control(c)) {
+            return ParseError::UnexpectedCharacter;
+        } else if (static_cast<unsigned char>(c) >= 0x80) {
+            char sequence[4];
+            size_t length;
+            ParseError error = read_utf8_sequence(reader, sequence, length);
+            if (error != ParseError::None) return error;
+        } else {
+            reader.advance();
         }
-        return result;
-    } catch (std::exception &) {
-        return std::nullopt;
     }
 }
 
-std::optional<JsonValue> parse_object(BufferReader& reader) {
-    JsonValue result(JsonValue::Type::Object);
-
-    try {
-        // parse object begin
-        if (reader.throw_peek() != JsonConstants::OBJECT_START)
-            return std::nullopt;
-        reader.throw_next_byte();
+// like parse_scalar; numbers are still converted, as one too large for a
+// double fails to parse
+template <typename Reader>
+ParseError skip_scalar(Reader& reader) {
+    switch(reader.current()) {
+        case JsonConstants::STRING_QUOTE:
+            reader.advance();
+            return skip_string_contents(reader);
+        case 't':
+            return read_literal(reader, "true") ? ParseError::None : error_at(reader, ParseError::InvalidLiteral);
+        case 'f':
+            return read_literal(reader, "false") ? ParseError::None : error_at(reader, ParseError::InvalidLiteral);
+        case 'n':
+            return read_literal(reader, "null") ? ParseError::None : error_at(reader, ParseError::InvalidLiteral);
+        default:
+            if (is_digit(reader.current()) || reader.current() == JsonConstants::MINUS) {
+                NumberValue number;
+                return read_number(reader, number);
+            }
+            return error_at(reader, ParseError::UnexpectedCharacter);
+    }
+}
 
-        // whitespace
+// like parse_document and parse_value; the open containers are one bit each,
+// set for an object, so the whole stack fits in a few words
+template <typename Reader>
+ParseError validate_document(Reader& reader) {
+    consume_whitespace(reader);
+    if (!reader)
+        return ParseError::EmptyDocument;
+    if (reader.current() != JsonConstants::OBJECT_START && reader.current() != JsonConstants::ARRAY_START)
+        return ParseError::InvalidRoot;
+
+    std::bitset<DEFAULT_MAX_DEPTH> objects;
+    size_t depth = 0;
+    do {
         consume_whitespace(reader);
+        char c = reader.current();
+        bool opened = c == JsonConstants::OBJECT_START || c == JsonConstants::ARRAY_START;
+        if (opened) {
+            if (depth >= DEFAULT_MAX_DEPTH)
+                return ParseError::TooDeep;
+            reader.advance();
+            objects[depth++] = c == JsonConstants::OBJECT_START;
+        } else {
+            ParseError error = skip_scalar(reader);
+            if (error != ParseError::None) return error;
+        }
+
+        while (depth > 0) {
+            bool object = objects[depth - 1];
+            consume_whitespace(reader);
+            if (reader.current() == (object ? JsonConstants::OBJECT_END : JsonConstants::ARRAY_END)) {
+                reader.advance();
+                depth--;
+                opened = false;
+                continue;
+            }
+
+            if (!opened) {
+                if (reader.current() != JsonConstants::COMMA)
+                    return error_at(reader, object ? ParseError::ExpectedCommaOrObjectEnd : ParseError::ExpectedCommaOrArrayEnd);
+                reader.advance();
+            }
+            if (object) {
+                consume_whitespace(reader);
+                if (reader.current() != JsonConstants::STRING_QUOTE)
+                    return error_at(reader, ParseError::ExpectedKey);
+                reader.advance();
+                ParseError error = skip_string_contents(reader);
+                if (error != ParseError::None) return error;
 
-        // if there is string key-value pair, grab it and enter loop
-        if (reader.throw_peek() == JsonConstants::STRING_QUOTE) {
-            std::optional<std::pair<std::string, JsonValue>> kv = read_key_value_pair(reader);
-            if (!kv.has_value()) return std::nullopt;
-            result.set_index(kv->first, kv->second);
-            
-            while(true) {
                 consume_whitespace(reader);
-                if (reader.throw_peek() == JsonConstants::COMMA) {
-                    reader.throw_next_byte();
-                    consume_whitespace(reader);
-
-                    std::optional<std::pair<std::string, JsonValue>> kv = read_key_value_pair(reader);
-                    if (!kv.has_value()) return std::nullopt;
-                    result.set_index(kv->first, kv->second);
-                } else if (reader.throw_peek() == JsonConstants::OBJECT_END) {
-                    break;
-                } else return std::nullopt;
+                if (reader.current() != JsonConstants::KEY_VALUE_SEPARATOR)
+                    return error_at(reader, ParseError::ExpectedColon);
+                reader.advance();
             }
+            break;
         }
+    } while (depth > 0);
 
-        consume_whitespace(reader);
-        if (reader.throw_peek() != JsonConstants::OBJECT_END)
-            return std::nullopt;
-        reader.throw_next_byte();
+    consume_whitespace(reader);
+    if (reader)
+        return ParseError::TrailingCharacters;
+    return ParseError::None;
+}
 
-        return result;
+} // namespace
 
-    
-    } catch (std::exception &) {
-        return std::nullopt;
-    }
+ParseResult parse(std::istream& input, std::pmr::memory_resource* resource) {
+    return parse(input, ParseOptions(), resource);
 }
 
-std::optional<JsonValue> parse_array(BufferReader& reader) {
-    try {
-        consume_whitespace(reader);
+ParseResult parse(std::string_view input, std::pmr::memory_resource* resource) {
+    return parse(input, ParseOptions(), resource);
+}
+
+ParseResult parse(std::istream& input, const ParseOptions& options, std::pmr::memory_resource* resource) {
+    BufferReader reader(input);
+    JsonValue result{JsonValue::allocator_type(resource)};
+    ParseError error = parse_document(reader, result, options.max_depth);
+    if (error != ParseError::None && reader.status() == BufferReader::Status::FAIL)
+        error = ParseError::IoError;
+    return finish(reader, error, std::move(result));
+}
+
+ParseResult parse(std::string_view input, const ParseOptions& options, std::pmr::memory_resource* resource) {
+    SpanReader reader(input);
+    JsonValue result{JsonValue::allocator_type(resource)};
+    ParseError error = parse_document(reader, result, options.max_depth);
+    return finish(reader, error, std::move(result));
+}
+
+ParseResult parse(std::istream& input, ParseStats& stats, std::pmr::memory_resource* resource) {
+    // the first fill happens as the reader is built
+    auto start = std::chrono::steady_clock::now();
+    StatsReader<BufferReader> reader(stats, input);
+    stats.buffer_refills++;
+    stats.refill_time += std::chrono::steady_clock::now() - start;
+
+    JsonValue result{JsonValue::allocator_type(stats.counting_resource(resource))};
+    ParseError error = parse_document(reader, result);
+    if (error != ParseError::None && reader.status() == BufferReader::Status::FAIL)
+        error = ParseError::IoError;
+    stats.bytes_consumed += reader.offset();
+    return finish(reader, error, std::move(result));
+}
+
+ParseResult parse(std::string_view input, ParseStats& stats, std::pmr::memory_resource* resource) {
+    StatsReader<SpanReader> reader(stats, input);
+    JsonValue result{JsonValue::allocator_type(stats.counting_resource(resource))};
+    ParseError error = parse_document(reader, result);
+    stats.bytes_consumed += reader.offset();
+    return finish(reader, error, std::move(result));
+}
+
+ParseResult parse_borrowed(std::string_view input, std::pmr::memory_resource* resource) {
+    BorrowingReader reader(input);
+    JsonValue result{JsonValue::allocator_type(resource)};
+    ParseError error = parse_document(reader, result);
+    return finish(reader, error, std::move(result));
+}
 
-        // consume beginning of array
-        if (reader.throw_peek() != JsonConstants::ARRAY_START)
-            return std::nullopt;
-        reader.throw_next_byte();
+ParseResult parse_file(const std::string& path, std::pmr::memory_resource* resource) {
+    return parse_file(path, ParseOptions(), resource);
+}
+
+ParseResult parse_file(const std::string& path, const ParseOptions& options, std::pmr::memory_resource* resource) {
+    MappedFile file(path);
+    if (!file)
+        return ParseResult(ParseError::IoError, SourceLocation());
+    return parse(file.view(), options, resource);
+}
+
+ParseStatus validate(std::string_view input) {
+    SpanReader reader(input);
+    ParseError error = validate_document(reader);
+    if (error != ParseError::None)
+        return ParseStatus{error, reader.location()};
+    return ParseStatus();
+}
+
+ParseStatus validate(std::istream& input) {
+    BufferReader reader(input);
+    ParseError error = validate_document(reader);
+    if (error != ParseError::None && reader.status() == BufferReader::Status::FAIL)
+        error = ParseError::IoError;
+    if (error != ParseError::None)
+        return ParseStatus{error, reader.location()};
+    return ParseStatus();
+}
+
+template <typename Reader>
+ParseError parse_document(Reader& reader, JsonValue& result, size_t max_depth) {
+    // consume whitespace
+    consume_whitespace(reader);
 
-        JsonValue result(JsonValue::Type::Array);
+    // begin parsing
+    if (!reader) 
+        return ParseError::EmptyDocument;
     
+    // only allowed json file level values are object or array
+    ParseError error;
+    switch(reader.current()) {
+        case JsonConstants::OBJECT_START:
+            error = parse_object(reader, result, max_depth);
+            break;
+        case JsonConstants::ARRAY_START:
+            error = parse_array(reader, result, max_depth);
+            break;
+        default:
+            return ParseError::InvalidRoot;
+    }
+    if (error != ParseError::None)
+        return error;
+    
+    consume_whitespace(reader);
+    if (reader) 
+        return ParseError::TrailingCharacters;
+    return ParseError::None;
+}
+
+// Objects and arrays are parsed without recursion: the open ones are kept on
+// an explicit stack, innermost last, and every value is parsed straight into
+// its final place. Only the innermost container grows, so the pointers to the
+// ones around it stay valid.
+template <typename Reader>
+ParseError parse_value(Reader& reader, JsonValue& result, size_t max_depth) {
+    std::vector<JsonValue*> stack;
+    JsonValue* slot = &result;
+
+    while (true) {
+        // the value for slot
         consume_whitespace(reader);
+        char c = reader.current();
+        bool opened = c == JsonConstants::OBJECT_START || c == JsonConstants::ARRAY_START;
+        if (opened) {
+            if (stack.size() >= max_depth)
+                return ParseError::TooDeep;
+            reader.advance();
+            slot->set_type(c == JsonConstants::OBJECT_START ? JsonValue::Type::Object : JsonValue::Type::Array);
+            stack.push_back(slot);
+            note_depth(reader, stack.size());
+        } else {
+            ParseError error = parse_scalar(reader, *slot);
+            if (error != ParseError::None) return error;
+        }
 
-        // if next thing is not array end, try to parse it as a value
+        // close the containers that are complete, then find the slot of the
+        // next member or element
+        while (!stack.empty()) {
+            JsonValue& container = *stack.back();
+            bool object = container.type() == JsonValue::Type::Object;
+            consume_whitespace(reader);
+            if (reader.current() == (object ? JsonConstants::OBJECT_END : JsonConstants::ARRAY_END)) {
+                reader.advance();
+                count_value(reader, container);
+                stack.pop_back();
+                opened = false;
+                continue;
+            }
 
-        if (reader.throw_peek() != JsonConstants::ARRAY_END) {
-            std::optional<JsonValue> value = parse_value(reader);
-            if (!value.has_value()) return std::nullopt;
-            result.push_back(*value);
-            
-            while(true) {
-                consume_whitespace(reader);
-                if (reader.throw_peek() == JsonConstants::COMMA) {
-                    reader.throw_next_byte();
-                    consume_whitespace(reader);
-                    value = parse_value(reader);
-                    if (!value.has_value()) return std::nullopt;
-                    result.push_back(*value);
-                } else if (reader.throw_peek() == JsonConstants::ARRAY_END) {
-                    break;
-                } else return std::nullopt;
+            // no comma before the first member or element
+            if (!opened) {
+                if (reader.current() != JsonConstants::COMMA)
+                    return error_at(reader, object ? ParseError::ExpectedCommaOrObjectEnd : ParseError::ExpectedCommaOrArrayEnd);
+                reader.advance();
             }
+            if (object) {
+                ParseError error = read_member_key(reader, container, slot);
+                if (error != ParseError::None) return error;
+            } else {
+                slot = &container.emplace_back();
+            }
+            break;
         }
-        
-        consume_whitespace(reader); 
-        if (reader.throw_peek() != JsonConstants::ARRAY_END) return std::nullopt;
-        reader.throw_next_byte();
-
-        return result;
-    } catch (std::exception &) {
-        return std::nullopt;
+        if (stack.empty())
+            return ParseError::None;
     }
 }
 
-std::optional<JsonValue> parse_bool(BufferReader& reader) {
-    try {
-        consume_whitespace(reader);
-        if (reader.throw_peek() == 't') {
-            if (reader.throw_next_byte() != 't' ||
-                reader.throw_next_byte() != 'r' ||
-                reader.throw_next_byte() != 'u' ||
-                reader.throw_next_byte() != 'e')
-                return std::nullopt;
-            return true;
-        } else if (reader.throw_peek() == 'f') {
-            if (reader.throw_next_byte() != 'f' ||
-                reader.throw_next_byte() != 'a' ||
-                reader.throw_next_byte() != 'l' ||
-                reader.throw_next_byte() != 's' ||
-                reader.throw_next_byte() != 'e')
-                return std::nullopt;
-            return false;
-        } else return std::nullopt;
-    } catch (std::exception &) {
-        return std::nullopt;
+template <typename Reader>
+ParseError parse_string(Reader& reader, JsonValue& result) {
+    JsonValue::String str(result.get_allocator());
+    if constexpr (std::is_same_v<Reader, BorrowingReader>) {
+        std::string_view text;
+        bool borrowed;
+        ParseError error = read_string_view(reader, str, text, borrowed);
+        if (error != ParseError::None) return error;
+        if (borrowed) {
+            result.borrow_string(text);
+            return count_value(reader, result);
+        }
+    } else {
+        ParseError error = read_string(reader, str);
+        if (error != ParseError::None) return error;
     }
+
+    result.set_value(std::move(str));
+    return count_value(reader, result);
 }
 
-std::optional<JsonValue> parse_null(BufferReader& reader) {
-    try {
-        consume_whitespace(reader);
-        if (reader.throw_peek() == 'n') {
-            if (reader.throw_next_byte() != 'n' ||
-                reader.throw_next_byte() != 'u' ||
-                reader.throw_next_byte() != 'l' ||
-                reader.throw_next_byte() != 'l')
-                return std::nullopt;
-
-            std::optional<JsonValue> value(JsonValue(nullptr));
-            return value;
-        } else return std::nullopt;
-    } catch (std::exception &) {
-        return std::nullopt;
+template <typename Reader>
+ParseError parse_number(Reader& reader, JsonValue& result) {
+    NumberValue number;
+    ParseError error = read_number(reader, number);
+    if (error != ParseError::None) 
+        return error;
+
+    std::visit([&](auto held) { result.set_value(held); }, number);
+    return count_value(reader, result);
+}
+
+template <typename Reader>
+ParseError read_number(Reader& reader, NumberValue& result) {
+    // consume whitespace
+    consume_whitespace(reader);
+
+    bool integral;
+    if constexpr (is_span_reader<Reader>) {
+        // the digits are converted where they are, nothing is copied
+        const char* start = reader.position();
+        ParseError error = read_num_string(reader, nullptr, integral);
+        if (error != ParseError::None) 
+            return error;
+        return timed_convert_number(reader, std::string_view(start, reader.position() - start), integral, result);
+    } else {
+        // collected on the stack, only a number of more than 255 characters
+        // spills to the heap
+        char buffer[256];
+        std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+        JsonValue::String text(&arena);
+        text.reserve(sizeof(buffer) - 1);
+        ParseError error = read_num_string(reader, &text, integral);
+        if (error != ParseError::None) 
+            return error;
+        return timed_convert_number(reader, text, integral, result);
     }
 }
 
-std::optional<std::pair<std::string, JsonValue>> read_key_value_pair(BufferReader& reader) {
+// see https://www.json.org/fatfree.html
+template <typename Reader>
+ParseError read_num_string(Reader& reader, JsonValue::String* text, bool& integral) {
+    auto take = [&]() {
+        if (text) text->push_back(reader.current());
+        reader.advance();
+    };
+    integral = true;
+
+    // if there is a sign, grab it
+    if (reader.current() == JsonConstants::MINUS)
+        take();
+
+    // grab the decimal part
+    if (!is_digit(reader.current()))
+        return error_at(reader, ParseError::InvalidNumber);
+    while (is_digit(reader.current()))
+        take();
+
+    // if there is fractional part, grab it
+    if (reader.current() == JsonConstants::DECIMAL_POINT) {
+        integral = false;
+        take();
+        if (!is_digit(reader.current()))
+            return error_at(reader, ParseError::InvalidNumber);
+        while (is_digit(reader.current()))
+            take();
+    }
+
+    // if there is exponent, grab it
+    if (tolower(reader.current()) == JsonConstants::EXPONENT_UNCASED) {
+        integral = false;
+        take();
+
+        // if there is sign, grab it
+        if (reader.current() == JsonConstants::MINUS || reader.current() == JsonConstants::PLUS)
+            take();
+
+        // grab digits
+        if (!is_digit(reader.current()))
+            return error_at(reader, ParseError::InvalidNumber);
+        while (is_digit(reader.current()))
+            take();
+    }
+    return ParseError::None;
+}
+
+ParseError convert_number(std::string_view text, bool integral, NumberValue& result) {
+    const char* first = text.data();
+    const char* last = text.data() + text.size();
+    bool negative = text.front() == JsonConstants::MINUS;
+
+    // integers are kept exact as long as they fit, -0 has to stay a double to
+    // keep its sign
+    if (integral && negative) {
+        int64_t number;
+        auto [end, ec] = std::from_chars(first, last, number);
+        if (ec == std::errc() && number != 0) {
+            result = number;
+            return ParseError::None;
+        }
+    } else if (integral) {
+        uint64_t number;
+        auto [end, ec] = std::from_chars(first, last, number);
+        if (ec == std::errc()) {
+            result = number;
+            return ParseError::None;
+        }
+    }
+
+    // correctly rounded and independent of the locale
+    double number;
+    auto [end, ec] = std::from_chars(first, last, number);
+    if (ec == std::errc::result_out_of_range) {
+        // only overflow is an error, underflow rounds to zero
+        if (is_overflow(text))
+            return ParseError::InvalidNumber;
+        number = negative ? -0.0 : 0.0;
+    } else if (ec != std::errc() || end != last)
+        return ParseError::InvalidNumber;
+
+    result = number;
+    return ParseError::None;
+}
+
+template <typename Reader>
+ParseError read_string(Reader& reader, JsonValue::String& result) {
     consume_whitespace(reader);
-    try {
-        if (reader.throw_peek() == JsonConstants::STRING_QUOTE) {
-            // grab key-value pair
-            std::optional<std::string> key = read_string(reader);
-            if (!key.has_value()) return std::nullopt;
-            
-            // read delimiter
-            consume_whitespace(reader);
-            if (reader.throw_peek() != JsonConstants::KEY_VALUE_SEPARATOR) return std::nullopt;
-            reader.throw_next_byte();
 
-            // read value
-            consume_whitespace(reader);
-            std::optional<JsonValue> value = parse_value(reader);
-            if (!value.has_value()) return std::nullopt;
+    if (reader.current() != JsonConstants::STRING_QUOTE)
+        return error_at(reader, ParseError::UnexpectedCharacter);
+    reader.advance();
+    return read_string_contents(reader, result);
+}
+
+template <typename Reader>
+ParseError read_escape_sequence(Reader& reader, JsonValue::String& result) {
+    uint32_t code_point;
+    ParseError error = decode_escape_sequence(reader, code_point);
+    if (error != ParseError::None) return error;
+    append_utf8(code_point, result);
+    return ParseError::None;
+}
+
+template <typename Reader>
+ParseError parse_object(Reader& reader, JsonValue& result, size_t max_depth) {
+    if (reader.current() != JsonConstants::OBJECT_START)
+        return error_at(reader, ParseError::UnexpectedCharacter);
+    return parse_value(reader, result, max_depth);
+}
+
+template <typename Reader>
+ParseError parse_array(Reader& reader, JsonValue& result, size_t max_depth) {
+    consume_whitespace(reader);
+    if (reader.current() != JsonConstants::ARRAY_START)
+        return error_at(reader, ParseError::UnexpectedCharacter);
+    return parse_value(reader, result, max_depth);
+}
+
+template <typename Reader>
+ParseError parse_bool(Reader& reader, JsonValue& result) {
+    consume_whitespace(reader);
+    if (reader.current() == 't') {
+        if (!read_literal(reader, "true"))
+            return error_at(reader, ParseError::InvalidLiteral);
+        result.set_value(true);
+        return count_value(reader, result);
+    } else if (reader.current() == 'f') {
+        if (!read_literal(reader, "false"))
+            return error_at(reader, ParseError::InvalidLiteral);
+        result.set_value(false);
+        return count_value(reader, result);
+    } else return error_at(reader, ParseError::InvalidLiteral);
+}
+
+template <typename Reader>
+ParseError parse_null(Reader& reader, JsonValue& result) {
+    consume_whitespace(reader);
+    if (!read_literal(reader, "null"))
+        return error_at(reader, ParseError::InvalidLiteral);
+    result.set_type(JsonValue::Type::Null);
+    return count_value(reader, result);
+}
+
+template <typename Reader>
+ParseError read_key_value_pair(Reader& reader, JsonValue& object, size_t max_depth) {
+    // read value straight into the member, a repeated key overwrites the earlier one
+    JsonValue* member;
+    ParseError error = read_member_key(reader, object, member);
+    if (error != ParseError::None) return error;
+    return parse_value(reader, *member, max_depth);
+}
 
-            return std::pair(*key, *value);
-        } else return std::nullopt;
-    } catch (std::exception &e) {
-        return std::nullopt;
+template <typename Reader>
+bool read_literal(Reader& reader, std::string_view literal) {
+    for (char c: literal) {
+        if (reader.current() != c) return false;
+        reader.advance();
     }
-}   
+    return true;
+}
 
-void consume_whitespace(BufferReader& reader) {
-    while(reader && is_whitespace(reader.peek())) {
-        reader.next_byte();
+template <typename Reader>
+void consume_whitespace(Reader& reader) {
+    while (is_whitespace(reader.current())) {
+        reader.advance();
     }
 }
 
@@ -374,6 +910,33 @@ bool is_whitespace(std::optional<char> c) {
     return c.has_value() && is_whitespace(*c);
 }
 
+bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
 bool is_hex(char c) {
     return std::isxdigit(static_cast<unsigned char>(c));
-}
\ No newline at end of file
+}
+
+#define INSTANTIATE_PARSER(Reader) \
+    template ParseError parse_document<Reader>(Reader&, JsonValue&, size_t); \
+    template ParseError parse_value<Reader>(Reader&, JsonValue&, size_t); \
+    template ParseError parse_bool<Reader>(Reader&, JsonValue&); \
+    template ParseError parse_null<Reader>(Reader&, JsonValue&); \
+    template ParseError parse_string<Reader>(Reader&, JsonValue&); \
+    template ParseError parse_number<Reader>(Reader&, JsonValue&); \
+    template ParseError parse_object<Reader>(Reader&, JsonValue&, size_t); \
+    template ParseError parse_array<Reader>(Reader&, JsonValue&, size_t); \
+    template ParseError read_number<Reader>(Reader&, NumberValue&); \
+    template ParseError read_num_string<Reader>(Reader&, JsonValue::String*, bool&); \
+    template ParseError read_string<Reader>(Reader&, JsonValue::String&); \
+    template ParseError read_escape_sequence<Reader>(Reader&, JsonValue::String&); \
+    template ParseError read_key_value_pair<Reader>(Reader&, JsonValue&, size_t); \
+    template bool read_literal<Reader>(Reader&, std::string_view); \
+    template void consume_whitespace<Reader>(Reader&);
+
+INSTANTIATE_PARSER(BufferReader)
+INSTANTIATE_PARSER(SpanReader)
+INSTANTIATE_PARSER(BorrowingReader)
+INSTANTIATE_PARSER(StatsReader<BufferReader>)
+INSTANTIATE_PARSER(StatsReader<SpanReader>)
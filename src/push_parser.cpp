@@ -0,0 +1,333 @@
+#include "push_parser.h"
+#include "parser.h"
+#include "utf8.h"
+
+namespace {
+
+bool is_number_char(char c) {
+    return is_digit(c) || c == JsonConstants::MINUS || c == JsonConstants::PLUS ||
+           c == JsonConstants::DECIMAL_POINT || c == 'e' || c == 'E';
+}
+
+bool is_escape_char(char c) {
+    return std::string_view("\"\\/bfnrtu").find(c) != std::string_view::npos;
+}
+
+// \x, \uXXXX, or \uXXXX\uXXXX when the first one is a high surrogate
+size_t escape_length(std::string_view token) {
+    if (token[1] != JsonConstants::HEX) return 2;
+    if (token.size() < 6) return 6;
+    bool high_surrogate = (token[2] | 0x20) == 'd' && std::string_view("89abAB").find(token[3]) != std::string_view::npos;
+    return high_surrogate ? 12 : 6;
+}
+
+// where a multi-byte sequence cut off at the end of text starts, text.size()
+// if the last one is complete
+size_t complete_prefix(std::string_view text) {
+    for (size_t back = 1; back <= std::min<size_t>(3, text.size()); back++) {
+        unsigned char c = static_cast<unsigned char>(text[text.size() - back]);
+        if ((c & 0xC0) == 0x80) continue;
+        size_t length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        return length > back ? text.size() - back : text.size();
+    }
+    return text.size();
+}
+
+} // namespace
+
+PushParser::PushParser(std::pmr::memory_resource* _resource)
+    : resource{_resource}, root{JsonValue::allocator_type(_resource)}, slot{&root} {};
+
+PushParser::PushParser(const ParseOptions& options, std::pmr::memory_resource* _resource)
+    : resource{_resource}, max_depth{options.max_depth}, root{JsonValue::allocator_type(_resource)}, slot{&root} {};
+
+PushParser::Status PushParser::feed(std::string_view data) {
+    return feed(data.data(), data.size());
+}
+
+PushParser::Status PushParser::feed(const char* data, size_t size) {
+    std::string_view input(data, size);
+    size_t pos = 0;
+    while (pos < input.size() && state != State::Done && state != State::Failed) {
+        std::string_view rest = input.substr(pos);
+        size_t used;
+        switch (state) {
+            case State::String: used = read_string(rest); break;
+            case State::Escape: used = read_escape(rest); break;
+            case State::Number: used = read_number(rest); break;
+            case State::Literal: used = read_literal(rest); break;
+            default:
+                if (is_whitespace(rest.front())) {
+                    if (rest.front() == '\n') {
+                        line++;
+                        line_start = offset + 1;
+                    }
+                    used = 1;
+                } else used = step(rest);
+        }
+        pos += used;
+        offset += used;
+    }
+    last_consumed = pos;
+    return status();
+}
+
+PushParser::Status PushParser::finish() {
+    if (state == State::Root)
+        fail(ParseError::EmptyDocument, 0);
+    else if (state != State::Done && state != State::Failed)
+        fail(ParseError::UnexpectedEnd, 0);
+    return status();
+}
+
+PushParser::Status PushParser::status() const {
+    switch (state) {
+        case State::Done: return Status::ValueComplete;
+        case State::Failed: return Status::Error;
+        default: return Status::NeedMoreData;
+    }
+}
+
+size_t PushParser::consumed() const {
+    return last_consumed;
+}
+
+ParseResult PushParser::take() {
+    finish();
+    ParseResult result = state == State::Done ? ParseResult(std::move(root)) : ParseResult(error, error_location);
+    reset();
+    return result;
+}
+
+void PushParser::reset() {
+    // keeps the resource, assignment never changes it
+    root = JsonValue(nullptr, JsonValue::allocator_type(resource));
+    stack.clear();
+    slot = &root;
+    state = State::Root;
+    text.clear();
+    checked = 0;
+    token.clear();
+    error = ParseError::None;
+    error_location = SourceLocation();
+    offset = 0;
+    line = 1;
+    line_start = 0;
+}
+
+size_t PushParser::step(std::string_view input) {
+    char c = input.front();
+    switch (state) {
+        case State::Root:
+            if (c != JsonConstants::OBJECT_START && c != JsonConstants::ARRAY_START)
+                return fail(ParseError::InvalidRoot, 0);
+            return start_value(input);
+        case State::FirstElement:
+            if (c == JsonConstants::ARRAY_END)
+                return close_container(c);
+            [[fallthrough]];
+        case State::Element:
+            slot = &stack.back()->emplace_back();
+            return start_value(input);
+        case State::FirstKey:
+            if (c == JsonConstants::OBJECT_END)
+                return close_container(c);
+            [[fallthrough]];
+        case State::Key:
+            if (c != JsonConstants::STRING_QUOTE)
+                return fail(ParseError::ExpectedKey, 0);
+            in_key = true;
+            text.clear();
+            checked = 0;
+            state = State::String;
+            return 1;
+        case State::Colon:
+            if (c != JsonConstants::KEY_VALUE_SEPARATOR)
+                return fail(ParseError::ExpectedColon, 0);
+            state = State::MemberValue;
+            return 1;
+        case State::MemberValue:
+            return start_value(input);
+        case State::AfterValue:
+            if (c == JsonConstants::COMMA) {
+                state = stack.back()->type() == JsonValue::Type::Object ? State::Key : State::Element;
+                return 1;
+            }
+            return close_container(c);
+        default:
+            return 0;
+    }
+}
+
+size_t PushParser::start_value(std::string_view input) {
+    switch (input.front()) {
+        case JsonConstants::OBJECT_START:
+            if (stack.size() >= max_depth)
+                return fail(ParseError::TooDeep, 0);
+            slot->set_type(JsonValue::Type::Object);
+            stack.push_back(slot);
+            state = State::FirstKey;
+            return 1;
+        case JsonConstants::ARRAY_START:
+            if (stack.size() >= max_depth)
+                return fail(ParseError::TooDeep, 0);
+            slot->set_type(JsonValue::Type::Array);
+            stack.push_back(slot);
+            state = State::FirstElement;
+            return 1;
+        case JsonConstants::STRING_QUOTE:
+            in_key = false;
+            text.clear();
+            checked = 0;
+            state = State::String;
+            return 1;
+        case 't':
+            literal = "true";
+            break;
+        case 'f':
+            literal = "false";
+            break;
+        case 'n':
+            literal = "null";
+            break;
+        default:
+            if (input.front() != JsonConstants::MINUS && !is_digit(input.front()))
+                return fail(ParseError::UnexpectedCharacter, 0);
+            token.clear();
+            state = State::Number;
+            return 0;
+    }
+    token.clear();
+    state = State::Literal;
+    return 0;
+}
+
+size_t PushParser::read_string(std::string_view input) {
+    size_t end = 0;
+    while (end < input.size() && input[end] != JsonConstants::STRING_QUOTE && input[end] != JsonConstants::ESCAPE &&
+           static_cast<unsigned char>(input[end]) >= 0x20)
+        end++;
+    text.append(input.substr(0, end));
+
+    // a sequence split between two pieces is checked once it is whole
+    bool closed = end < input.size() && input[end] == JsonConstants::STRING_QUOTE;
+    size_t boundary = closed ? text.size() : complete_prefix(text);
+    std::string_view unchecked = std::string_view(text).substr(checked, boundary - checked);
+    size_t valid = find_invalid_utf8(unchecked);
+    if (valid != unchecked.size()) {
+        // the offending byte may have come with an earlier piece
+        size_t in_text = checked + valid, piece_start = text.size() - end;
+        return fail(ParseError::InvalidUtf8, in_text > piece_start ? in_text - piece_start : 0);
+    }
+    checked = boundary;
+
+    if (end == input.size())
+        return end;
+
+    if (input[end] == JsonConstants::ESCAPE) {
+        token.assign(1, JsonConstants::ESCAPE);
+        state = State::Escape;
+        return end + 1;
+    }
+    if (!closed)
+        return fail(ParseError::UnexpectedCharacter, end);
+
+    if (in_key) {
+        slot = &stack.back()->at(KeyPool::current().intern(text));
+        state = State::Colon;
+    } else {
+        slot->set_value(JsonValue::String(text, slot->get_allocator()));
+        end_value();
+    }
+    return end + 1;
+}
+
+size_t PushParser::read_escape(std::string_view input) {
+    size_t used = 0;
+    while (used < input.size()) {
+        char c = input[used];
+        size_t at = token.size();
+        bool valid = at == 1 ? is_escape_char(c)
+                   : at == 6 ? c == JsonConstants::ESCAPE
+                   : at == 7 ? c == JsonConstants::HEX
+                   : is_hex(c);
+        if (!valid)
+            return fail(ParseError::InvalidEscape, used);
+        token += c;
+        used++;
+
+        if (token.size() == escape_length(token)) {
+            // complete, decoded the same way parse() does, which also rejects
+            // unpaired surrogates
+            SpanReader reader(token);
+            if (read_escape_sequence(reader, text) != ParseError::None)
+                return fail(ParseError::InvalidEscape, used - 1);
+            state = State::String;
+            return used;
+        }
+    }
+    return used;
+}
+
+size_t PushParser::read_number(std::string_view input) {
+    size_t used = 0;
+    while (used < input.size() && is_number_char(input[used]))
+        used++;
+    token.append(input.substr(0, used));
+    // the root is a container, so a number always ends before the input does
+    if (used == input.size())
+        return used;
+
+    SpanReader reader(token);
+    bool integral = false;
+    NumberValue number;
+    ParseError error = read_num_string(reader, nullptr, integral);
+    if (error == ParseError::None && reader)
+        error = ParseError::InvalidNumber;
+    if (error == ParseError::None)
+        error = convert_number(token, integral, number);
+    if (error != ParseError::None)
+        return fail(ParseError::InvalidNumber, used);
+
+    std::visit([&](auto held) { slot->set_value(held); }, number);
+    end_value();
+    return used;
+}
+
+size_t PushParser::read_literal(std::string_view input) {
+    size_t used = 0;
+    while (used < input.size() && token.size() < literal.size()) {
+        if (input[used] != literal[token.size()])
+            return fail(ParseError::InvalidLiteral, used);
+        token += input[used++];
+    }
+    if (token.size() < literal.size())
+        return used;
+
+    if (literal == "null") slot->set_type(JsonValue::Type::Null);
+    else slot->set_value(literal == "true");
+    end_value();
+    return used;
+}
+
+size_t PushParser::close_container(char c) {
+    bool object = stack.back()->type() == JsonValue::Type::Object;
+    if (c != (object ? JsonConstants::OBJECT_END : JsonConstants::ARRAY_END))
+        return fail(object ? ParseError::ExpectedCommaOrObjectEnd : ParseError::ExpectedCommaOrArrayEnd, 0);
+    stack.pop_back();
+    end_value();
+    return 1;
+}
+
+void PushParser::end_value() {
+    state = stack.empty() ? State::Done : State::AfterValue;
+}
+
+size_t PushParser::fail(ParseError _error, size_t at) {
+    error = _error;
+    error_location.offset = offset + at;
+    error_location.line = line;
+    error_location.column = offset + at - line_start + 1;
+    state = State::Failed;
+    return at;
+}
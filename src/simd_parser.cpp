@@ -0,0 +1,200 @@
+#include "parser.h"
+#include "structural_index.h"
+
+namespace {
+
+// Stage two. Containers are handled by walking the structural index directly.
+// Scalars are handed to the regular grammar functions through a SpanReader
+// positioned on them, after which only whitespace may remain before the next
+// structural; that is what rejects inputs like [1x] or ["a"b].
+struct IndexWalker {
+    std::string_view input;
+    const uint32_t* cur;
+    const uint32_t* end;
+    // first error hit and the input offset it was hit at
+    ParseError error = ParseError::None;
+    size_t error_offset = 0;
+    // open objects and arrays, limited like parse() limits them
+    size_t depth = 0;
+
+    bool done() const {
+        return cur == end;
+    }
+
+    char peek() const {
+        return input[*cur];
+    }
+
+    // where the structural after the current one starts, or the end of input
+    const char* following_position() const {
+        return cur + 1 == end ? input.data() + input.size() : input.data() + cur[1];
+    }
+
+    SpanReader reader_at_current() const {
+        return SpanReader(input.data() + *cur, input.data() + input.size());
+    }
+
+    bool fail(ParseError _error) {
+        return done() ? fail_at(ParseError::UnexpectedEnd, input.size()) : fail_at(_error, *cur);
+    }
+
+    bool fail_at(ParseError _error, size_t offset) {
+        error = _error;
+        error_offset = offset;
+        return false;
+    }
+
+    // separator_error is reported if something other than whitespace and the
+    // next structural follows a scalar
+    bool walk_value(JsonValue& result, ParseError separator_error);
+    bool walk_object(JsonValue& result);
+    bool walk_array(JsonValue& result);
+    bool walk_scalar(JsonValue& result, ParseError separator_error);
+    // moves past a scalar that reader has just finished
+    bool finish_scalar(SpanReader& reader, ParseError separator_error);
+};
+
+bool IndexWalker::walk_value(JsonValue& result, ParseError separator_error) {
+    if (done()) return fail(ParseError::UnexpectedEnd);
+    switch (peek()) {
+        case JsonConstants::OBJECT_START:
+            return walk_object(result);
+        case JsonConstants::ARRAY_START:
+            return walk_array(result);
+        case JsonConstants::OBJECT_END:
+        case JsonConstants::ARRAY_END:
+        case JsonConstants::KEY_VALUE_SEPARATOR:
+        case JsonConstants::ITEM_SEPARATOR:
+            return fail(ParseError::UnexpectedCharacter);
+        default:
+            return walk_scalar(result, separator_error);
+    }
+}
+
+bool IndexWalker::walk_scalar(JsonValue& result, ParseError separator_error) {
+    SpanReader reader = reader_at_current();
+    ParseError scalar_error = parse_value(reader, result);
+    if (scalar_error != ParseError::None)
+        return fail_at(scalar_error, reader.offset() + *cur);
+    return finish_scalar(reader, separator_error);
+}
+
+bool IndexWalker::finish_scalar(SpanReader& reader, ParseError separator_error) {
+    consume_whitespace(reader);
+    if (reader.position() != following_position())
+        return fail_at(separator_error, reader.position() - input.data());
+    cur++;
+    return true;
+}
+
+bool IndexWalker::walk_object(JsonValue& result) {
+    if (depth == DEFAULT_MAX_DEPTH) return fail(ParseError::TooDeep);
+    depth++;
+    result.set_type(JsonValue::Type::Object);
+
+    // consume beginning of object
+    cur++;
+    if (done()) return fail(ParseError::UnexpectedEnd);
+    if (peek() == JsonConstants::OBJECT_END) {
+        cur++;
+        depth--;
+        return true;
+    }
+
+    while (true) {
+        // key, which must be followed by whitespace and the separator only
+        if (done() || peek() != JsonConstants::STRING_QUOTE) return fail(ParseError::ExpectedKey);
+        SpanReader reader = reader_at_current();
+        // reused for the thread's lifetime, so not from the default resource
+        thread_local JsonValue::String key{std::pmr::new_delete_resource()};
+        key.clear();
+        ParseError key_error = read_string(reader, key);
+        if (key_error != ParseError::None)
+            return fail_at(key_error, reader.offset() + *cur);
+        if (!finish_scalar(reader, ParseError::ExpectedColon)) return false;
+
+        if (done() || peek() != JsonConstants::KEY_VALUE_SEPARATOR) return fail(ParseError::ExpectedColon);
+        cur++;
+
+        if (!walk_value(result.at(KeyPool::current().intern(key)), ParseError::ExpectedCommaOrObjectEnd)) return false;
+
+        if (done()) return fail(ParseError::UnexpectedEnd);
+        char c = peek();
+        if (c != JsonConstants::OBJECT_END && c != JsonConstants::ITEM_SEPARATOR)
+            return fail(ParseError::ExpectedCommaOrObjectEnd);
+        cur++;
+        if (c == JsonConstants::OBJECT_END) {
+            depth--;
+            return true;
+        }
+    }
+}
+
+bool IndexWalker::walk_array(JsonValue& result) {
+    if (depth == DEFAULT_MAX_DEPTH) return fail(ParseError::TooDeep);
+    depth++;
+    result.set_type(JsonValue::Type::Array);
+
+    // consume beginning of array
+    cur++;
+    if (done()) return fail(ParseError::UnexpectedEnd);
+    if (peek() == JsonConstants::ARRAY_END) {
+        cur++;
+        depth--;
+        return true;
+    }
+
+    while (true) {
+        if (!walk_value(result.emplace_back(), ParseError::ExpectedCommaOrArrayEnd)) return false;
+
+        if (done()) return fail(ParseError::UnexpectedEnd);
+        char c = peek();
+        if (c != JsonConstants::ARRAY_END && c != JsonConstants::ITEM_SEPARATOR)
+            return fail(ParseError::ExpectedCommaOrArrayEnd);
+        cur++;
+        if (c == JsonConstants::ARRAY_END) {
+            depth--;
+            return true;
+        }
+    }
+}
+
+} // namespace
+
+ParseResult parse_simd(std::string_view input, std::pmr::memory_resource* resource) {
+    return parse_simd(input, detect_simd_engine(), resource);
+}
+
+ParseResult parse_simd(std::string_view input, SimdEngine engine, std::pmr::memory_resource* resource) {
+    if (input.size() > UINT32_MAX)
+        return ParseResult(ParseError::InputTooLarge, SourceLocation());
+
+    // the only other way to fail indexing is a string left open at the end
+    std::optional<std::vector<uint32_t>> index = build_structural_index(input, engine);
+    if (!index.has_value())
+        return ParseResult(ParseError::UnexpectedEnd, locate(input, input.size()));
+    if (index->empty())
+        return ParseResult(ParseError::EmptyDocument, locate(input, input.size()));
+
+    IndexWalker walker{input, index->data(), index->data() + index->size()};
+    JsonValue result{JsonValue::allocator_type(resource)};
+
+    // only allowed json file level values are object or array
+    bool parsed;
+    switch (walker.peek()) {
+        case JsonConstants::OBJECT_START:
+            parsed = walker.walk_object(result);
+            break;
+        case JsonConstants::ARRAY_START:
+            parsed = walker.walk_array(result);
+            break;
+        default:
+            return ParseResult(ParseError::InvalidRoot, locate(input, walker.cur[0]));
+    }
+
+    if (parsed && !walker.done())
+        walker.fail(ParseError::TrailingCharacters);
+    if (walker.error != ParseError::None)
+        return ParseResult(walker.error, locate(input, walker.error_offset));
+    return ParseResult(std::move(result));
+}
@@ -0,0 +1,9 @@
+#include "span_reader.h"
+
+SpanReader::SpanReader(std::string_view _input): begin{_input.data()}, cur{_input.data()}, end{_input.data() + _input.size()} {};
+
+SpanReader::SpanReader(const char* _begin, const char* _end): begin{_begin}, cur{_begin}, end{_end} {};
+
+SourceLocation SpanReader::location() const {
+    return locate(std::string_view(begin, end - begin), offset());
+}
@@ -0,0 +1,317 @@
+#include "structural_index.h"
+
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_PARSER_X86 1
+#endif
+
+namespace {
+
+constexpr size_t BLOCK_SIZE = 64;
+
+constexpr uint64_t ODD_BITS = 0xAAAAAAAAAAAAAAAAULL;
+
+struct BlockMasks {
+    uint64_t quote;
+    uint64_t backslash;
+    // one of { } [ ] : ,
+    uint64_t op;
+    // same set as isspace() in the C locale, which is what parse() accepts
+    uint64_t whitespace;
+};
+
+using Classifier = BlockMasks (*)(const char* block);
+
+BlockMasks classify_scalar(const char* block) {
+    BlockMasks masks{0, 0, 0, 0};
+    for (size_t idx = 0; idx < BLOCK_SIZE; idx++) {
+        uint64_t bit = uint64_t(1) << idx;
+        switch (block[idx]) {
+            case '"': masks.quote |= bit; break;
+            case '\\': masks.backslash |= bit; break;
+            case '{':
+            case '}':
+            case '[':
+            case ']':
+            case ':':
+            case ',': masks.op |= bit; break;
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\v':
+            case '\f':
+            case '\r': masks.whitespace |= bit; break;
+            default: break;
+        }
+    }
+    return masks;
+}
+
+#ifdef JSON_PARSER_X86
+
+// '[' and ']' differ from '{' and '}' only in bit 0x20, so or-ing it in folds
+// the four brackets onto two comparisons. Whitespace is ' ' or \t..\r.
+
+__attribute__((target("sse4.2")))
+BlockMasks classify_sse42(const char* block) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i open_brace = _mm_set1_epi8('{');
+    const __m128i close_brace = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i control_range = _mm_set1_epi8('\r' - '\t');
+
+    BlockMasks masks{0, 0, 0, 0};
+    for (size_t idx = 0; idx < BLOCK_SIZE / 16; idx++) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + idx * 16));
+        __m128i folded = _mm_or_si128(chunk, case_bit);
+        __m128i op = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(folded, open_brace), _mm_cmpeq_epi8(folded, close_brace)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, colon), _mm_cmpeq_epi8(chunk, comma)));
+        __m128i control = _mm_sub_epi8(chunk, tab);
+        __m128i whitespace = _mm_or_si128(
+            _mm_cmpeq_epi8(chunk, space),
+            _mm_cmpeq_epi8(_mm_min_epu8(control, control_range), control));
+
+        size_t shift = idx * 16;
+        masks.quote |= uint64_t(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)))) << shift;
+        masks.backslash |= uint64_t(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash)))) << shift;
+        masks.op |= uint64_t(uint32_t(_mm_movemask_epi8(op))) << shift;
+        masks.whitespace |= uint64_t(uint32_t(_mm_movemask_epi8(whitespace))) << shift;
+    }
+    return masks;
+}
+
+__attribute__((target("avx2")))
+BlockMasks classify_avx2(const char* block) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i open_brace = _mm256_set1_epi8('{');
+    const __m256i close_brace = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i control_range = _mm256_set1_epi8('\r' - '\t');
+
+    BlockMasks masks{0, 0, 0, 0};
+    for (size_t idx = 0; idx < BLOCK_SIZE / 32; idx++) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + idx * 32));
+        __m256i folded = _mm256_or_si256(chunk, case_bit);
+        __m256i op = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(folded, open_brace), _mm256_cmpeq_epi8(folded, close_brace)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, colon), _mm256_cmpeq_epi8(chunk, comma)));
+        __m256i control = _mm256_sub_epi8(chunk, tab);
+        __m256i whitespace = _mm256_or_si256(
+            _mm256_cmpeq_epi8(chunk, space),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(control, control_range), control));
+
+        size_t shift = idx * 32;
+        masks.quote |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, quote)))) << shift;
+        masks.backslash |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, backslash)))) << shift;
+        masks.op |= uint64_t(uint32_t(_mm256_movemask_epi8(op))) << shift;
+        masks.whitespace |= uint64_t(uint32_t(_mm256_movemask_epi8(whitespace))) << shift;
+    }
+    return masks;
+}
+
+#endif
+
+// running xor from bit 0 upwards, turns quote positions into string regions
+uint64_t prefix_xor(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+// state carried from one block into the next
+struct IndexState {
+    // 1 if the first byte of the next block is escaped by a trailing backslash
+    uint64_t next_is_escaped = 0;
+    // all ones if the next block starts inside a string
+    uint64_t in_string = 0;
+    // 1 if the last byte of the previous block belonged to a bare scalar
+    uint64_t in_scalar = 0;
+};
+
+// Bytes preceded by an odd-length run of backslashes. Backslash runs are
+// found with a carry-propagating subtraction instead of a per-byte loop.
+uint64_t find_escaped(uint64_t backslash, IndexState& state) {
+    if (backslash == 0) {
+        uint64_t escaped = state.next_is_escaped;
+        state.next_is_escaped = 0;
+        return escaped;
+    }
+    uint64_t potential_escape = backslash & ~state.next_is_escaped;
+    uint64_t maybe_escaped = potential_escape << 1;
+    uint64_t escape_and_terminal = ((maybe_escaped | ODD_BITS) - potential_escape) ^ ODD_BITS;
+    uint64_t escaped = escape_and_terminal ^ (backslash | state.next_is_escaped);
+    state.next_is_escaped = (escape_and_terminal & backslash) >> 63;
+    return escaped;
+}
+
+uint64_t find_structurals(const BlockMasks& masks, IndexState& state) {
+    uint64_t escaped = find_escaped(masks.backslash, state);
+    uint64_t quote = masks.quote & ~escaped;
+
+    // opening quotes and string contents are set, closing quotes are not
+    uint64_t in_string = prefix_xor(quote) ^ state.in_string;
+    state.in_string = uint64_t(int64_t(in_string) >> 63);
+
+    uint64_t scalar = ~(masks.op | masks.whitespace | quote | in_string);
+    uint64_t follows_scalar = (scalar << 1) | state.in_scalar;
+    state.in_scalar = scalar >> 63;
+
+    return (masks.op & ~in_string) | (quote & in_string) | (scalar & ~follows_scalar);
+}
+
+void flatten(uint64_t bits, uint32_t base, std::vector<uint32_t>& index) {
+    size_t cur = index.size();
+    index.resize(cur + __builtin_popcountll(bits));
+    uint32_t* out = index.data() + cur;
+    while (bits != 0) {
+        *out++ = base + static_cast<uint32_t>(__builtin_ctzll(bits));
+        bits &= bits - 1;
+    }
+}
+
+template <Classifier classify>
+std::vector<uint32_t> index_blocks(std::string_view input, IndexState& state) {
+    std::vector<uint32_t> index;
+    // structurals are typically well under a quarter of the bytes
+    index.reserve(input.size() / 4 + 16);
+
+    size_t pos = 0;
+    for (; pos + BLOCK_SIZE <= input.size(); pos += BLOCK_SIZE) {
+        uint64_t structurals = find_structurals(classify(input.data() + pos), state);
+        flatten(structurals, static_cast<uint32_t>(pos), index);
+    }
+
+    // pad the tail with whitespace, which never produces a structural
+    if (pos < input.size()) {
+        char block[BLOCK_SIZE];
+        std::memset(block, ' ', BLOCK_SIZE);
+        std::memcpy(block, input.data() + pos, input.size() - pos);
+        uint64_t structurals = find_structurals(classify(block), state);
+        flatten(structurals, static_cast<uint32_t>(pos), index);
+    }
+    return index;
+}
+
+// unescaped quotes in input, all index_blocks needs to know to tell where the
+// strings of the input that follows are
+template <Classifier classify>
+size_t count_quote_blocks(std::string_view input) {
+    IndexState state;
+    size_t count = 0;
+    size_t pos = 0;
+    for (; pos + BLOCK_SIZE <= input.size(); pos += BLOCK_SIZE) {
+        BlockMasks masks = classify(input.data() + pos);
+        count += __builtin_popcountll(masks.quote & ~find_escaped(masks.backslash, state));
+    }
+
+    if (pos < input.size()) {
+        char block[BLOCK_SIZE];
+        std::memset(block, ' ', BLOCK_SIZE);
+        std::memcpy(block, input.data() + pos, input.size() - pos);
+        BlockMasks masks = classify(block);
+        count += __builtin_popcountll(masks.quote & ~find_escaped(masks.backslash, state));
+    }
+    return count;
+}
+
+// the kernels above with the classifier of engine, or the scalar one if the
+// CPU does not support it
+std::vector<uint32_t> index_with(SimdEngine engine, std::string_view input, IndexState& state) {
+    if (!engine_supported(engine))
+        engine = SimdEngine::Scalar;
+
+    switch (engine) {
+#ifdef JSON_PARSER_X86
+        case SimdEngine::AVX2: return index_blocks<classify_avx2>(input, state);
+        case SimdEngine::SSE42: return index_blocks<classify_sse42>(input, state);
+#endif
+        default: return index_blocks<classify_scalar>(input, state);
+    }
+}
+
+size_t count_quotes_with(SimdEngine engine, std::string_view input) {
+    if (!engine_supported(engine))
+        engine = SimdEngine::Scalar;
+
+    switch (engine) {
+#ifdef JSON_PARSER_X86
+        case SimdEngine::AVX2: return count_quote_blocks<classify_avx2>(input);
+        case SimdEngine::SSE42: return count_quote_blocks<classify_sse42>(input);
+#endif
+        default: return count_quote_blocks<classify_scalar>(input);
+    }
+}
+
+} // namespace
+
+bool engine_supported(SimdEngine engine) {
+    switch (engine) {
+        case SimdEngine::Scalar: return true;
+#ifdef JSON_PARSER_X86
+        case SimdEngine::SSE42: return __builtin_cpu_supports("sse4.2");
+        case SimdEngine::AVX2: return __builtin_cpu_supports("avx2");
+#endif
+        default: return false;
+    }
+}
+
+SimdEngine detect_simd_engine() {
+    static const SimdEngine engine = [] {
+        if (engine_supported(SimdEngine::AVX2)) return SimdEngine::AVX2;
+        if (engine_supported(SimdEngine::SSE42)) return SimdEngine::SSE42;
+        return SimdEngine::Scalar;
+    }();
+    return engine;
+}
+
+const char* simd_engine_name(SimdEngine engine) {
+    switch (engine) {
+        case SimdEngine::Scalar: return "scalar";
+        case SimdEngine::SSE42: return "sse4.2";
+        case SimdEngine::AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+std::optional<std::vector<uint32_t>> build_structural_index(std::string_view input, SimdEngine engine) {
+    if (input.size() > std::numeric_limits<uint32_t>::max())
+        return std::nullopt;
+
+    IndexState state;
+    std::vector<uint32_t> index = index_with(engine, input, state);
+    if (state.in_string != 0)
+        return std::nullopt;
+    return index;
+}
+
+std::optional<std::vector<uint32_t>> build_structural_index(std::string_view input) {
+    return build_structural_index(input, detect_simd_engine());
+}
+
+size_t count_unescaped_quotes(std::string_view span, SimdEngine engine) {
+    return count_quotes_with(engine, span);
+}
+
+std::vector<uint32_t> build_span_index(std::string_view span, bool in_string, SimdEngine engine) {
+    IndexState state;
+    state.in_string = in_string ? ~uint64_t(0) : 0;
+    return index_with(engine, span, state);
+}
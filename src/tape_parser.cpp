@@ -0,0 +1,230 @@
+#include "parser.h"
+#include "json_tape.h"
+#include "structural_index.h"
+
+namespace {
+
+// Stage two over the structural index, appending to a tape instead of building
+// a JsonValue tree. Follows IndexWalker in simd_parser.cpp, errors included.
+struct TapeWalker {
+    std::string_view input;
+    const uint32_t* cur;
+    const uint32_t* end;
+    JsonTape& tape;
+    // string decoding goes through read_string, which needs somewhere to put it
+    std::pmr::memory_resource* scratch;
+    // first error hit and the input offset it was hit at
+    ParseError error = ParseError::None;
+    size_t error_offset = 0;
+    // open objects and arrays, limited like parse() limits them
+    size_t depth = 0;
+
+    bool done() const {
+        return cur == end;
+    }
+
+    char peek() const {
+        return input[*cur];
+    }
+
+    const char* following_position() const {
+        return cur + 1 == end ? input.data() + input.size() : input.data() + cur[1];
+    }
+
+    SpanReader reader_at_current() const {
+        return SpanReader(input.data() + *cur, input.data() + input.size());
+    }
+
+    bool fail(ParseError _error) {
+        return done() ? fail_at(ParseError::UnexpectedEnd, input.size()) : fail_at(_error, *cur);
+    }
+
+    bool fail_at(ParseError _error, size_t offset) {
+        error = _error;
+        error_offset = offset;
+        return false;
+    }
+
+    // separator_error is reported if something other than whitespace and the
+    // next structural follows a scalar
+    bool walk_value(ParseError separator_error);
+    bool walk_object();
+    bool walk_array();
+    bool walk_string(ParseError separator_error);
+    bool walk_scalar(ParseError separator_error);
+    // moves past a scalar that reader has just finished
+    bool finish_scalar(SpanReader& reader, ParseError separator_error);
+};
+
+bool TapeWalker::walk_value(ParseError separator_error) {
+    if (done()) return fail(ParseError::UnexpectedEnd);
+    switch (peek()) {
+        case JsonConstants::OBJECT_START:
+            return walk_object();
+        case JsonConstants::ARRAY_START:
+            return walk_array();
+        case JsonConstants::STRING_QUOTE:
+            return walk_string(separator_error);
+        case JsonConstants::OBJECT_END:
+        case JsonConstants::ARRAY_END:
+        case JsonConstants::KEY_VALUE_SEPARATOR:
+        case JsonConstants::ITEM_SEPARATOR:
+            return fail(ParseError::UnexpectedCharacter);
+        default:
+            return walk_scalar(separator_error);
+    }
+}
+
+bool TapeWalker::finish_scalar(SpanReader& reader, ParseError separator_error) {
+    consume_whitespace(reader);
+    if (reader.position() != following_position())
+        return fail_at(separator_error, reader.position() - input.data());
+    cur++;
+    return true;
+}
+
+bool TapeWalker::walk_string(ParseError separator_error) {
+    SpanReader reader = reader_at_current();
+    JsonValue::String str(scratch);
+    ParseError string_error = read_string(reader, str);
+    if (string_error != ParseError::None)
+        return fail_at(string_error, reader.offset() + *cur);
+    if (!finish_scalar(reader, separator_error)) return false;
+    tape.append_string(str);
+    return true;
+}
+
+bool TapeWalker::walk_scalar(ParseError separator_error) {
+    SpanReader reader = reader_at_current();
+    JsonValue value;
+    ParseError scalar_error = parse_value(reader, value);
+    if (scalar_error != ParseError::None)
+        return fail_at(scalar_error, reader.offset() + *cur);
+    if (!finish_scalar(reader, separator_error)) return false;
+
+    switch (value.type()) {
+        case JsonValue::Type::Null: tape.append_literal(JsonTape::Tag::Null); break;
+        case JsonValue::Type::Boolean: tape.append_literal(value.as_boolean() ? JsonTape::Tag::True : JsonTape::Tag::False); break;
+        default:
+            switch (value.number_type()) {
+                case JsonValue::NumberType::Int64: tape.append_number(value.as_int64()); break;
+                case JsonValue::NumberType::UInt64: tape.append_number(value.as_uint64()); break;
+                default: tape.append_number(value.as_double()); break;
+            }
+            break;
+    }
+    return true;
+}
+
+bool TapeWalker::walk_object() {
+    if (depth == DEFAULT_MAX_DEPTH) return fail(ParseError::TooDeep);
+    depth++;
+    size_t start = tape.start_container(JsonTape::Tag::ObjectStart);
+    uint64_t count = 0;
+
+    // consume beginning of object
+    cur++;
+    if (done()) return fail(ParseError::UnexpectedEnd);
+    if (peek() == JsonConstants::OBJECT_END) {
+        cur++;
+        depth--;
+        tape.end_container(start, count);
+        return true;
+    }
+
+    while (true) {
+        // key, which must be followed by whitespace and the separator only
+        if (done() || peek() != JsonConstants::STRING_QUOTE) return fail(ParseError::ExpectedKey);
+        if (!walk_string(ParseError::ExpectedColon)) return false;
+
+        if (done() || peek() != JsonConstants::KEY_VALUE_SEPARATOR) return fail(ParseError::ExpectedColon);
+        cur++;
+
+        if (!walk_value(ParseError::ExpectedCommaOrObjectEnd)) return false;
+        count++;
+
+        if (done()) return fail(ParseError::UnexpectedEnd);
+        char c = peek();
+        if (c != JsonConstants::OBJECT_END && c != JsonConstants::ITEM_SEPARATOR)
+            return fail(ParseError::ExpectedCommaOrObjectEnd);
+        cur++;
+        if (c == JsonConstants::OBJECT_END) break;
+    }
+
+    depth--;
+    tape.end_container(start, count);
+    return true;
+}
+
+bool TapeWalker::walk_array() {
+    if (depth == DEFAULT_MAX_DEPTH) return fail(ParseError::TooDeep);
+    depth++;
+    size_t start = tape.start_container(JsonTape::Tag::ArrayStart);
+    uint64_t count = 0;
+
+    // consume beginning of array
+    cur++;
+    if (done()) return fail(ParseError::UnexpectedEnd);
+    if (peek() == JsonConstants::ARRAY_END) {
+        cur++;
+        depth--;
+        tape.end_container(start, count);
+        return true;
+    }
+
+    while (true) {
+        if (!walk_value(ParseError::ExpectedCommaOrArrayEnd)) return false;
+        count++;
+
+        if (done()) return fail(ParseError::UnexpectedEnd);
+        char c = peek();
+        if (c != JsonConstants::ARRAY_END && c != JsonConstants::ITEM_SEPARATOR)
+            return fail(ParseError::ExpectedCommaOrArrayEnd);
+        cur++;
+        if (c == JsonConstants::ARRAY_END) break;
+    }
+
+    depth--;
+    tape.end_container(start, count);
+    return true;
+}
+
+} // namespace
+
+TapeParseResult parse_tape(std::string_view input) {
+    if (input.size() > UINT32_MAX)
+        return TapeParseResult(ParseError::InputTooLarge, SourceLocation());
+
+    // the only other way to fail indexing is a string left open at the end
+    std::optional<std::vector<uint32_t>> index = build_structural_index(input);
+    if (!index.has_value())
+        return TapeParseResult(ParseError::UnexpectedEnd, locate(input, input.size()));
+    if (index->empty())
+        return TapeParseResult(ParseError::EmptyDocument, locate(input, input.size()));
+
+    JsonTape tape;
+    // one word per structural is a good first guess
+    tape.words.reserve(index->size() + 2);
+
+    std::pmr::unsynchronized_pool_resource scratch;
+    TapeWalker walker{input, index->data(), index->data() + index->size(), tape, &scratch};
+
+    // only allowed json file level values are object or array
+    bool parsed;
+    switch (walker.peek()) {
+        case JsonConstants::OBJECT_START:
+            parsed = walker.walk_object();
+            break;
+        case JsonConstants::ARRAY_START:
+            parsed = walker.walk_array();
+            break;
+        default:
+            return TapeParseResult(ParseError::InvalidRoot, locate(input, walker.cur[0]));
+    }
+
+    if (parsed && !walker.done())
+        walker.fail(ParseError::TrailingCharacters);
+    if (walker.error != ParseError::None)
+        return TapeParseResult(walker.error, locate(input, walker.error_offset));
+    return TapeParseResult(std::move(tape));
+}
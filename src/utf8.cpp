@@ -0,0 +1,245 @@
+#include "utf8.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_PARSER_X86 1
+#endif
+
+namespace {
+
+bool is_continuation(unsigned char c) {
+    return (c & 0xC0) == 0x80;
+}
+
+size_t find_invalid_scalar(std::string_view text) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(text.data());
+    size_t size = text.size();
+    size_t idx = 0;
+    while (idx < size) {
+        // ASCII eight bytes at a time
+        if (idx + 8 <= size) {
+            uint64_t word;
+            std::memcpy(&word, bytes + idx, sizeof(word));
+            if ((word & 0x8080808080808080) == 0) {
+                idx += 8;
+                continue;
+            }
+        }
+
+        unsigned char lead = bytes[idx];
+        if (lead < 0x80) {
+            idx++;
+            continue;
+        }
+
+        // the range the second byte has to be in narrows for the leads that
+        // would otherwise allow overlong forms, surrogates or too large values
+        size_t length;
+        unsigned char low = 0x80, high = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF) length = 2;
+        else if (lead >= 0xE0 && lead <= 0xEF) {
+            length = 3;
+            if (lead == 0xE0) low = 0xA0;
+            else if (lead == 0xED) high = 0x9F;
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            length = 4;
+            if (lead == 0xF0) low = 0x90;
+            else if (lead == 0xF4) high = 0x8F;
+        } else return idx;
+
+        if (idx + length > size || bytes[idx + 1] < low || bytes[idx + 1] > high)
+            return idx;
+        for (size_t follow = 2; follow < length; follow++)
+            if (!is_continuation(bytes[idx + follow])) return idx;
+        idx += length;
+    }
+    return size;
+}
+
+#ifdef JSON_PARSER_X86
+
+// Error bits of the Keiser-Lemire lookup. Each table maps a nibble of the
+// previous or current byte to the errors it allows; a pair of bytes is in error
+// where all three agree.
+constexpr uint8_t TOO_SHORT = 1 << 0;
+constexpr uint8_t TOO_LONG = 1 << 1;
+constexpr uint8_t OVERLONG_3 = 1 << 2;
+constexpr uint8_t TOO_LARGE = 1 << 3;
+constexpr uint8_t SURROGATE = 1 << 4;
+constexpr uint8_t OVERLONG_2 = 1 << 5;
+constexpr uint8_t TOO_LARGE_1000 = 1 << 6;
+constexpr uint8_t OVERLONG_4 = 1 << 6;
+constexpr uint8_t TWO_CONTS = 1 << 7;
+constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+// high nibble of the previous byte
+#define BYTE_1_HIGH                                                                                     \
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,                     \
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,                                                         \
+    TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,                              \
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+
+// low nibble of the previous byte
+#define BYTE_1_LOW                                                                                      \
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY,                     \
+    CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,          \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,                             \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,                             \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,                             \
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, CARRY | TOO_LARGE | TOO_LARGE_1000,                 \
+    CARRY | TOO_LARGE | TOO_LARGE_1000
+
+// high nibble of the current byte
+#define BYTE_2_HIGH                                                                                     \
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,             \
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,                       \
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,                                         \
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,                                          \
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,                                          \
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+
+// The last bytes of a chunk can only be lead bytes if the sequence carries on
+// into the next chunk. Anything above these in the last three positions does.
+#define INCOMPLETE_LIMITS                                                                               \
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF
+
+// What the vector engines carry from one chunk to the next. One struct per
+// width rather than a template, as the vector types lose their attributes as
+// template arguments.
+struct LookupState128 {
+    __m128i error;
+    __m128i previous;
+    // lead bytes at the end of the previous chunk still waiting for their
+    // continuations
+    __m128i incomplete;
+};
+
+struct LookupState256 {
+    __m256i error;
+    __m256i previous;
+    __m256i incomplete;
+};
+
+__attribute__((target("sse4.2")))
+void check_chunk(LookupState128& state, __m128i chunk) {
+    if (_mm_movemask_epi8(chunk) == 0) {
+        // ASCII, only a sequence left open by the previous chunk is wrong
+        state.error = _mm_or_si128(state.error, state.incomplete);
+        state.previous = chunk;
+        return;
+    }
+
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i prev1 = _mm_alignr_epi8(chunk, state.previous, 15);
+    __m128i special = _mm_and_si128(
+        _mm_and_si128(_mm_shuffle_epi8(_mm_setr_epi8(BYTE_1_HIGH), _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                      _mm_shuffle_epi8(_mm_setr_epi8(BYTE_1_LOW), _mm_and_si128(prev1, nibble))),
+        _mm_shuffle_epi8(_mm_setr_epi8(BYTE_2_HIGH), _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble)));
+
+    // the third and fourth bytes of a sequence have to be continuations
+    __m128i prev2 = _mm_alignr_epi8(chunk, state.previous, 14);
+    __m128i prev3 = _mm_alignr_epi8(chunk, state.previous, 13);
+    __m128i must_continue = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(char(0xE0 - 0x80))),
+                                         _mm_subs_epu8(prev3, _mm_set1_epi8(char(0xF0 - 0x80))));
+    __m128i lengths = _mm_xor_si128(_mm_and_si128(must_continue, _mm_set1_epi8(char(0x80))), special);
+    state.error = _mm_or_si128(state.error, lengths);
+    state.incomplete = _mm_subs_epu8(chunk, _mm_setr_epi8(INCOMPLETE_LIMITS));
+    state.previous = chunk;
+}
+
+__attribute__((target("sse4.2")))
+size_t find_invalid_sse42(std::string_view text) {
+    LookupState128 state{_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+    size_t idx = 0;
+    for (; idx + 16 <= text.size(); idx += 16)
+        check_chunk(state, _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + idx)));
+    if (idx < text.size()) {
+        // padded with ASCII, which ends any sequence left open
+        char tail[16] = {};
+        std::memcpy(tail, text.data() + idx, text.size() - idx);
+        check_chunk(state, _mm_loadu_si128(reinterpret_cast<const __m128i*>(tail)));
+    }
+    __m128i error = _mm_or_si128(state.error, state.incomplete);
+
+    if (_mm_testz_si128(error, error))
+        return text.size();
+    return find_invalid_scalar(text);
+}
+
+__attribute__((target("avx2")))
+void check_chunk(LookupState256& state, __m256i chunk) {
+    if (_mm256_movemask_epi8(chunk) == 0) {
+        state.error = _mm256_or_si256(state.error, state.incomplete);
+        state.previous = chunk;
+        return;
+    }
+
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    // the bytes before each position, across the two 128 bit lanes
+    __m256i shifted = _mm256_permute2x128_si256(state.previous, chunk, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(chunk, shifted, 15);
+    __m256i special = _mm256_and_si256(
+        _mm256_and_si256(
+            _mm256_shuffle_epi8(_mm256_setr_epi8(BYTE_1_HIGH, BYTE_1_HIGH), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+            _mm256_shuffle_epi8(_mm256_setr_epi8(BYTE_1_LOW, BYTE_1_LOW), _mm256_and_si256(prev1, nibble))),
+        _mm256_shuffle_epi8(_mm256_setr_epi8(BYTE_2_HIGH, BYTE_2_HIGH), _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble)));
+
+    __m256i prev2 = _mm256_alignr_epi8(chunk, shifted, 14);
+    __m256i prev3 = _mm256_alignr_epi8(chunk, shifted, 13);
+    __m256i must_continue = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(char(0xE0 - 0x80))),
+                                            _mm256_subs_epu8(prev3, _mm256_set1_epi8(char(0xF0 - 0x80))));
+    __m256i lengths = _mm256_xor_si256(_mm256_and_si256(must_continue, _mm256_set1_epi8(char(0x80))), special);
+    state.error = _mm256_or_si256(state.error, lengths);
+    const __m256i limits = _mm256_setr_epi8(0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                            0xFF, 0xFF, 0xFF, 0xFF, INCOMPLETE_LIMITS);
+    state.incomplete = _mm256_subs_epu8(chunk, limits);
+    state.previous = chunk;
+}
+
+__attribute__((target("avx2")))
+size_t find_invalid_avx2(std::string_view text) {
+    LookupState256 state{_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+    size_t idx = 0;
+    for (; idx + 32 <= text.size(); idx += 32)
+        check_chunk(state, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + idx)));
+    if (idx < text.size()) {
+        char tail[32] = {};
+        std::memcpy(tail, text.data() + idx, text.size() - idx);
+        check_chunk(state, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tail)));
+    }
+    __m256i error = _mm256_or_si256(state.error, state.incomplete);
+
+    if (_mm256_testz_si256(error, error))
+        return text.size();
+    return find_invalid_scalar(text);
+}
+
+#undef BYTE_1_HIGH
+#undef BYTE_1_LOW
+#undef BYTE_2_HIGH
+#undef INCOMPLETE_LIMITS
+
+#endif
+
+} // namespace
+
+size_t find_invalid_utf8(std::string_view text, SimdEngine engine) {
+    // below a vector the scalar loop is as fast
+    if (text.size() < 16 || !engine_supported(engine))
+        engine = SimdEngine::Scalar;
+
+    switch (engine) {
+#ifdef JSON_PARSER_X86
+        case SimdEngine::AVX2: return find_invalid_avx2(text);
+        case SimdEngine::SSE42: return find_invalid_sse42(text);
+#endif
+        default: return find_invalid_scalar(text);
+    }
+}
+
+size_t find_invalid_utf8(std::string_view text) {
+    return find_invalid_utf8(text, detect_simd_engine());
+}
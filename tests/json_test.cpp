@@ -1,6 +1,10 @@
 #include <gtest/gtest.h>
 #include <nlohmann/json.hpp>
 #include "json.h"
+#include "json_writer.h"
+#include <cmath>
+#include <cstdio>
+#include <sstream>
 
 bool compare_json_strings(const std::string& json_str1, const std::string& json_str2) {
     nlohmann::json json1 = nlohmann::json::parse(json_str1);
@@ -35,7 +39,24 @@ TEST(JsonValueTest, NumberValue) {
     JsonValue json_value(42.0);
     EXPECT_EQ(json_value.type(), JsonValue::Type::Number);
     EXPECT_EQ(json_value.as_double(), 42.0);
-    EXPECT_EQ(json_value.to_string(), "42.000000");
+    EXPECT_EQ(json_value.to_string(), "42");
+}
+
+TEST(JsonValueTest, IntegerValue) {
+    JsonValue big(int64_t(9007199254740993));
+    EXPECT_EQ(big.type(), JsonValue::Type::Number);
+    EXPECT_EQ(big.number_type(), JsonValue::NumberType::Int64);
+    EXPECT_EQ(big.as_int64(), 9007199254740993);
+    EXPECT_EQ(big.to_string(), "9007199254740993");
+
+    JsonValue huge(uint64_t(18446744073709551615u));
+    EXPECT_EQ(huge.number_type(), JsonValue::NumberType::UInt64);
+    EXPECT_EQ(huge.as_uint64(), 18446744073709551615u);
+    EXPECT_THROW(huge.as_int64(), std::out_of_range);
+    EXPECT_EQ(JsonValue(-1).as_int64(), -1);
+    EXPECT_THROW(JsonValue(-1).as_uint64(), std::out_of_range);
+    EXPECT_THROW(JsonValue(1.5).as_int64(), std::out_of_range);
+    EXPECT_EQ(JsonValue(7).as_double(), 7.0);
 }
 
 TEST(JsonValueTest, StringValue) {
@@ -100,6 +121,193 @@ TEST(JsonValueTest, NestedValue) {
     EXPECT_FALSE(compare_json_strings(unexpected_json, json_value.to_string()));
 }
 
+// Remembers the blocks it hands out, to tell where a string's characters live.
+struct TrackingResource: std::pmr::memory_resource {
+    std::pmr::monotonic_buffer_resource arena;
+    std::vector<std::pair<const char*, size_t>> blocks;
+
+    bool owns(std::string_view text) const {
+        for (const auto& [begin, size]: blocks) {
+            if (text.data() >= begin && text.data() + text.size() <= begin + size) return true;
+        }
+        return false;
+    }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        void* block = arena.allocate(bytes, alignment);
+        blocks.emplace_back(static_cast<const char*>(block), bytes);
+        return block;
+    }
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// Test case to verify that nested values live in the resource of their parent
+TEST(JsonValueTest, ArenaAllocation) {
+    TrackingResource arena;
+    JsonValue json_value(JsonValue::Type::Object, &arena);
+
+    // built on the default resource, copied into the arena on insertion
+    JsonValue languages(JsonValue::Type::Array);
+    languages.push_back("a string long enough to not fit the small string buffer");
+    json_value.set_index("languages", languages);
+    json_value.set_index("name", "Jane Doe");
+
+    EXPECT_EQ(json_value.get_allocator().resource(), &arena);
+    EXPECT_EQ(json_value.at("languages").get_allocator().resource(), &arena);
+    EXPECT_EQ(json_value.at("languages").at(0).get_allocator().resource(), &arena);
+    EXPECT_TRUE(arena.owns(json_value.at("languages").at(0).as_string()));
+    EXPECT_EQ(json_value.at("name").as_string(), "Jane Doe");
+
+    // a plain copy leaves the arena, like the std::pmr containers
+    JsonValue copy = json_value;
+    EXPECT_EQ(copy.get_allocator().resource(), std::pmr::get_default_resource());
+    EXPECT_EQ(copy.at("languages").at(0).as_string(), languages.at(0).as_string());
+
+    // assignment keeps the resource of the assigned-to value
+    json_value.at("name") = copy.at("languages");
+    EXPECT_EQ(json_value.at("name").get_allocator().resource(), &arena);
+    EXPECT_TRUE(arena.owns(json_value.at("name").at(0).as_string()));
+}
+
+// Test case for compact and pretty output, escaping and number formatting
+TEST(JsonValueTest, WriteJson) {
+    JsonValue json_value(JsonValue::Type::Object);
+    json_value.set_index("text", "quote \" slash \\ newline \n bell \a end of a long run");
+    json_value.set_index("numbers", JsonValue::Array{0.1, 1e-7, 1e300, -0.0, 5, NAN});
+    json_value.set_index("empty", JsonValue(JsonValue::Type::Array));
+
+    std::string compact = json_value.to_string();
+    EXPECT_EQ(compact, R"({"text":"quote \" slash \\ newline \n bell \u0007 end of a long run",)"
+                       R"("numbers":[0.1,1e-07,1e+300,-0,5,null],"empty":[]})");
+
+    std::string pretty;
+    write_json(json_value.at("numbers"), pretty, WriteOptions{true, 2});
+    EXPECT_EQ(pretty, "[\n  0.1,\n  1e-07,\n  1e+300,\n  -0,\n  5,\n  null\n]");
+    EXPECT_TRUE(compare_json_strings(compact, [&] {
+        std::string out;
+        write_json(json_value, out, WriteOptions{true, 4});
+        return out;
+    }()));
+
+    // larger than one chunk, so the stream and fd writers have to flush midway
+    JsonValue big(JsonValue::Type::Array);
+    for (int idx = 0; idx < 20000; idx++)
+        big.push_back(JsonValue::Array{idx, "element"});
+    std::stringstream stream;
+    write_json(big, stream);
+    EXPECT_EQ(stream.str(), big.to_string());
+
+    std::FILE* file = std::tmpfile();
+    ASSERT_NE(file, nullptr);
+    EXPECT_TRUE(write_json(big, fileno(file)));
+    std::string from_fd(big.to_string().size(), '\0');
+    std::rewind(file);
+    EXPECT_EQ(std::fread(from_fd.data(), 1, from_fd.size(), file), from_fd.size());
+    EXPECT_EQ(from_fd, big.to_string());
+    std::fclose(file);
+    EXPECT_FALSE(write_json(big, -1));
+}
+
+// Test case for keys being stored once in the pool in scope
+TEST(JsonValueTest, KeyInterning) {
+    KeyPool pool;
+    {
+        KeyPoolScope scope(pool);
+        JsonValue first(JsonValue::Type::Object);
+        JsonValue second(JsonValue::Type::Object);
+        for (JsonValue* object: {&first, &second}) {
+            object->set_index("id", 1);
+            object->set_index("a key long enough to not fit the small string buffer", "value");
+        }
+        EXPECT_EQ(pool.size(), 2);
+
+        // the same key is the same handle in every object and in copies
+        auto first_key = first.as_object().begin()->first;
+        EXPECT_TRUE(first_key.same_handle(second.as_object().begin()->first));
+        JsonValue copy = first;
+        EXPECT_TRUE(first_key.same_handle(copy.as_object().begin()->first));
+        EXPECT_EQ(first_key.view(), "id");
+        EXPECT_EQ(copy.at("id").as_int64(), 1);
+    }
+
+    // outside the scope keys go to the global pool, lookups work across pools
+    JsonValue other(JsonValue::Type::Object);
+    other.set_index("id", 2);
+    EXPECT_EQ(pool.size(), 2);
+    EXPECT_EQ(&KeyPool::current(), &KeyPool::global());
+    EXPECT_TRUE(other.exists("id"));
+    EXPECT_EQ(pool.intern("id").view(), "id");
+    EXPECT_TRUE(pool.intern("id").same_handle(pool.intern(std::string("id"))));
+}
+
+// Test case for a pool that is full handing out owned keys
+TEST(JsonValueTest, KeyPoolBudget) {
+    KeyPool pool(2 * (KeyPool::KEY_OVERHEAD + 2));
+    std::optional<JsonValue> copy;
+    {
+        KeyPoolScope scope(pool);
+        JsonValue object(JsonValue::Type::Object);
+        for (std::string key: {"k0", "k1", "k2", "k3", "k0"})
+            object.set_index(key, key);
+        EXPECT_EQ(pool.size(), 2);
+        EXPECT_EQ(object.as_object().size(), 4);
+
+        // interned keys are shared, owned ones shared between copies
+        auto members = object.as_object().begin();
+        EXPECT_FALSE(members[0].first.owned_key());
+        EXPECT_TRUE(members[0].first.same_handle(pool.intern("k0")));
+        EXPECT_TRUE(members[2].first.owned_key());
+        EXPECT_FALSE(members[2].first.same_handle(pool.intern("k2")));
+        EXPECT_EQ(members[2].first.hash(), pool.intern("k2").hash());
+        copy = object;
+        EXPECT_TRUE(members[3].first.same_handle(copy->as_object().begin()[3].first));
+    }
+
+    // owned keys live on in the copy, and lookups find them
+    EXPECT_EQ(copy->at("k3").as_string(), "k3");
+    EXPECT_EQ(copy->at("k0").as_string(), "k0");
+    EXPECT_EQ(copy->to_string(), R"({"k0":"k0","k1":"k1","k2":"k2","k3":"k3"})");
+    EXPECT_EQ(pool.size(), 2);
+}
+
+// Test case for members keeping insertion order, below and above the index limit
+TEST(JsonValueTest, ObjectMemberOrder) {
+    JsonValue json_value(JsonValue::Type::Object);
+    std::vector<std::string> keys;
+    for (int idx = 0; idx < 100; idx++) {
+        keys.push_back("key" + std::to_string((idx * 37) % 100));
+        json_value.set_index(keys.back(), idx);
+        ASSERT_EQ(json_value.as_object().size(), idx + 1);
+        // every key so far is still found, whether scanned or indexed
+        for (int prior = 0; prior <= idx; prior++)
+            ASSERT_EQ(json_value.at(keys[prior]).as_int64(), prior) << keys[prior];
+        EXPECT_FALSE(json_value.exists("missing"));
+    }
+
+    // setting a key again replaces the value in place
+    json_value.set_index(keys[50], "replaced");
+    json_value.at(keys[3]) = true;
+    EXPECT_EQ(json_value.as_object().size(), 100);
+    size_t position = 0;
+    for (const auto& [key, member]: json_value.as_object()) {
+        EXPECT_EQ(key.view(), keys[position]);
+        position++;
+    }
+    EXPECT_EQ(json_value.at(keys[50]).as_string(), "replaced");
+    EXPECT_TRUE(json_value.at(keys[3]).as_boolean());
+
+    // copies, also into another resource, keep the order and the index
+    std::pmr::monotonic_buffer_resource arena;
+    JsonValue copy(json_value, &arena);
+    EXPECT_EQ(copy.to_string(), json_value.to_string());
+    EXPECT_EQ(copy.at(keys[99]).as_int64(), 99);
+    EXPECT_EQ(copy.at(keys[99]).get_allocator().resource(), &arena);
+}
+
 int main(int argc, char* argv[]) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
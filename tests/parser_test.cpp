@@ -2,6 +2,21 @@
 #include <sstream>
 #include "json.h"
 #include "parser.h"
+#include "sax_parser.h"
+#include "ndjson.h"
+#include "parallel_parser.h"
+#include "lazy_value.h"
+#include "json_query.h"
+#include "push_parser.h"
+#include "json_bind.h"
+#include "json_binary.h"
+#include "json_snapshot.h"
+#include "parse_cache.h"
+#include "utf8.h"
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <thread>
 #include <iostream>
 #include "tools/cpp/runfiles/runfiles.h"
 #include <nlohmann/json.hpp>
@@ -108,11 +123,85 @@ TEST(JsonParserTest, ParseInvalidJson) {
     EXPECT_FALSE(result.has_value());
 }
 
-std::ifstream open_json_test_file(const std::string& filepath_to_root) {
+// Test case for parsing directly out of a contiguous buffer
+TEST(JsonParserTest, ParseStringView) {
+    std::string_view json = " {\"key\": [1, \"two\", true, null]} ";
+    std::optional<JsonValue> result = parse(json);
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(result->at("key").type(), JsonValue::Type::Array);
+    EXPECT_DOUBLE_EQ(result->at("key").at(0).as_double(), 1);
+    EXPECT_EQ(result->at("key").at(1).as_string(), "two");
+
+    // the view does not have to be null terminated
+    std::string_view truncated = std::string_view("[1, 2]]", 6);
+    EXPECT_TRUE(parse(truncated).has_value());
+    EXPECT_FALSE(parse(std::string_view("[1, 2", 5)).has_value());
+    EXPECT_FALSE(parse(std::string_view("")).has_value());
+}
+
+// Makes resource the default one until the scope ends
+struct DefaultResourceScope {
+    explicit DefaultResourceScope(std::pmr::memory_resource* resource)
+        : previous{std::pmr::set_default_resource(resource)} {}
+    ~DefaultResourceScope() { std::pmr::set_default_resource(previous); }
+    DefaultResourceScope(const DefaultResourceScope&) = delete;
+    DefaultResourceScope& operator=(const DefaultResourceScope&) = delete;
+
+    std::pmr::memory_resource* previous;
+};
+
+// Test case for building a document entirely inside an arena
+TEST(JsonParserTest, ParseIntoArena) {
+    std::string json = R"({"key": "a value that is too long for the small string buffer",
+                           "list": [1, "two", {"three": [true, null]}]})";
+    std::pmr::monotonic_buffer_resource arena;
+
+    // any allocation that escapes the arena would throw, also when this is the
+    // first parse in the process: the key pool and key buffers it sets up
+    // never take the default resource
+    std::optional<JsonValue> result;
+    {
+        DefaultResourceScope scope(std::pmr::null_memory_resource());
+        result = parse(std::string_view(json), &arena);
+    }
+
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(result->get_allocator().resource(), &arena);
+    EXPECT_EQ(result->at("list").at(2).at("three").get_allocator().resource(), &arena);
+    EXPECT_EQ(result->at("key").as_string(), "a value that is too long for the small string buffer");
+    EXPECT_EQ(result->to_string(), parse_json_string(json)->to_string());
+}
+
+// Test case for the process-wide key pool and key buffers outliving the
+// default resource they are first used under
+TEST(JsonParserTest, ParseUnderScopedDefaultResource) {
+    // re-run in a fresh process, so this is the first parse to use them
+    ::testing::GTEST_FLAG(death_test_style) = "threadsafe";
+    EXPECT_EXIT({
+        {
+            // the document itself is released before the arena
+            char buffer[4096];
+            std::pmr::monotonic_buffer_resource scoped(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+            DefaultResourceScope scope(&scoped);
+            if (!parse(std::string_view(R"({"k": 1, "\u006b2": 2})")).has_value()) std::exit(1);
+        }
+        std::string json = "{";
+        for (int idx = 0; idx < 1000; idx++)
+            json += std::string(idx ? "," : "") + "\"" + std::string(40, 'k') + std::to_string(idx) + "\": 1";
+        json += "}";
+        auto result = parse(std::string_view(json));
+        std::exit(result.has_value() && result->as_object().size() == 1000 ? 0 : 2);
+    }, ::testing::ExitedWithCode(0), "");
+}
+
+std::string json_test_file_path(const std::string& filepath_to_root) {
     std::string workspace_name = "custom_json_parser"; 
     auto runfiles = bazel::tools::cpp::runfiles::Runfiles::CreateForTest();
-    std::string runfiles_path = runfiles->Rlocation(workspace_name + "/" + filepath_to_root);
-    auto file = std::ifstream(runfiles_path);
+    return runfiles->Rlocation(workspace_name + "/" + filepath_to_root);
+}
+
+std::ifstream open_json_test_file(const std::string& filepath_to_root) {
+    auto file = std::ifstream(json_test_file_path(filepath_to_root));
     if (!file.is_open()) 
         throw std::runtime_error("Error, file not open");
     return file;
@@ -197,10 +286,1178 @@ TEST(JsonParserTest, ParseCrickettTestCases) {
     }                               
 }
 
+// Expects actual to be accepted exactly when expected is, and then to hold the
+// same value; either can be a ParseResult or anything else optional-like
+template <typename Expected, typename Actual>
+void expect_same_document(const Expected& expected, const Actual& actual, const std::string& context) {
+    ASSERT_EQ(expected.has_value(), actual.has_value()) << context;
+    if (expected.has_value()) {
+        EXPECT_EQ(expected->to_string(), actual->to_string()) << context;
+    }
+}
+
+// the mmap and string_view entry points must agree with the stream parser
+TEST(JsonParserTest, ParseFileMatchesStream) {
+    std::vector<std::string> filepaths = {"data/tests/official/pass1.json",
+                                          "data/tests/official/pass2.json",
+                                          "data/tests/official/pass3.json",
+                                          "data/tests/step4/valid2.json",
+                                          "data/tests/step4/invalid.json"};
+
+    for (const auto& filepath: filepaths) {
+        auto file = open_json_test_file(filepath);
+        auto from_stream = parse(file);
+        auto from_file = parse_file(json_test_file_path(filepath));
+        expect_same_document(from_stream, from_file, filepath);
+    }
+
+    EXPECT_FALSE(parse_file(json_test_file_path("data/tests/does_not_exist.json")).has_value());
+}
+
+std::string read_json_test_file(const std::string& filepath) {
+    auto file = open_json_test_file(filepath);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+std::vector<std::string> all_json_test_files() {
+    std::vector<std::string> filepaths = {"data/tests/step1/valid.json",
+                                          "data/tests/step1/invalid.json",
+                                          "data/tests/step2/valid.json",
+                                          "data/tests/step2/valid2.json",
+                                          "data/tests/step2/invalid.json",
+                                          "data/tests/step2/invalid2.json",
+                                          "data/tests/step3/valid.json",
+                                          "data/tests/step3/invalid.json",
+                                          "data/tests/step4/valid.json",
+                                          "data/tests/step4/valid2.json",
+                                          "data/tests/step4/invalid.json"};
+    for (int i = 1; i <= 33; i++)
+        filepaths.push_back("data/tests/official/fail" + std::to_string(i) + ".json");
+    for (int i = 1; i <= 3; i++)
+        filepaths.push_back("data/tests/official/pass" + std::to_string(i) + ".json");
+    return filepaths;
+}
+
+// Expects parse_with to accept exactly the test files parse() accepts, and to
+// build the same values from them
+template <typename Parse>
+void expect_test_files_parse_alike(Parse&& parse_with) {
+    for (const auto& filepath: all_json_test_files()) {
+        std::string document = read_json_test_file(filepath);
+        expect_same_document(parse(std::string_view(document)), parse_with(document), filepath);
+    }
+}
+
+// the two-stage parser must agree with parse() on every input, with every engine
+TEST(JsonParserTest, ParseSimdMatchesParse) {
+    std::vector<std::string> documents;
+    for (const auto& filepath: all_json_test_files())
+        documents.push_back(read_json_test_file(filepath));
+
+    // slide tricky strings across the 64 byte block boundaries
+    std::vector<std::string> fragments = {
+        R"(["a\\\"b{", "c\\\\", "\\", 1, true, {"k,": [null, -2.5e3]}])",
+        R"({"a" : "}", "b":[ "\"" ,false]})",
+        R"([1x])", R"(["a"b])", R"([tru e])", R"({"a" 1})", R"(["abc)", R"([1, 2] x)",
+        R"({"a":1,})", R"([1,])", R"([\"a"])", R"({"a":[1,2}})", R"({"a"::1})",
+    };
+    for (const auto& fragment: fragments) {
+        for (size_t padding = 0; padding <= 70; padding++)
+            documents.push_back(std::string(padding, ' ') + fragment + "\n");
+    }
+
+    for (SimdEngine engine: {SimdEngine::Scalar, SimdEngine::SSE42, SimdEngine::AVX2}) {
+        for (const auto& document: documents) {
+            expect_same_document(parse(std::string_view(document)), parse_simd(document, engine),
+                                 std::string(simd_engine_name(engine)) + ": " + document);
+        }
+    }
+}
+
+// Test case for reading a tape through JsonView without materializing it
+TEST(JsonParserTest, ParseTapeAccessors) {
+    std::string json = R"({"skip": {"deep": [[1, 2], {"x": null}]}, "list": [1.5, "two", true, false, null],
+                           "name": "tape", "empty": {}})";
+    std::optional<JsonTape> tape = parse_tape(json);
+    ASSERT_TRUE(tape.has_value());
+
+    JsonView root = tape->root();
+    EXPECT_EQ(root.type(), JsonValue::Type::Object);
+    EXPECT_EQ(root.size(), 4);
+    EXPECT_EQ(root.at("name").as_string(), "tape");
+    EXPECT_TRUE(root.exists("skip"));
+    EXPECT_FALSE(root.exists("missing"));
+    EXPECT_FALSE(root.exists(0));
+
+    JsonView list = root.at("list");
+    EXPECT_EQ(list.size(), 5);
+    EXPECT_DOUBLE_EQ(list.at(0).as_double(), 1.5);
+    EXPECT_EQ(list.at(1).as_string(), "two");
+    EXPECT_TRUE(list.at(2).as_boolean());
+    EXPECT_FALSE(list.at(3).as_boolean());
+    EXPECT_EQ(list.at(4).type(), JsonValue::Type::Null);
+    EXPECT_TRUE(list.exists(4));
+    EXPECT_FALSE(list.exists(5));
+
+    EXPECT_EQ(root.at("empty").size(), 0);
+    EXPECT_EQ(root.at("skip").at("deep").at(1).at("x").type(), JsonValue::Type::Null);
+
+    EXPECT_THROW(root.at("name").as_double(), std::runtime_error);
+    EXPECT_THROW(root.at("missing"), std::out_of_range);
+    EXPECT_THROW(list.at(5), std::runtime_error);
+
+    EXPECT_EQ(root.at("skip").materialize().to_string(), parse_json_string(json)->at("skip").to_string());
+}
+
+// the tape must accept the same documents as parse() and materialize to the
+// same value, and reject the others with the errors parse_simd() reports
+TEST(JsonParserTest, ParseTapeMatchesParse) {
+    expect_test_files_parse_alike([](const std::string& document) -> std::optional<JsonValue> {
+        auto tape = parse_tape(document);
+        if (!tape.has_value()) return std::nullopt;
+        return tape->root().materialize();
+    });
 
+    for (const auto& filepath: all_json_test_files()) {
+        std::string document = read_json_test_file(filepath);
+        auto tape = parse_tape(document);
+        auto simd = parse_simd(document);
+        EXPECT_EQ(tape.error(), simd.error()) << filepath;
+        EXPECT_EQ(tape.location().offset, simd.location().offset) << filepath;
+    }
+
+    auto failed = parse_tape("[1,\n 2 3]");
+    ASSERT_FALSE(failed.has_value());
+    EXPECT_EQ(failed.error(), ParseError::ExpectedCommaOrArrayEnd);
+    EXPECT_EQ(failed.location().line, 2);
+    EXPECT_EQ(failed.location().column, 4);
+    EXPECT_THROW(failed.value(), std::runtime_error);
+    EXPECT_EQ(parse_tape("  ").error(), ParseError::EmptyDocument);
+}
+
+// Test case for the error code and location reported on malformed input
+TEST(JsonParserTest, ParseErrorLocation) {
+    auto result = parse(std::string_view("{\n  \"a\": 1,\n  \"b\" 2\n}"));
+    ASSERT_FALSE(result.has_value());
+    EXPECT_EQ(result.error(), ParseError::ExpectedColon);
+    EXPECT_EQ(result.location().offset, 18);
+    EXPECT_EQ(result.location().line, 3);
+    EXPECT_EQ(result.location().column, 7);
+    EXPECT_THROW(result.value(), std::runtime_error);
+
+    EXPECT_EQ(parse(std::string_view(" \n ")).error(), ParseError::EmptyDocument);
+    EXPECT_EQ(parse(std::string_view("42")).error(), ParseError::InvalidRoot);
+    EXPECT_EQ(parse(std::string_view("[1, 2")).error(), ParseError::UnexpectedEnd);
+    EXPECT_EQ(parse(std::string_view("[1 2]")).error(), ParseError::ExpectedCommaOrArrayEnd);
+    EXPECT_EQ(parse(std::string_view("[tru]")).error(), ParseError::InvalidLiteral);
+    EXPECT_EQ(parse(std::string_view("[-]")).error(), ParseError::InvalidNumber);
+    EXPECT_EQ(parse(std::string_view("[\"\\x\"]")).error(), ParseError::InvalidEscape);
+    EXPECT_EQ(parse(std::string_view("{1: 2}")).error(), ParseError::ExpectedKey);
+    EXPECT_EQ(parse(std::string_view("{} x")).error(), ParseError::TrailingCharacters);
+    EXPECT_EQ(parse_file("does/not/exist.json").error(), ParseError::IoError);
+
+    // the stream reader keeps counting lines across its internal buffer refills
+    std::string document = "[" + std::string(5000, '\n') + "1,\n  x]";
+    std::stringstream stream(document);
+    auto from_stream = parse(stream);
+    auto from_buffer = parse(std::string_view(document));
+    auto from_simd = parse_simd(document);
+    for (const ParseResult* failed: {&from_stream, &from_buffer, &from_simd}) {
+        EXPECT_EQ(failed->error(), ParseError::UnexpectedCharacter);
+        EXPECT_EQ(failed->location().offset, document.size() - 2);
+        EXPECT_EQ(failed->location().line, 5002);
+        EXPECT_EQ(failed->location().column, 3);
+    }
+}
+
+// Test case for exact integers and correctly rounded doubles
+TEST(JsonParserTest, ParseNumbers) {
+    std::string json = "[9007199254740993, -9223372036854775808, 18446744073709551615, 18446744073709551616, "
+                       "-0, 0.1, 2.2250738585072011e-308, 1e-400, -12.5E+3]";
+    std::stringstream stream(json);
+    for (auto result: {parse(std::string_view(json)), parse(stream), parse_simd(json)}) {
+        ASSERT_TRUE(result.has_value());
+        const JsonValue& numbers = *result;
+        EXPECT_EQ(numbers.at(0).number_type(), JsonValue::NumberType::UInt64);
+        EXPECT_EQ(numbers.at(0).as_int64(), 9007199254740993);
+        EXPECT_EQ(numbers.at(1).number_type(), JsonValue::NumberType::Int64);
+        EXPECT_EQ(numbers.at(1).as_int64(), INT64_MIN);
+        EXPECT_EQ(numbers.at(2).as_uint64(), UINT64_MAX);
+        // integers that do not fit fall back to double
+        EXPECT_EQ(numbers.at(3).number_type(), JsonValue::NumberType::Double);
+        EXPECT_EQ(numbers.at(3).as_double(), 18446744073709551616.0);
+        EXPECT_EQ(numbers.at(4).number_type(), JsonValue::NumberType::Double);
+        EXPECT_TRUE(std::signbit(numbers.at(4).as_double()));
+        EXPECT_EQ(numbers.at(5).as_double(), 0.1);
+        EXPECT_EQ(numbers.at(6).as_double(), 2.2250738585072011e-308);
+        EXPECT_EQ(numbers.at(7).as_double(), 0.0);
+        EXPECT_EQ(numbers.at(8).as_double(), -12500.0);
+    }
+
+    auto tape = parse_tape(json);
+    ASSERT_TRUE(tape.has_value());
+    EXPECT_EQ(tape->root().at(0).as_int64(), 9007199254740993);
+    EXPECT_EQ(tape->root().at(2).as_uint64(), UINT64_MAX);
+    EXPECT_EQ(tape->root().at(5).as_double(), 0.1);
+
+    EXPECT_EQ(parse(std::string_view("[1e400]")).error(), ParseError::InvalidNumber);
+    EXPECT_EQ(parse(std::string_view("[0.1e99999999999999999999]")).error(), ParseError::InvalidNumber);
+    EXPECT_EQ(parse(std::string_view("[-0.1e-99999999999999999999]")).error(), ParseError::None);
+    EXPECT_EQ(parse(std::string_view("[1.]")).error(), ParseError::InvalidNumber);
+}
+
+// records every event as a short string
+struct RecordingHandler {
+    std::vector<std::string> events;
+
+    void on_null() { events.push_back("null"); }
+    void on_bool(bool value) { events.push_back(value ? "true" : "false"); }
+    void on_number(int64_t value) { events.push_back("i" + std::to_string(value)); }
+    void on_number(uint64_t value) { events.push_back("u" + std::to_string(value)); }
+    void on_number(double value) { events.push_back("d" + std::to_string(value)); }
+    void on_string(std::string_view value) { events.push_back("s" + std::string(value)); }
+    void on_key(std::string_view key) { events.push_back("k" + std::string(key)); }
+    void on_start_object() { events.push_back("{"); }
+    void on_end_object() { events.push_back("}"); }
+    void on_start_array() { events.push_back("["); }
+    void on_end_array() { events.push_back("]"); }
+};
+
+// Test case for the event driven parser
+TEST(JsonParserTest, ParseSax) {
+    std::string json = R"({"a": [1, -2, 2.5, "x", true, false, null], "b": {}, "c": []})";
+    std::vector<std::string> expected = {"{", "ka", "[", "u1", "i-2", "d2.500000", "sx", "true", "false", "null", "]",
+                                         "kb", "{", "}", "kc", "[", "]", "}"};
+
+    RecordingHandler from_span;
+    EXPECT_TRUE(parse_sax(std::string_view(json), from_span));
+    EXPECT_EQ(from_span.events, expected);
+
+    RecordingHandler from_stream;
+    std::stringstream stream(json);
+    EXPECT_TRUE(parse_sax(stream, from_stream));
+    EXPECT_EQ(from_stream.events, expected);
 
+    // same verdict and error location as parse() on every test file
+    for (const auto& filepath: all_json_test_files()) {
+        std::string document = read_json_test_file(filepath);
+        auto expected_result = parse(std::string_view(document));
+        RecordingHandler handler;
+        ParseStatus status = parse_sax(std::string_view(document), handler);
+        EXPECT_EQ(status.error, expected_result.error()) << filepath;
+        EXPECT_EQ(status.location.offset, expected_result.location().offset) << filepath;
+    }
+}
+
+// Test case for newline delimited input parsed on several threads
+TEST(JsonParserTest, ParseNdjson) {
+    std::string input;
+    for (int idx = 0; idx < 1000; idx++) {
+        input += "{\"id\": " + std::to_string(idx) + ", \"tags\": [\"a\", \"b\"]}\n";
+        if (idx % 100 == 0) input += "  \r\n";
+    }
+    input += "{\"id\": 1000, \"bad\" 1}\n[1001]";
+
+    NdjsonOptions options;
+    options.threads = 4;
+    options.chunk_size = 256;
 
+    std::vector<size_t> lines;
+    std::vector<ParseResult> records;
+    auto collect = [&](size_t line, ParseResult&& record) {
+        lines.push_back(line);
+        records.push_back(std::move(record));
+    };
+    parse_ndjson(std::string_view(input), collect, options);
 
+    // records come back in order, the blank lines are skipped but still counted
+    ASSERT_EQ(records.size(), 1002);
+    for (int idx = 0; idx < 1000; idx++) {
+        ASSERT_TRUE(records[idx].has_value());
+        EXPECT_EQ(records[idx]->at("id").as_int64(), idx);
+    }
+    EXPECT_EQ(lines[0], 1);
+    EXPECT_EQ(lines[1], 3);
+    EXPECT_EQ(lines[1000], 1011);
+    EXPECT_FALSE(records[1000].has_value());
+    EXPECT_EQ(records[1000].error(), ParseError::ExpectedColon);
+    EXPECT_EQ(records[1000].location().line, 1011);
+    EXPECT_EQ(records[1000].location().column, 20);
+    EXPECT_EQ(records[1000].location().offset, input.rfind("1}"));
+    EXPECT_EQ(records[1001]->at(0).as_int64(), 1001);
+
+    // the stream reader cuts its chunks differently but must agree
+    for (size_t chunk_size: {1, 100, 1 << 20}) {
+        options.chunk_size = chunk_size;
+        std::vector<size_t> stream_lines;
+        std::vector<ParseResult> stream_records;
+        std::stringstream stream(input);
+        EXPECT_TRUE(parse_ndjson(stream, [&](size_t line, ParseResult&& record) {
+            stream_lines.push_back(line);
+            stream_records.push_back(std::move(record));
+        }, options));
+        ASSERT_EQ(stream_lines, lines);
+        for (size_t idx = 0; idx < records.size(); idx++) {
+            EXPECT_EQ(stream_records[idx].error(), records[idx].error());
+            EXPECT_EQ(stream_records[idx].location().offset, records[idx].location().offset);
+            expect_same_document(records[idx], stream_records[idx], "record " + std::to_string(idx));
+        }
+    }
+
+    // a long line read in small pieces is only searched once for its end
+    std::string long_line = "[\"" + std::string(1 << 18, 'x') + "\"]\n[2]";
+    std::stringstream long_stream(long_line);
+    options.chunk_size = 16;
+    std::vector<size_t> long_lines;
+    EXPECT_TRUE(parse_ndjson(long_stream, [&](size_t line, ParseResult&& record) {
+        EXPECT_TRUE(record.has_value());
+        long_lines.push_back(line);
+    }, options));
+    EXPECT_EQ(long_lines, std::vector<size_t>({1, 2}));
+
+    EXPECT_EQ(parse_ndjson(std::string_view("[1]\n\n{}"), options).size(), 2);
+    EXPECT_TRUE(parse_ndjson(std::string_view(""), options).empty());
+}
+
+// the parallel array parser must agree with parse() on results and errors
+TEST(JsonParserTest, ParseParallelMatchesParse) {
+    std::vector<std::string> documents;
+    for (const auto& filepath: all_json_test_files())
+        documents.push_back(read_json_test_file(filepath));
+
+    std::string big = "[";
+    for (int idx = 0; idx < 2000; idx++) {
+        if (idx > 0) big += ",\n ";
+        big += "{\"id\": " + std::to_string(idx) + R"(, "s": "a,]\"[", "n": [[], {"x": [1, 2]}]})";
+    }
+    big += "]";
+    documents.push_back(big);
+    documents.push_back(" [ ] ");
+    documents.push_back("[1, 2");
+    documents.push_back("[1, 2] x");
+    documents.push_back("[1,, 2]");
+    documents.push_back("[1, {\"a\": ]}, 3]");
+    documents.push_back("[\"open]");
+    documents.push_back(big.substr(0, big.size() - 20) + "}, 1x]");
+    // the root counts towards the depth of the elements
+    std::string deepest = std::string(DEFAULT_MAX_DEPTH - 1, '[') + std::string(DEFAULT_MAX_DEPTH - 1, ']');
+    documents.push_back("[1, " + deepest + "]");
+    documents.push_back("[1, [" + deepest + "]]");
+    // spans cut through backslash runs, escaped quotes and leading whitespace
+    std::string escapes = std::string(100, ' ') + "[";
+    for (int idx = 0; idx < 200; idx++)
+        escapes += std::string(idx ? ", " : "") + "\"" + std::string(2 * (idx % 40), '\\') + "\\\",]\"";
+    documents.push_back(escapes + "]");
+    documents.push_back(escapes + "}");
+    documents.push_back(escapes.substr(0, escapes.size() - 1) + ", \"\\\"]");
+
+    ParallelParseOptions options;
+    options.threads = 4;
+    options.chunk_size = 64;
+    for (const auto& document: documents) {
+        auto expected = parse(std::string_view(document));
+        auto actual = parse_parallel(document, options);
+        ASSERT_EQ(expected.has_value(), actual.has_value()) << document.substr(0, 100);
+        if (expected.has_value()) {
+            EXPECT_EQ(expected->to_string(), actual->to_string()) << document.substr(0, 100);
+        } else {
+            EXPECT_EQ(expected.error(), actual.error()) << document.substr(0, 100);
+            EXPECT_EQ(expected.location().offset, actual.location().offset) << document.substr(0, 100);
+        }
+    }
+}
+
+// Test case for reading a few fields through the on-demand cursor
+TEST(JsonParserTest, ParseLazy) {
+    // the payload is malformed, but it is only ever stepped over
+    std::string json = R"( {"payload": {"deep": [1, 2, {"x": "}]\""}], "bad": [1 2]},
+                            "type": "event", "tenant_id": 18446744073709551615,
+                            "list": [1.5, true, null, "s"], "esc\"key": 7, "type": "dup"} )";
+    LazyValue root = parse_lazy(json);
+    EXPECT_EQ(root.type(), JsonValue::Type::Object);
+    // a repeated key reads as the first value, as through JsonView
+    EXPECT_EQ(root.at("type").as_string(), "event");
+    EXPECT_EQ(root.at("tenant_id").as_uint64(), UINT64_MAX);
+    EXPECT_EQ(root.at("esc\"key").as_int64(), 7);
+    EXPECT_EQ(root.size(), 6);
+
+    std::string repeated = R"({"k": 1, "x": 2, "k\u0000": 0, "\u006b": 3})";
+    auto tape = parse_tape(repeated);
+    ASSERT_TRUE(tape.has_value());
+    LazyValue lazy = parse_lazy(repeated);
+    EXPECT_EQ(lazy.at("k").as_int64(), 1);
+    EXPECT_EQ(lazy.at("k").as_int64(), tape->root().at("k").as_int64());
+    EXPECT_EQ(lazy.size(), tape->root().size());
+    std::string visited;
+    lazy.for_each([&](const LazyValue& value) { visited += value.materialize().to_string(); });
+    EXPECT_EQ(visited, "1203");
+    EXPECT_EQ(lazy.materialize().to_string(), parse(std::string_view(repeated))->to_string());
+    // and the lookup stops there, never reaching what follows
+    EXPECT_EQ(parse_lazy(R"({"k": 1, "k": [1 2)").at("k").as_int64(), 1);
+
+    LazyValue list = root.at("list");
+    EXPECT_EQ(list.size(), 4);
+    EXPECT_DOUBLE_EQ(list.at(0).as_double(), 1.5);
+    EXPECT_TRUE(list.at(1).as_boolean());
+    EXPECT_EQ(list.at(2).type(), JsonValue::Type::Null);
+    EXPECT_TRUE(list.exists(3));
+    EXPECT_FALSE(list.exists(4));
+    EXPECT_FALSE(root.exists("missing"));
+    EXPECT_EQ(list.materialize().to_string(), R"([1.5,true,null,"s"])");
+
+    EXPECT_THROW(root.at("missing"), std::out_of_range);
+    EXPECT_THROW(list.at(4), std::runtime_error);
+    EXPECT_THROW(root.at("type").as_double(), std::runtime_error);
+    // reading into the malformed part does fail
+    EXPECT_THROW(root.at("payload").at("bad").at(1), std::runtime_error);
+    EXPECT_THROW(parse_lazy("  "), std::runtime_error);
+    EXPECT_THROW(parse_lazy("42"), std::runtime_error);
+    EXPECT_THROW(parse_lazy(R"({"a": [1, 2)").at("b"), std::runtime_error);
+
+    // on valid documents the lazy cursor sees what parse() builds; it only
+    // checks what it reads, such as nothing past the root, so invalid ones are
+    // left out
+    expect_test_files_parse_alike([](const std::string& document) -> std::optional<JsonValue> {
+        if (!parse(std::string_view(document)).has_value()) return std::nullopt;
+        return parse_lazy(document).materialize();
+    });
+}
+
+TEST(JsonParserTest, ParseQuery) {
+    std::string json = R"({"store": {"book": [
+        {"title": "Sayings", "author": "Rees", "price": 8.95, "tags": ["a/b", "c~d"]},
+        {"title": "Sword", "author": "Waugh", "price": 12},
+        {"title": "Moby", "author": "Melville", "price": 8.95, "isbn": "0-553"}],
+        "bicycle": {"color": "red", "price": 19}, "a/b": 1, "c~d": 2}})";
+    auto document = parse(std::string_view(json));
+    ASSERT_TRUE(document.has_value());
+
+    auto titles = [](const std::vector<const JsonValue*>& matches) {
+        std::string result;
+        for (const JsonValue* match: matches) result += match->at("title").as_string();
+        return result;
+    };
+
+    // JSON Pointer
+    EXPECT_EQ(compile_json_pointer("").first(*document), &*document);
+    EXPECT_EQ(compile_json_pointer("/store/book/1/author").first(*document)->as_string(), "Waugh");
+    EXPECT_EQ(compile_json_pointer("/store/a~1b").first(*document)->as_int64(), 1);
+    EXPECT_EQ(compile_json_pointer("/store/c~0d").first(*document)->as_int64(), 2);
+    EXPECT_EQ(compile_json_pointer("/store/book/3").first(*document), nullptr);
+    EXPECT_EQ(compile_json_pointer("/store/book/01").first(*document), nullptr);
+    EXPECT_EQ(compile_json_pointer("/store/missing/x").first(*document), nullptr);
+    EXPECT_THROW(compile_json_pointer("store"), std::invalid_argument);
+    EXPECT_THROW(compile_json_pointer("/a~2"), std::invalid_argument);
+
+    // JSONPath
+    EXPECT_EQ(titles(compile_json_path("$.store.book[*]").evaluate(*document)), "SayingsSwordMoby");
+    EXPECT_EQ(titles(compile_json_path("$['store'].book[?(@.price == 8.95)]").evaluate(*document)), "SayingsMoby");
+    EXPECT_EQ(titles(compile_json_path("$.store.book[?(@.price != 8.95)]").evaluate(*document)), "Sword");
+    EXPECT_EQ(titles(compile_json_path("$.store.book[?(@.author == 'Waugh')]").evaluate(*document)), "Sword");
+    EXPECT_EQ(titles(compile_json_path(R"($.store.book[?(@.tags[1] == "c~d")])").evaluate(*document)), "Sayings");
+    EXPECT_EQ(compile_json_path("$.store.book[?(@.price == 12.0)].title").first(*document)->as_string(), "Sword");
+    EXPECT_EQ(compile_json_path("$.store.*.price").evaluate(*document).size(), 1);
+    EXPECT_EQ(compile_json_path("$.store.book[2].isbn").first(*document)->as_string(), "0-553");
+    EXPECT_TRUE(compile_json_path("$.store.book[7]").evaluate(*document).empty());
+    EXPECT_THROW(compile_json_path("store.book"), std::invalid_argument);
+    EXPECT_THROW(compile_json_path("$..book"), std::invalid_argument);
+    EXPECT_THROW(compile_json_path("$.book[?(@.price < 10)]"), std::invalid_argument);
+    EXPECT_THROW(compile_json_path("$.book[?(@.price == [1])]"), std::invalid_argument);
+
+    // over raw text the same queries find the same values
+    for (std::string_view path: {"$.store.book[*].title", "$.store.book[?(@.price == 8.95)].author",
+                                 "$.store.bicycle", "$.store.book[1]", "$.store.*"}) {
+        JsonQuery query = compile_json_path(path);
+        std::vector<const JsonValue*> expected = query.evaluate(*document);
+        std::vector<JsonValue> actual = query.evaluate(std::string_view(json));
+        ASSERT_EQ(actual.size(), expected.size()) << path;
+        for (size_t idx = 0; idx < actual.size(); idx++)
+            EXPECT_EQ(actual[idx].to_string(), expected[idx]->to_string()) << path;
+    }
+
+    // except on repeated keys, where raw text takes each member as written,
+    // as LazyValue does, while parse() keeps the last of them
+    std::string repeated = R"({"k": {"v": 1}, "x": 2, "k": {"v": 3}})";
+    auto parsed = parse(std::string_view(repeated));
+    ASSERT_TRUE(parsed.has_value());
+    EXPECT_EQ(compile_json_path("$.k.v").first(*parsed)->as_int64(), 3);
+    EXPECT_EQ(compile_json_path("$.k.v").evaluate(std::string_view(repeated)).at(0).as_int64(), 1);
+    EXPECT_EQ(compile_json_pointer("/k/v").evaluate(std::string_view(repeated)).at(0).as_int64(), 1);
+    EXPECT_EQ(compile_json_path("$.*").evaluate(*parsed).size(), 2);
+    EXPECT_EQ(compile_json_path("$.*").evaluate(std::string_view(repeated)).size(), 3);
+}
+
+TEST(JsonParserTest, ParseInternsKeys) {
+    std::string json = "[";
+    for (int idx = 0; idx < 1000; idx++)
+        json += std::string(idx ? "," : "") + R"({"id": 1, "name": "n", "tags": {"id": 2}})";
+    json += "]";
+
+    KeyPool pool;
+    KeyPoolScope scope(pool);
+    auto result = parse(std::string_view(json));
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(pool.size(), 3);
+    EXPECT_EQ(parse_simd(json)->to_string(), result->to_string());
+    EXPECT_EQ(parse_parallel(json, ParallelParseOptions{2, 64})->to_string(), result->to_string());
+    for (const auto& record: parse_ndjson(R"({"id": 1, "other": 2})" "\n" R"({"other": 3})", NdjsonOptions{2, 8}))
+        EXPECT_TRUE(record.has_value());
+    EXPECT_EQ(pool.size(), 4);
+}
+
+TEST(JsonParserTest, ParseKeepsMemberOrder) {
+    std::string json = R"({"zeta": 1, "alpha": {"y": [], "x": null}, "mid": 2, "zeta": 3})";
+    std::string expected = R"({"zeta":3,"alpha":{"y":[],"x":null},"mid":2})";
+    EXPECT_EQ(parse(std::string_view(json))->to_string(), expected);
+    EXPECT_EQ(parse_simd(json)->to_string(), expected);
+    EXPECT_EQ(parse_lazy(json).materialize().to_string(), expected);
+}
+
+TEST(JsonParserTest, ParseBorrowed) {
+    std::string json = R"({"plain": "a string long enough to cross a sixteen byte block", "short": "",
+                           "escaped": "tab\tin \"quotes\" past the first block", "list": ["x", "y\\z"]})";
+    auto result = parse_borrowed(json);
+    ASSERT_TRUE(result.has_value());
+
+    auto in_input = [&](std::string_view text) {
+        return text.data() >= json.data() && text.data() + text.size() <= json.data() + json.size();
+    };
+    const JsonValue& plain = result->at("plain");
+    EXPECT_TRUE(plain.is_borrowed());
+    EXPECT_TRUE(in_input(plain.as_string()));
+    EXPECT_EQ(plain.as_string(), "a string long enough to cross a sixteen byte block");
+    EXPECT_TRUE(result->at("short").is_borrowed());
+    EXPECT_TRUE(result->at("list").at(0).is_borrowed());
+    EXPECT_FALSE(result->at("escaped").is_borrowed());
+    EXPECT_FALSE(result->at("list").at(1).is_borrowed());
+    EXPECT_FALSE(parse(std::string_view(json))->at("plain").is_borrowed());
+
+    // copies keep borrowing, the output is the same as for an owning parse
+    JsonValue copy = *result;
+    EXPECT_EQ(copy.at("plain").as_string().data(), plain.as_string().data());
+    EXPECT_EQ(result->to_string(), parse(std::string_view(json))->to_string());
+
+    expect_test_files_parse_alike([](const std::string& document) { return parse_borrowed(document); });
+    for (const auto& filepath: all_json_test_files()) {
+        std::string document = read_json_test_file(filepath);
+        EXPECT_EQ(parse_borrowed(document).error_message(), parse(std::string_view(document)).error_message()) << filepath;
+    }
+}
+
+TEST(JsonParserTest, ParseStats) {
+    std::string json = R"({"a": [1, 2.5, {"b": [true, null]}], "s": "x\ny", "t": "plain"})";
+    ParseStats stats;
+    auto result = parse(std::string_view(json), stats);
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(result->to_string(), parse(std::string_view(json))->to_string());
+
+    EXPECT_EQ(stats.bytes_consumed, json.size());
+    EXPECT_EQ(stats.buffer_refills, 0);
+    EXPECT_EQ(stats.value_count(JsonValue::Type::Object), 2);
+    EXPECT_EQ(stats.value_count(JsonValue::Type::Array), 2);
+    EXPECT_EQ(stats.value_count(JsonValue::Type::Number), 2);
+    EXPECT_EQ(stats.value_count(JsonValue::Type::Boolean), 1);
+    EXPECT_EQ(stats.value_count(JsonValue::Type::Null), 1);
+    EXPECT_EQ(stats.value_count(JsonValue::Type::String), 2);
+    EXPECT_EQ(stats.max_depth, 4);
+    // keys a, b, s, t and the string contents, the escape on its own
+    EXPECT_EQ(stats.string_bytes_copied, 4 + 2 + 5);
+    EXPECT_EQ(stats.string_bytes_escaped, 2);
+    EXPECT_GT(stats.allocations, 0);
+    EXPECT_GT(stats.allocated_bytes, 0);
+
+    // the counters add up over parses, a stream larger than the buffer refills
+    std::string large = "[";
+    for (int idx = 0; idx < 2000; idx++) large += (idx ? "," : "") + std::to_string(idx);
+    large += "]";
+    std::istringstream input(large);
+    ParseStats before = stats;
+    auto streamed = parse(input, stats);
+    ASSERT_TRUE(streamed.has_value());
+    EXPECT_EQ(streamed->as_array().size(), 2000);
+    EXPECT_EQ(stats.bytes_consumed, json.size() + large.size());
+    EXPECT_GT(stats.buffer_refills, 1);
+    EXPECT_EQ(stats.value_count(JsonValue::Type::Number), 2002);
+    EXPECT_EQ(stats.max_depth, 4);
+    EXPECT_GT(stats.allocations, before.allocations);
+
+    std::ostringstream out;
+    out << stats;
+    EXPECT_NE(out.str().find("max depth: 4"), std::string::npos);
+
+    ParseStats failed;
+    EXPECT_FALSE(parse(std::string_view("[1, 2"), failed).has_value());
+}
+
+TEST(JsonParserTest, ParseDepthLimit) {
+    auto nested = [](size_t depth) {
+        std::string json;
+        for (size_t idx = 0; idx < depth; idx++) json += idx % 2 ? R"({"k":)" : "[";
+        json += "0";
+        for (size_t idx = depth; idx > 0; idx--) json += (idx - 1) % 2 ? "}" : "]";
+        return json;
+    };
+
+    // exactly at the limit is fine, one more level is an error at its bracket
+    std::string deepest = nested(DEFAULT_MAX_DEPTH);
+    std::string too_deep = nested(DEFAULT_MAX_DEPTH + 1);
+    EXPECT_TRUE(parse(std::string_view(deepest)).has_value());
+    auto result = parse(std::string_view(too_deep));
+    EXPECT_EQ(result.error(), ParseError::TooDeep);
+    size_t opening = 0;
+    for (size_t idx = 0; idx < DEFAULT_MAX_DEPTH; idx++) opening += idx % 2 ? 5 : 1;
+    EXPECT_EQ(result.location().offset, opening);
+    std::istringstream stream(too_deep);
+    EXPECT_EQ(parse(stream).error(), ParseError::TooDeep);
+    EXPECT_EQ(parse_simd(too_deep).error(), ParseError::TooDeep);
+    EXPECT_TRUE(parse_simd(deepest).has_value());
+    EXPECT_EQ(parse_tape(too_deep).error(), ParseError::TooDeep);
+    EXPECT_TRUE(parse_tape(deepest).has_value());
+    PushParser pushed;
+    pushed.feed(too_deep);
+    auto pushed_result = pushed.take();
+    EXPECT_EQ(pushed_result.error(), ParseError::TooDeep);
+    EXPECT_EQ(pushed_result.location().offset, opening);
+    pushed.feed(deepest);
+    EXPECT_TRUE(pushed.take().has_value());
+    RecordingHandler handler;
+    EXPECT_EQ(parse_sax(std::string_view(too_deep), handler).error, ParseError::TooDeep);
+
+    ParseOptions shallow;
+    shallow.max_depth = 2;
+    EXPECT_TRUE(parse(std::string_view(R"({"a": [1, 2], "b": {}})"), shallow).has_value());
+    EXPECT_EQ(parse(std::string_view(R"({"a": [[1]]})"), shallow).error(), ParseError::TooDeep);
+    PushParser pushed_shallow(shallow);
+    pushed_shallow.feed(R"({"a": [[1]]})");
+    EXPECT_EQ(pushed_shallow.take().error(), ParseError::TooDeep);
+
+    ParseOptions deeper;
+    deeper.max_depth = 5000;
+    auto deep = parse(std::string_view(nested(5000)), deeper);
+    ASSERT_TRUE(deep.has_value());
+    const JsonValue* value = &*deep;
+    for (size_t idx = 0; idx < 4; idx++)
+        value = idx % 2 ? &value->at("k") : &value->at(0);
+    EXPECT_EQ(value->type(), JsonValue::Type::Array);
+    EXPECT_EQ(parse(std::string_view(nested(5001)), deeper).error(), ParseError::TooDeep);
+}
+
+struct Fill {
+    uint32_t quantity = 0;
+    double price = 0;
+};
+
+template <>
+struct JsonFields<Fill> {
+    static constexpr auto fields = std::make_tuple(JSON_FIELD(Fill, quantity), JSON_FIELD(Fill, price));
+};
+
+struct Order {
+    int64_t id = 0;
+    std::string symbol;
+    bool active = false;
+    std::optional<std::string> note;
+    std::vector<Fill> fills;
+    std::vector<std::vector<int>> matrix;
+};
+
+template <>
+struct JsonFields<Order> {
+    static constexpr auto fields = std::make_tuple(JSON_FIELD(Order, id), JSON_FIELD(Order, symbol),
+                                                   JSON_FIELD(Order, active), JSON_FIELD(Order, note),
+                                                   json_field("order_fills", &Order::fills), JSON_FIELD(Order, matrix));
+};
+
+TEST(JsonParserTest, ParseInto) {
+    std::string json = R"({"id": -42, "symbol": "ACME", "ignored": {"deep": [1, {"x": null}]}, "active": true,
+                           "note": null, "order_fills": [{"quantity": 10, "price": 1.5}, {"price": 2e2}],
+                           "matrix": [[1, 2], []]})";
+    auto order = parse_into<Order>(json);
+    ASSERT_TRUE(order.has_value());
+    EXPECT_EQ(order->id, -42);
+    EXPECT_EQ(order->symbol, "ACME");
+    EXPECT_TRUE(order->active);
+    EXPECT_FALSE(order->note.has_value());
+    ASSERT_EQ(order->fills.size(), 2);
+    EXPECT_EQ(order->fills[0].quantity, 10);
+    EXPECT_EQ(order->fills[0].price, 1.5);
+    EXPECT_EQ(order->fills[1].quantity, 0);
+    EXPECT_EQ(order->fills[1].price, 200);
+    EXPECT_EQ(order->matrix, (std::vector<std::vector<int>>{{1, 2}, {}}));
+
+    // written in declaration order, and read back the same
+    order->note = "rush \"now\"\n";
+    std::string written = serialize(*order);
+    EXPECT_EQ(written, R"({"id":-42,"symbol":"ACME","active":true,"note":"rush \"now\"\n",)"
+                       R"("order_fills":[{"quantity":10,"price":1.5},{"quantity":0,"price":200}],"matrix":[[1,2],[]]})");
+    EXPECT_EQ(parse(std::string_view(written))->to_string(), written);
+    std::istringstream stream(written);
+    Order again;
+    ASSERT_TRUE(parse_into(stream, again));
+    EXPECT_EQ(again.note, order->note);
+    EXPECT_EQ(serialize(again), written);
+
+    // values that do not fit their member, and syntax errors as parse() has them
+    EXPECT_EQ(parse_into(R"({"id": "7"})", again).error, ParseError::TypeMismatch);
+    EXPECT_EQ(parse_into(R"({"id": 1.5})", again).error, ParseError::TypeMismatch);
+    EXPECT_EQ(parse_into(R"({"active": null})", again).error, ParseError::TypeMismatch);
+    EXPECT_EQ(parse_into(R"({"order_fills": [{"quantity": -1}]})", again).error, ParseError::TypeMismatch);
+    auto status = parse_into(R"({"id": 1, "symbol": [1]})", again);
+    EXPECT_EQ(status.error, ParseError::TypeMismatch);
+    EXPECT_EQ(status.location.offset, 20);
+    EXPECT_EQ(parse_into(R"({"id": 1,})", again).error, ParseError::ExpectedKey);
+    EXPECT_EQ(parse_into(R"({"id": 1} x)", again).error, ParseError::TrailingCharacters);
+    EXPECT_EQ(parse_into(R"({"ignored": [1,]})", again).error, ParseError::UnexpectedCharacter);
+    EXPECT_FALSE(parse_into<Order>(R"({"id": 1)").has_value());
+
+    std::vector<Fill> fills;
+    ASSERT_TRUE(parse_into(R"([{"quantity": 4294967295}])", fills));
+    EXPECT_EQ(fills[0].quantity, 4294967295u);
+    EXPECT_EQ(parse_into(R"([{"quantity": 4294967296}])", fills).error, ParseError::TypeMismatch);
+
+    // a skipped member counts the containers around it, like parse() does
+    auto skipped = [](size_t depth) {
+        return R"({"x": )" + std::string(depth, '[') + std::string(depth, ']') + R"(, "quantity": 1})";
+    };
+    Fill fill;
+    EXPECT_TRUE(parse_into(skipped(DEFAULT_MAX_DEPTH - 1), fill));
+    EXPECT_EQ(parse_into(skipped(DEFAULT_MAX_DEPTH), fill).error, ParseError::TooDeep);
+    EXPECT_EQ(parse(std::string_view(skipped(DEFAULT_MAX_DEPTH))).error(), ParseError::TooDeep);
+}
+
+TEST(JsonParserTest, BinaryEncoding) {
+    std::string json = R"({"small": [0, 127, 128, 65536, 4294967296, 18446744073709551615],
+                           "signed": [-1, -32, -33, -129, -40000, -3000000000, -9223372036854775808],
+                           "real": [0.5, -0.0, 0.1, 1e300, 3.4028234663852886e38, 1e39],
+                           "text": ["", "short", "a string longer than thirty-one bytes"],
+                           "flags": [true, false, null], "nested": {"small": {}, "text": []}})";
+    JsonValue value = *parse(std::string_view(json));
+    std::string binary;
+    write_binary(value, binary);
+    ASSERT_TRUE(binary.starts_with(BINARY_MAGIC));
+
+    auto decoded = read_binary(binary);
+    ASSERT_TRUE(decoded.has_value()) << decoded.error_message();
+    EXPECT_EQ(decoded->to_string(), value.to_string());
+    EXPECT_EQ(decoded->at("signed").at(0).number_type(), JsonValue::NumberType::Int64);
+    EXPECT_EQ(decoded->at("small").at(0).number_type(), JsonValue::NumberType::UInt64);
+    EXPECT_TRUE(std::signbit(decoded->at("real").at(1).as_double()));
+
+    std::ostringstream stream;
+    write_binary(value, stream);
+    EXPECT_EQ(stream.str(), binary);
+
+    // repeated keys are written once, records come out well below the text
+    std::string records = "[";
+    for (int idx = 0; idx < 1000; idx++)
+        records += std::string(idx ? "," : "") + R"({"id":)" + std::to_string(idx) + R"(,"price":)" +
+                   std::to_string(idx * 0.25) + R"(,"active":true,"tags":["a","b"]})";
+    records += "]";
+    std::string packed;
+    write_binary(*parse(std::string_view(records)), packed);
+    EXPECT_LT(packed.size(), records.size() / 2);
+    EXPECT_EQ(read_binary(packed)->to_string(), parse(std::string_view(records))->to_string());
+
+    // malformed input
+    EXPECT_EQ(read_binary("").error(), ParseError::UnexpectedEnd);
+    EXPECT_EQ(read_binary("{}").error(), ParseError::InvalidEncoding);
+    for (size_t size = BINARY_MAGIC.size(); size < binary.size(); size += 7)
+        EXPECT_EQ(read_binary(std::string_view(binary).substr(0, size)).error(), ParseError::UnexpectedEnd) << size;
+    std::string bad_tag = std::string(BINARY_MAGIC) + "\x8e\x01\x90";
+    auto result = read_binary(bad_tag);
+    EXPECT_EQ(result.error(), ParseError::InvalidEncoding);
+    EXPECT_EQ(result.location().offset, 5);
+    EXPECT_EQ(read_binary(std::string(BINARY_MAGIC) + "\x8f\x01\x02\x80").error(), ParseError::InvalidEncoding);
+    EXPECT_EQ(read_binary(binary + "\x80").error(), ParseError::TrailingCharacters);
+    std::string nested(BINARY_MAGIC);
+    for (size_t depth = 0; depth <= DEFAULT_MAX_DEPTH; depth++) nested += "\x8e\x01";
+    EXPECT_EQ(read_binary(nested + "\x80").error(), ParseError::TooDeep);
+
+    for (const auto& filepath: all_json_test_files()) {
+        std::string document = read_json_test_file(filepath);
+        auto expected = parse(std::string_view(document));
+        if (!expected.has_value()) continue;
+        std::string encoded;
+        write_binary(*expected, encoded);
+        EXPECT_EQ(read_binary(encoded)->to_string(), expected->to_string()) << filepath;
+    }
+}
+
+TEST(JsonParserTest, ParsePushed) {
+    std::string json = R"({"name": "push\tparser", "list": [1, -2.5e3, true, false, null, [], {}],
+                           "nested": {"deep": [[{"x": 18446744073709551615}]]}})";
+    std::string expected = parse(std::string_view(json))->to_string();
+
+    // every split of the input, down to a byte at a time
+    for (size_t piece: {json.size(), size_t(7), size_t(3), size_t(1)}) {
+        PushParser parser;
+        PushParser::Status status = PushParser::Status::NeedMoreData;
+        for (size_t pos = 0; pos < json.size(); pos += piece) {
+            ASSERT_EQ(status, PushParser::Status::NeedMoreData) << piece;
+            status = parser.feed(std::string_view(json).substr(pos, piece));
+        }
+        ASSERT_EQ(status, PushParser::Status::ValueComplete) << piece;
+        EXPECT_EQ(parser.take()->to_string(), expected) << piece;
+    }
+
+    // documents back to back in one piece, the rest is left for the next one
+    PushParser parser;
+    std::string_view pipelined = " [1, 2]\n{\"a\": \"b\"}\n[";
+    ASSERT_EQ(parser.feed(pipelined), PushParser::Status::ValueComplete);
+    EXPECT_EQ(parser.consumed(), 7);
+    EXPECT_EQ(parser.take()->to_string(), "[1,2]");
+    pipelined.remove_prefix(7);
+    ASSERT_EQ(parser.feed(pipelined), PushParser::Status::ValueComplete);
+    EXPECT_EQ(parser.take()->to_string(), R"({"a":"b"})");
+    pipelined.remove_prefix(parser.consumed());
+    EXPECT_EQ(parser.feed(pipelined), PushParser::Status::NeedMoreData);
+    EXPECT_EQ(parser.consumed(), 2);
+
+    // input ending early, and errors with their location
+    auto result = parser.take();
+    EXPECT_EQ(result.error(), ParseError::UnexpectedEnd);
+    EXPECT_EQ(parser.finish(), PushParser::Status::Error);
+    EXPECT_EQ(parser.take().error(), ParseError::EmptyDocument);
+
+    parser.feed("[1,\n");
+    EXPECT_EQ(parser.feed(" 2 3]"), PushParser::Status::Error);
+    EXPECT_EQ(parser.feed("]"), PushParser::Status::Error);
+    result = parser.take();
+    EXPECT_EQ(result.error(), ParseError::ExpectedCommaOrArrayEnd);
+    EXPECT_EQ(result.location().line, 2);
+    EXPECT_EQ(result.location().column, 4);
+    EXPECT_EQ(result.location().offset, 7);
+
+    for (std::string_view bad: {"7", "[tru ", "[\"\\x\"]", "{\"a\" 1}", "[1.]", "[1e]", "{]"}) {
+        parser.feed(bad);
+        EXPECT_FALSE(parser.take().has_value()) << bad;
+    }
+
+    // accepts and builds what parse() does, fed in small pieces
+    expect_test_files_parse_alike([&](const std::string& document) -> std::optional<JsonValue> {
+        size_t pos = 0;
+        while (pos < document.size() && parser.status() == PushParser::Status::NeedMoreData) {
+            std::string_view piece = std::string_view(document).substr(pos, 5);
+            parser.feed(piece);
+            pos += parser.consumed();
+        }
+        bool trailing = parser.status() == PushParser::Status::ValueComplete &&
+                        document.find_first_not_of(" \t\r\n", pos) != std::string::npos;
+        std::optional<JsonValue> pushed = parser.take();
+        if (trailing) return std::nullopt;
+        return pushed;
+    });
+}
+
+TEST(JsonParserTest, Snapshot) {
+    std::string source = testing::TempDir() + "snapshot_source.json";
+    std::string path = testing::TempDir() + "snapshot_source.snap";
+    std::filesystem::remove(path);
+    std::ofstream(source) << R"({"zeta": [1, -2, 18446744073709551615, 0.5, "text", true, false, null],
+                                 "alpha": {"b": {}, "a": []}, "mid": "value"})";
+
+    auto snapshot = load_snapshot(source, path);
+    ASSERT_TRUE(snapshot.has_value());
+    SnapshotView root = snapshot->root();
+    ASSERT_EQ(root.type(), JsonValue::Type::Object);
+    EXPECT_EQ(root.size(), 3);
+    EXPECT_EQ(root.at("mid").as_string(), "value");
+    SnapshotView zeta = root.at("zeta");
+    EXPECT_EQ(zeta.size(), 8);
+    EXPECT_EQ(zeta.at(1).as_int64(), -2);
+    EXPECT_EQ(zeta.at(2).as_uint64(), UINT64_MAX);
+    EXPECT_EQ(zeta.at(3).as_double(), 0.5);
+    EXPECT_EQ(zeta.at(4).as_string(), "text");
+    EXPECT_TRUE(zeta.at(5).as_boolean());
+    EXPECT_EQ(zeta.at(7).type(), JsonValue::Type::Null);
+    EXPECT_TRUE(root.exists("alpha"));
+    EXPECT_FALSE(root.exists("beta"));
+    EXPECT_FALSE(zeta.exists(8));
+    EXPECT_THROW(root.at("beta"), std::out_of_range);
+    EXPECT_THROW(zeta.at(8), std::runtime_error);
+    EXPECT_THROW(root.as_string(), std::runtime_error);
+    // keys are sorted
+    EXPECT_EQ(root.key_at(0), "alpha");
+    EXPECT_EQ(root.value_at(2).size(), 8);
+    EXPECT_EQ(root.at("alpha").materialize().to_string(), R"({"a":[],"b":{}})");
+
+    // current, so it is opened as it is
+    EXPECT_TRUE(open_snapshot(path, source).has_value());
+    EXPECT_TRUE(open_snapshot(path).has_value());
+
+    // a changed source makes it stale and load_snapshot() rebuilds it
+    std::ofstream(source) << R"({"mid": "changed value"})";
+    EXPECT_FALSE(open_snapshot(path, source).has_value());
+    snapshot = load_snapshot(source, path);
+    ASSERT_TRUE(snapshot.has_value());
+    EXPECT_EQ(snapshot->root().at("mid").as_string(), "changed value");
+    EXPECT_FALSE(snapshot->root().exists("zeta"));
+
+    // anything but a whole snapshot of this version is rejected
+    std::stringstream contents;
+    contents << std::ifstream(path, std::ios::binary).rdbuf();
+    std::string bytes = contents.str();
+    auto write_file = [&](const std::string& contents) { std::ofstream(path, std::ios::binary | std::ios::trunc) << contents; };
+    write_file(bytes.substr(0, bytes.size() - 1));
+    EXPECT_FALSE(open_snapshot(path).has_value());
+    std::string other_version = bytes;
+    other_version[offsetof(SnapshotHeader, version)]++;
+    write_file(other_version);
+    EXPECT_FALSE(open_snapshot(path).has_value());
+    write_file("{}");
+    EXPECT_FALSE(open_snapshot(path).has_value());
+    EXPECT_FALSE(load_snapshot(testing::TempDir() + "does_not_exist.json", path).has_value());
+
+    // offsets pointing outside the file throw instead of being followed
+    std::string damaged = bytes;
+    uint64_t payload = uint64_t(1) << 40;
+    std::memcpy(damaged.data() + offsetof(SnapshotHeader, root) + offsetof(SnapshotNode, payload), &payload, sizeof(payload));
+    write_file(damaged);
+    snapshot = open_snapshot(path);
+    ASSERT_TRUE(snapshot.has_value());
+    EXPECT_THROW(snapshot->root().at("mid"), std::runtime_error);
+
+    // an array whose element is the array itself ends at the nesting limit
+    ASSERT_TRUE(write_snapshot(*parse(std::string_view("[[]]")), path));
+    contents.str("");
+    contents << std::ifstream(path, std::ios::binary).rdbuf();
+    std::string cyclic = contents.str();
+    SnapshotNode root_node;
+    std::memcpy(&root_node, cyclic.data() + offsetof(SnapshotHeader, root), sizeof(root_node));
+    std::memcpy(cyclic.data() + root_node.payload, &root_node, sizeof(root_node));
+    write_file(cyclic);
+    snapshot = open_snapshot(path);
+    ASSERT_TRUE(snapshot.has_value());
+    EXPECT_EQ(snapshot->root().at(0).at(0).size(), 1);
+    EXPECT_THROW(snapshot->root().materialize(), std::runtime_error);
+
+    // what parse() accepts fits, anything deeper is refused
+    std::string deepest = std::string(DEFAULT_MAX_DEPTH, '[') + std::string(DEFAULT_MAX_DEPTH, ']');
+    ASSERT_TRUE(write_snapshot(*parse(std::string_view(deepest)), path));
+    EXPECT_EQ(open_snapshot(path)->root().materialize().to_string(), deepest);
+    ParseOptions deeper;
+    deeper.max_depth = DEFAULT_MAX_DEPTH + 1;
+    auto too_deep = parse(std::string_view("[" + deepest + "]"), deeper);
+    ASSERT_TRUE(too_deep.has_value());
+    EXPECT_THROW(write_snapshot(*too_deep, path), std::length_error);
+
+    // a value round trips, apart from the member order
+    for (const auto& filepath: all_json_test_files()) {
+        auto expected = parse_file(json_test_file_path(filepath));
+        if (!expected.has_value()) continue;
+        ASSERT_TRUE(write_snapshot(*expected, path));
+        JsonValue materialized = open_snapshot(path)->root().materialize();
+        ASSERT_TRUE(write_snapshot(materialized, path + "2"));
+        EXPECT_EQ(open_snapshot(path + "2")->root().materialize().to_string(), materialized.to_string()) << filepath;
+        EXPECT_EQ(materialized.to_string().size(), expected->to_string().size()) << filepath;
+    }
+}
+
+TEST(JsonParserTest, ParseCache) {
+    ParseCache cache(1 << 20, 4);
+    std::string json = R"({"poll": [1, 2, 3], "status": "ok"})";
+    auto first = cache.parse(json);
+    ASSERT_TRUE(first->has_value());
+    EXPECT_EQ((*first)->at("status").as_string(), "ok");
+
+    // a repeat is the same document, from another buffer too
+    std::string repeat = json;
+    auto second = cache.parse(repeat);
+    EXPECT_EQ(first.get(), second.get());
+    EXPECT_NE(cache.parse(json + " ").get(), first.get());
+
+    // failures are kept along with where they happened
+    auto failed = cache.parse("[1,");
+    EXPECT_EQ(failed->error(), ParseError::UnexpectedEnd);
+    EXPECT_EQ(cache.parse("[1,").get(), failed.get());
+
+    ParseCache::Counters counters = cache.counters();
+    EXPECT_EQ(counters.hits, 2);
+    EXPECT_EQ(counters.misses, 3);
+    EXPECT_EQ(counters.evictions, 0);
+    EXPECT_EQ(counters.entries, 3);
+    EXPECT_GT(counters.bytes, json.size());
+
+    // least recently used documents make way for new ones, and stay valid for
+    // whoever still holds them
+    ParseCache small(8 * 1024, 1);
+    auto oldest = small.parse(R"(["oldest"])");
+    for (int idx = 0; idx < 100; idx++)
+        small.parse("[" + std::to_string(idx) + "]");
+    counters = small.counters();
+    EXPECT_GT(counters.evictions, 0);
+    EXPECT_LE(counters.bytes, 8 * 1024);
+    EXPECT_EQ(counters.entries + counters.evictions, 101);
+    EXPECT_EQ((*oldest)->at(0).as_string(), "oldest");
+    EXPECT_NE(small.parse(R"(["oldest"])").get(), oldest.get());
+    auto recent = small.parse("[99]");
+    EXPECT_EQ(small.parse("[99]").get(), recent.get());
+
+    // too large for the budget, parsed but not kept
+    std::string large = "[\"" + std::string(16 * 1024, 'x') + "\"]";
+    EXPECT_TRUE(small.parse(large)->has_value());
+    EXPECT_NE(small.parse(large).get(), small.parse(large).get());
+
+    small.clear();
+    EXPECT_EQ(small.counters().entries, 0);
+    EXPECT_EQ(small.counters().bytes, 0);
+
+    // many threads over a few inputs agree on every document
+    std::vector<std::string> inputs;
+    for (int idx = 0; idx < 8; idx++) inputs.push_back(R"({"id": )" + std::to_string(idx) + "}");
+    ParseCache shared(1 << 20);
+    std::vector<std::thread> threads;
+    std::atomic<int> wrong{0};
+    for (int thread = 0; thread < 4; thread++)
+        threads.emplace_back([&]() {
+            for (int idx = 0; idx < 1000; idx++) {
+                auto result = shared.parse(inputs[idx % inputs.size()]);
+                if ((*result)->at("id").as_int64() != idx % 8) wrong++;
+            }
+        });
+    for (auto& thread: threads) thread.join();
+    EXPECT_EQ(wrong, 0);
+    counters = shared.counters();
+    EXPECT_EQ(counters.hits + counters.misses, 4000);
+    EXPECT_EQ(counters.entries, 8);
+
+    // a document cached under a scoped pool outlives that pool
+    ParseCache scoped(1 << 20);
+    {
+        KeyPool pool;
+        KeyPoolScope scope(pool);
+        scoped.parse(R"({"scoped key": [1, 2]})");
+    }
+    std::thread([&]() {
+        auto hit = scoped.parse(R"({"scoped key": [1, 2]})");
+        EXPECT_EQ((*hit)->as_object().begin()->first.view(), "scoped key");
+        EXPECT_EQ((*hit)->at("scoped key").at(1).as_int64(), 2);
+    }).join();
+    EXPECT_EQ(scoped.counters().hits, 1);
+
+    // and one cached under a scoped default resource outlives that resource,
+    // whose memory is scribbled over once it is gone
+    ParseCache arena_default(1 << 20);
+    std::vector<char> buffer(64 * 1024);
+    {
+        std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+        DefaultResourceScope scope(&arena);
+        arena_default.parse(R"({"arena key": ["a string too long for the small string buffer"]})");
+    }
+    std::fill(buffer.begin(), buffer.end(), '\xff');
+    auto hit = arena_default.parse(R"({"arena key": ["a string too long for the small string buffer"]})");
+    EXPECT_EQ((*hit)->at("arena key").at(0).as_string(), "a string too long for the small string buffer");
+    EXPECT_EQ(arena_default.counters().hits, 1);
+}
+
+// escapes are decoded to UTF-8 and strings are checked to be UTF-8, the same
+// on every path a string can take
+TEST(JsonParserTest, ParseStringDecoding) {
+    std::string json = R"(["quote \" backslash \\ slash \/ \b\f\n\r\t", "\u00e9\u20AC\ud83d\ude00 \u0041",
+                           "caf)" "\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80" R"(", "long run of plain ASCII text before é"])";
+    std::vector<std::string> expected = {"quote \" backslash \\ slash / \b\f\n\r\t",
+                                         "\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80 A",
+                                         "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80",
+                                         "long run of plain ASCII text before \xc3\xa9"};
+    auto check = [&](const JsonValue& value, const std::string& how) {
+        ASSERT_EQ(value.as_array().size(), expected.size()) << how;
+        for (size_t idx = 0; idx < expected.size(); idx++)
+            EXPECT_EQ(value.at(int(idx)).as_string(), expected[idx]) << how << " " << idx;
+    };
+    check(*parse(std::string_view(json)), "span");
+    std::istringstream stream(json);
+    check(*parse(stream), "stream");
+    check(*parse_borrowed(json), "borrowed");
+    check(*parse_simd(json), "simd");
+    check(parse_tape(json)->root().materialize(), "tape");
+    PushParser pusher;
+    for (char c: json) pusher.feed(&c, 1);
+    check(*pusher.take(), "pushed");
+    EXPECT_EQ(parse_lazy(json).at(1).as_string(), expected[1]);
+
+    // decoded keys, and written back out escaped only where JSON requires it
+    auto keyed = parse(std::string_view(R"({"k\u00e9y\n": 1})"));
+    EXPECT_TRUE(keyed->exists("k\xc3\xa9y\n"));
+    EXPECT_EQ(keyed->to_string(), "{\"k\xc3\xa9y\\n\":1}");
+
+    // malformed strings, with the offset of the offending byte
+    std::vector<std::pair<std::string, ParseError>> malformed = {
+        {R"(["\ud83d"])", ParseError::InvalidEscape},
+        {R"(["\ud83dx"])", ParseError::InvalidEscape},
+        {R"(["\ud83dA"])", ParseError::InvalidEscape},
+        {R"(["\ude00"])", ParseError::InvalidEscape},
+        {R"(["\u12g4"])", ParseError::InvalidEscape},
+        {"[\"tab\tinside\"]", ParseError::UnexpectedCharacter},
+        {"[\"line\nbreak\"]", ParseError::UnexpectedCharacter},
+        {"[\"bad \xc3\x28\"]", ParseError::InvalidUtf8},
+        {"[\"overlong \xc0\xaf\"]", ParseError::InvalidUtf8},
+        {"[\"surrogate \xed\xa0\x80\"]", ParseError::InvalidUtf8},
+        {"[\"too large \xf4\x90\x80\x80\"]", ParseError::InvalidUtf8},
+        {"[\"cut short \xe2\x82\"]", ParseError::InvalidUtf8},
+        {"[\"orphan \x80 past the first sixteen bytes\"]", ParseError::InvalidUtf8},
+    };
+    for (const auto& [text, error]: malformed) {
+        EXPECT_EQ(parse(std::string_view(text)).error(), error) << text;
+        std::istringstream input(text);
+        EXPECT_EQ(parse(input).error(), error) << text;
+        EXPECT_EQ(parse_simd(text).error(), error) << text;
+        PushParser parser;
+        for (char c: text) parser.feed(&c, 1);
+        EXPECT_EQ(parser.take().error(), error) << text;
+    }
+    EXPECT_EQ(parse(std::string_view("[\"orphan \x80 past the first sixteen bytes\"]")).location().offset, 9);
+    EXPECT_EQ(parse(std::string_view("[\"tab\tinside\"]")).location().offset, 5);
+
+    // every engine agrees on where the first invalid byte is
+    std::string text = std::string(40, 'a') + "\xe2\x82\xac" + std::string(40, 'b') + "\xe2\x28\xa1" + "tail";
+    for (SimdEngine engine: {SimdEngine::Scalar, SimdEngine::SSE42, SimdEngine::AVX2}) {
+        EXPECT_EQ(find_invalid_utf8(text, engine), 83) << simd_engine_name(engine);
+        EXPECT_EQ(find_invalid_utf8(std::string_view(text).substr(0, 83), engine), 83) << simd_engine_name(engine);
+        EXPECT_EQ(find_invalid_utf8(std::string_view(text).substr(0, 42), engine), 40) << simd_engine_name(engine);
+    }
+}
+
+// Test case for validate() agreeing with parse(); that it does not allocate is
+// checked in validate_test.cpp, which counts heap allocations
+TEST(JsonParserTest, Validate) {
+    std::string document = R"({"name": "a string too long for the small string buffer",
+        "escaped": "tab\t quote\" \u00e9\ud83d\ude00", "raw": "é€😀",
+        "numbers": [0, -12, 3.25e-4, 18446744073709551615, 123456789012345678901234567890],
+        "nested": [[[{"deep": [true, false, null]}]]], "empty": {}, "none": []})";
+    std::string deep = std::string(DEFAULT_MAX_DEPTH, '[') + std::string(DEFAULT_MAX_DEPTH, ']');
+    EXPECT_TRUE(validate(document));
+    EXPECT_TRUE(validate(deep));
+    std::istringstream stream(document);
+    EXPECT_TRUE(validate(stream));
+
+    // the same error at the same place as parse() with the same reader
+    std::vector<std::string> invalid = {
+        "", " 42", "[1, 2", "[1 2]", "[tru]", "[-]", "[1.]", "[1e400]", "[\"\\x\"]", "[\"\\ud800\"]",
+        "[\"a\x01\"]", "[\"\xC3\x28\"]", "{1: 2}", "{\"a\" 2}", "{\"a\": 1,}", "{} x",
+        "[" + deep + "]", "{\"a\": [1, {\"b\": \"unterminated}]}"};
+    for (const std::string& input: invalid) {
+        ParseResult expected = parse(std::string_view(input));
+        ASSERT_FALSE(expected.has_value()) << input;
+        ParseStatus status = validate(input);
+        EXPECT_EQ(status.error, expected.error()) << input;
+        EXPECT_EQ(status.location.offset, expected.location().offset) << input;
+
+        std::istringstream input_stream(input), parse_stream(input);
+        ParseResult expected_streamed = parse(parse_stream);
+        ParseStatus streamed = validate(input_stream);
+        EXPECT_EQ(streamed.error, expected_streamed.error()) << input;
+        EXPECT_EQ(streamed.location.offset, expected_streamed.location().offset) << input;
+    }
+
+    for (int i = 1; i <= 33; i++) {
+        std::string path = "data/tests/official/fail" + std::to_string(i) + ".json";
+        auto file = open_json_test_file(path);
+        std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        EXPECT_EQ(bool(validate(contents)), parse(std::string_view(contents)).has_value()) << path;
+    }
+}
 
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
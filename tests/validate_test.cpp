@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include "parser.h"
+#include <cstdlib>
+#include <new>
+
+// operator new is replaced for this whole binary, which is why this test has
+// a binary of its own, so that it can count what one thread takes from the heap
+thread_local size_t heap_allocations = 0;
+
+void* operator new(size_t size) {
+    heap_allocations++;
+    if (void* block = std::malloc(size ? size : 1))
+        return block;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* block) noexcept {
+    std::free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    std::free(block);
+}
+
+// Test case for validating documents without a single heap allocation
+TEST(JsonParserTest, ValidateAllocations) {
+    std::string document = R"({"name": "a string too long for the small string buffer",
+        "escaped": "tab\t quote\" \u00e9\ud83d\ude00", "raw": "é€😀",
+        "numbers": [0, -12, 3.25e-4, 18446744073709551615, 123456789012345678901234567890],
+        "nested": [[[{"deep": [true, false, null]}]]], "empty": {}, "none": []})";
+    std::string deep = std::string(DEFAULT_MAX_DEPTH, '[') + std::string(DEFAULT_MAX_DEPTH, ']');
+
+    size_t before = heap_allocations;
+    ParseStatus from_buffer = validate(document);
+    ParseStatus from_deep = validate(deep);
+    size_t allocations = heap_allocations - before;
+    EXPECT_TRUE(from_buffer);
+    EXPECT_TRUE(from_deep);
+    EXPECT_EQ(allocations, 0);
+
+    std::istringstream stream(document);
+    before = heap_allocations;
+    ParseStatus from_stream = validate(stream);
+    allocations = heap_allocations - before;
+    EXPECT_TRUE(from_stream);
+    EXPECT_EQ(allocations, 0);
+
+    // failing is no different
+    before = heap_allocations;
+    ParseStatus failed = validate(std::string_view(R"({"a": [1, {"b": "\x"}]})"));
+    allocations = heap_allocations - before;
+    EXPECT_EQ(failed.error, ParseError::InvalidEscape);
+    EXPECT_EQ(allocations, 0);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}